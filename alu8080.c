@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include "alu8080.h"
+#include "cpu8080.h"
+
+uint8_t zsp_table[256];
+uint16_t add_table[2][256][256];
+uint16_t sub_table[2][256][256];
+uint16_t daa_table[4][256];
+
+static bool alu_tables_built = false;
+
+void init_alu8080(void) {
+    /* The tables are built from the definitions in the Assembly Language Programming Manual rather than by calling the
+       functions do_opcode used to use, so that alu8080_self_check() compares two independent implementations. */
+    int a, byte, carry, aux_carry, bits, i, full;
+    uint8_t result, flags, tmp_8;
+
+    if (alu_tables_built) {
+        return;
+    }
+
+    for (byte = 0; byte < 256; byte++) {
+        flags = 0;
+        if (byte == 0) {
+            flags |= FLAG_ZERO;
+        }
+        if (byte & 0x80) {
+            flags |= FLAG_SIGN;
+        }
+        bits = 0;
+        for (i = 0; i < 8; i++) {
+            bits += (byte >> i) & 0x01;
+        }
+        if ((bits % 2) == 0) {
+            flags |= FLAG_PARITY;
+        }
+        zsp_table[byte] = flags;
+    }
+
+    for (carry = 0; carry < 2; carry++) {
+        for (a = 0; a < 256; a++) {
+            for (byte = 0; byte < 256; byte++) {
+                // addition: carry out of bit 7 sets CY, carry out of bit 3 sets AC.
+                full = a + byte + carry;
+                result = (uint8_t)full;
+                flags = zsp_table[result];
+                if (full > 0xFF) {
+                    flags |= FLAG_CARRY;
+                }
+                if (((a & 0x0F) + (byte & 0x0F) + carry) > 0x0F) {
+                    flags |= FLAG_AUX_CARRY;
+                }
+                add_table[carry][a][byte] = (flags << 8) | result;
+
+                /* subtraction: CY is set on a borrow out of bit 7.  The 8080 subtracts by adding the one's complement
+                   plus one (or plus zero if there is a borrow in), and AC is the carry out of bit 3 of that addition. */
+                full = a - byte - carry;
+                result = (uint8_t)full;
+                flags = zsp_table[result];
+                if (full < 0) {
+                    flags |= FLAG_CARRY;
+                }
+                if (((a & 0x0F) + ((~byte) & 0x0F) + (1 - carry)) > 0x0F) {
+                    flags |= FLAG_AUX_CARRY;
+                }
+                sub_table[carry][a][byte] = (flags << 8) | result;
+            }
+        }
+    }
+
+    for (i = 0; i < 4; i++) {
+        carry = i & 0x01;
+        aux_carry = (i >> 1) & 0x01;
+        for (a = 0; a < 256; a++) {
+            /* 1. If the low 4 bits of the accumulator are greater than 9 or AC is set, add 6.
+               2. If the high 4 bits are now greater than 9 or CY is set, add 6 to the high 4 bits.  
+               The 8080 decides step 2 from the original accumulator (a > 0x99), and CY is only ever set, never cleared. */
+            tmp_8 = (uint8_t)a;
+            if (aux_carry || ((a & 0x0F) > 0x09)) {
+                tmp_8 += 0x06;
+            }
+            flags = 0;
+            if (carry || (a > 0x99)) {
+                tmp_8 += 0x60;
+                flags |= FLAG_CARRY;
+            }
+            if ((a ^ tmp_8) & 0x10) {
+                flags |= FLAG_AUX_CARRY;
+            }
+            flags |= zsp_table[tmp_8];
+            daa_table[i][a] = (flags << 8) | tmp_8;
+        }
+    }
+
+    alu_tables_built = true;
+}
+
+/* What follows are the flag computations do_opcode used before the tables existed, kept as the reference the tables are
+   checked against.  They work on a scratch cpu8080 with the flags materialized. */
+
+static void reference_addition(cpu8080 *cpu, uint8_t byte, bool add_one_for_carry) {
+    uint8_t a_low, byte_low, low_tmp;
+    uint16_t tmp; // avoids overflow
+    // There is likely a better-performing way to compute AC but this is easy to understand.  If adding the low nibble causes a carry,
+    // then the AC flag is true.
+    a_low = cpu->a & 0x0F;
+    byte_low = byte & 0x0F;
+    low_tmp = a_low + byte_low;
+    if (add_one_for_carry) {
+        low_tmp++;
+    }
+    cpu->auxiliary_carry_flag = (bool)(low_tmp > 0xF);
+
+    tmp = (add_one_for_carry) ? byte + 1 : byte;
+    tmp = tmp + cpu->a;
+    cpu->carry_flag = (bool) (tmp > 0xFF);
+    cpu->a = (uint8_t)(tmp & 0xFF);
+    set_zero_sign_parity_from_byte(cpu, cpu->a);
+}
+
+static void reference_subtraction(cpu8080 *cpu, uint8_t byte, bool subtract_one_for_borrow) {
+    uint16_t tmp, q;  // avoids overflow
+    tmp = (subtract_one_for_borrow) ? byte + 1 : byte;
+    cpu -> carry_flag = (bool)((uint16_t) (cpu->a) < tmp);
+    q = ((uint16_t)(cpu->a)) - tmp;
+    set_zero_sign_parity_from_byte(cpu, (uint8_t)(q & 0xFF));
+    // taking logic from MAME emulator
+    cpu->auxiliary_carry_flag = (bool)((~(cpu->a ^ ((uint8_t)(q & 0xFF)) ^ byte)) & 0x10);
+    cpu->a = (uint8_t)(q & 0xFF);
+}
+
+static void reference_daa(cpu8080 *cpu) {
+    uint8_t tmp_8;
+    // copying the MAME logic
+    tmp_8 = cpu->a;
+    if (cpu->auxiliary_carry_flag || ((cpu->a & 0xF) > 0x9)) {
+        tmp_8 = tmp_8 + 0x06;
+    }
+    if (cpu->carry_flag || (cpu->a > 0x99)) {
+        tmp_8 = tmp_8 + 0x60;
+    }
+    cpu->carry_flag = (bool)(cpu->carry_flag || (cpu->a > 0x99));
+    cpu->auxiliary_carry_flag = (bool)((cpu->a ^ tmp_8) & 0x10);
+    cpu->a = (uint8_t)(tmp_8 & 0xFF);
+    set_zero_sign_parity_from_byte(cpu, cpu->a);
+}
+
+static bool check_entry(char *table_name, int carry, int a, int byte, uint16_t entry, cpu8080 *cpu) {
+    // get_byte_from_flags() always sets bit 1, which the tables leave out.
+    uint16_t expected = ((get_byte_from_flags(cpu) & ~0x02) << 8) | cpu->a;
+    if (entry != expected) {
+        printf("ALU self check: %s[%d][0x%02X][0x%02X] is 0x%04X, expected 0x%04X\n", table_name, carry, a, byte, entry, expected);
+        return false;
+    }
+    return true;
+}
+
+bool alu8080_self_check(void) {
+    // Compares every table entry against the reference functions.  Returns true if they all match.
+    cpu8080 cpu;
+    int a, byte, carry, i;
+    uint64_t checked = 0, failed = 0;
+
+    init_alu8080();
+    init_cpu8080(&cpu);
+
+    for (byte = 0; byte < 256; byte++) {
+        set_zero_sign_parity_from_byte(&cpu, (uint8_t)byte);
+        cpu.auxiliary_carry_flag = false;
+        cpu.carry_flag = false;
+        cpu.a = (uint8_t)byte;
+        if (!check_entry("zsp_table", 0, 0, byte, (zsp_table[byte] << 8) | byte, &cpu)) {
+            failed++;
+        }
+        checked++;
+    }
+
+    for (carry = 0; carry < 2; carry++) {
+        for (a = 0; a < 256; a++) {
+            for (byte = 0; byte < 256; byte++) {
+                cpu.a = (uint8_t)a;
+                reference_addition(&cpu, (uint8_t)byte, (bool)carry);
+                if (!check_entry("add_table", carry, a, byte, add_table[carry][a][byte], &cpu)) {
+                    failed++;
+                }
+                cpu.a = (uint8_t)a;
+                reference_subtraction(&cpu, (uint8_t)byte, (bool)carry);
+                if (!check_entry("sub_table", carry, a, byte, sub_table[carry][a][byte], &cpu)) {
+                    failed++;
+                }
+                checked += 2;
+            }
+        }
+    }
+
+    for (i = 0; i < 4; i++) {
+        for (a = 0; a < 256; a++) {
+            cpu.a = (uint8_t)a;
+            cpu.carry_flag = (bool)(i & 0x01);
+            cpu.auxiliary_carry_flag = (bool)(i & 0x02);
+            reference_daa(&cpu);
+            if (!check_entry("daa_table", i, a, 0, daa_table[i][a], &cpu)) {
+                failed++;
+            }
+            checked++;
+        }
+    }
+
+    printf("ALU self check: %lu table entries checked, %lu mismatches.\n", checked, failed);
+    return (failed == 0);
+}
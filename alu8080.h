@@ -0,0 +1,27 @@
+#ifndef ALU_8080_H
+#define ALU_8080_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Flag bits, in the positions PUSH PSW puts them.  Bit 1 is always set in the pushed byte but is not stored in the tables.
+#define FLAG_SIGN 0x80
+#define FLAG_ZERO 0x40
+#define FLAG_AUX_CARRY 0x10
+#define FLAG_PARITY 0x04
+#define FLAG_CARRY 0x01
+
+/* Precomputed ALU results, built by init_alu8080().
+   zsp_table[byte] holds the sign, zero and parity flags for byte.
+   add_table[carry][a][byte] and sub_table[carry][a][byte] hold a + byte + carry and a - byte - carry: the result is in the low 
+   8 bits and the flags (sign, zero, aux carry, parity, carry) are in the high 8 bits.  sub_table also serves CMP and CPI.
+   daa_table[(aux_carry << 1) | carry][a] holds the result of DAA the same way. */
+extern uint8_t zsp_table[256];
+extern uint16_t add_table[2][256][256];
+extern uint16_t sub_table[2][256][256];
+extern uint16_t daa_table[4][256];
+
+void init_alu8080(void);
+bool alu8080_self_check(void);
+
+#endif
@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "blockcache.h"
+#include "cpu8080.h"
+
+// Length in bytes of each opcode.  Invalid opcodes are treated as 1 byte; executing one stops the CPU anyway.
+static const uint8_t instruction_length[256] = {
+    1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+    1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+    1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1,
+    1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1,
+    1, 1, 3, 2, 3, 1, 2, 1, 1, 1, 3, 2, 3, 1, 2, 1,
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1,
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1
+};
+
+const char *const fusion_names[NUM_FUSIONS] = {
+    "none", "DCR r; JNZ", "MOV A,M; INX H", "LDAX D; MOV M,A; INX H", "LDAX D; MOV M,A; INX H; INX D",
+    "LDAX D; STAX B; INX D", "CPI; JZ", "CPI; JNZ"
+};
+
+static bool ends_block(uint8_t opcode) {
+    switch (opcode & 0xC7) {
+        case 0xC0:  // Rcc
+        case 0xC2:  // Jcc
+        case 0xC4:  // Ccc
+        case 0xC7:  // RST n
+            return true;
+    }
+    switch (opcode) {
+        case 0xC3:  // JMP
+        case 0xC9:  // RET
+        case 0xCD:  // CALL
+        case 0xE9:  // PCHL
+        case 0x76:  // HLT
+        case 0xFB:  // EI - the instruction after it runs with interrupts still disabled, cycle_cpu8080() handles that
+        case 0x08: case 0x10: case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:  // invalid
+        case 0xCB: case 0xD9: case 0xDD: case 0xED: case 0xFD:  // invalid
+            return true;
+    }
+    return false;
+}
+
+// True for instructions that write memory, do I/O or change the interrupt state.
+static bool has_side_effects(uint8_t opcode) {
+    switch (opcode) {
+        case 0x02: case 0x12: case 0x22: case 0x32:  // STAX B, STAX D, SHLD, STA
+        case 0x34: case 0x35: case 0x36:  // INR M, DCR M, MVI M
+        case 0x70: case 0x71: case 0x72: case 0x73: case 0x74: case 0x75: case 0x76: case 0x77:  // MOV M,r and HLT
+        case 0xC5: case 0xD5: case 0xE5: case 0xF5: case 0xE3:  // PUSH, XTHL
+        case 0xD3: case 0xDB:  // OUT, IN
+        case 0xF3: case 0xFB:  // DI, EI
+            return true;
+    }
+    return false;
+}
+
+static bool is_busy_wait_candidate(const cached_block *block) {
+    const decoded_instruction *last;
+    int i;
+
+    if (block->num_instructions == 0) {
+        return false;
+    }
+    last = &(block->instructions[block->num_instructions - 1]);
+    // JMP or Jcc
+    if (last->bytes[0] != 0xC3 && (last->bytes[0] & 0xC7) != 0xC2) {
+        return false;
+    }
+    if (((last->bytes[2] << 8) | last->bytes[1]) != block->start_pc) {
+        return false;
+    }
+    for (i = 0; i < block->num_instructions - 1; i++) {
+        if (has_side_effects(block->instructions[i].bytes[0])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns the fusion_type of the idiom that starts at instructions[0], given the number of instructions left in the block.
+static uint8_t find_fusion(const decoded_instruction *instructions, int remaining) {
+    uint8_t first = instructions[0].bytes[0];
+
+    if (remaining < 2) {
+        return FUSION_NONE;
+    }
+    if ((first & 0xC7) == 0x05 && first != 0x35 && instructions[1].bytes[0] == 0xC2) {
+        // DCR r other than DCR M
+        return FUSION_DCR_JNZ;
+    }
+    if (first == 0x7E && instructions[1].bytes[0] == 0x23) {
+        return FUSION_MOV_A_M_INX_H;
+    }
+    if (first == 0xFE && instructions[1].bytes[0] == 0xCA) {
+        return FUSION_CPI_JZ;
+    }
+    if (first == 0xFE && instructions[1].bytes[0] == 0xC2) {
+        return FUSION_CPI_JNZ;
+    }
+    if (first == 0x1A && remaining >= 3) {
+        if (instructions[1].bytes[0] == 0x77 && instructions[2].bytes[0] == 0x23) {
+            if (remaining >= 4 && instructions[3].bytes[0] == 0x13) {
+                return FUSION_LDAX_D_MOV_M_A_INX_H_INX_D;
+            }
+            return FUSION_LDAX_D_MOV_M_A_INX_H;
+        }
+        if (instructions[1].bytes[0] == 0x02 && instructions[2].bytes[0] == 0x13) {
+            return FUSION_LDAX_D_STAX_B_INX_D;
+        }
+    }
+    return FUSION_NONE;
+}
+
+block_cache8080 *init_block_cache8080() {
+    // calloc so every slot starts out invalid and the code map starts out empty
+    return (block_cache8080 *) calloc(1, sizeof(block_cache8080));
+}
+
+// A block cache allocated from arena, whose memory starts out zero like calloc's; NULL if the arena is full.
+block_cache8080 *init_block_cache8080_in_arena(memory_arena8080 *arena) {
+    block_cache8080 *cache = (block_cache8080 *) memory_arena_alloc(arena, sizeof(block_cache8080));
+
+    if (cache != NULL) {
+        cache->in_arena = true;
+    }
+    return cache;
+}
+
+void destroy_block_cache8080(block_cache8080 **cache_ptr) {
+    if (!((*cache_ptr)->in_arena)) {
+        free(*cache_ptr);
+    }
+    *cache_ptr = NULL;
+}
+
+/* Marks address as code in every view of its page, so that a write through any of them, which may be a single store to
+   aliased memory, finds it. */
+static void mark_code(block_cache8080 *cache, memory_map8080 *map, uint16_t address) {
+    uint8_t source = map->source_page[address >> 8];
+    uint8_t page = source;
+    uint16_t view;
+
+    do {
+        view = (page << 8) | (address & 0xFF);
+        cache->code_map[view >> 3] |= (1 << (view & 0x7));
+        page = map->next_view[page];
+    } while (page != source);
+}
+
+static void decode_block(block_cache8080 *cache, cached_block *block, memory_map8080 *map, uint16_t pc) {
+    uint8_t *memory = map->memory;
+    uint32_t addr = pc;  // 32 bits so a block that runs into the top of memory can be detected instead of wrapping
+    decoded_instruction *decoded;
+    uint8_t opcode;
+    int i;
+    bool done = false;
+
+    block->start_pc = pc;
+    block->num_instructions = 0;
+    while (!done) {
+        opcode = memory[addr];
+        decoded = &(block->instructions[block->num_instructions]);
+        decoded->length = instruction_length[opcode];
+        if (addr + decoded->length > 0x10000) {
+            // the operands wrap around to 0x0000; leave this instruction to cycle_cpu8080()
+            break;
+        }
+        decoded->bytes[1] = 0;
+        decoded->bytes[2] = 0;
+        for (i = 0; i < decoded->length; i++) {
+            decoded->bytes[i] = memory[addr + i];
+            mark_code(cache, map, addr + i);
+        }
+        decoded->operand = (decoded->bytes[2] << 8) | decoded->bytes[1];
+        decoded->states = (uint8_t)states_per_opcode[opcode];
+        addr += decoded->length;
+        block->num_instructions++;
+        done = ends_block(opcode) || block->num_instructions == BLOCK_CACHE_MAX_INSTRUCTIONS;
+    }
+    for (i = 0; i < block->num_instructions; i++) {
+        block->instructions[i].fusion = find_fusion(&(block->instructions[i]), block->num_instructions - i);
+    }
+    block->busy_wait_candidate = is_busy_wait_candidate(block);
+    block->busy_wait_changed_passes = 0;
+    block->num_bytes = (uint16_t)(addr - pc);
+    block->valid = true;
+    block->executions = 0;
+    block->translation_failed = false;
+    block->native_max_states = 0;
+    block->native_code = NULL;
+}
+
+/* Returns the block starting at pc, decoding it first if it is not in the cache.  The block has no instructions only if
+   the instruction at pc runs past the top of memory. */
+cached_block *block_cache_lookup(block_cache8080 *cache, memory_map8080 *map, uint16_t pc) {
+    cached_block *block = &(cache->slots[pc & (BLOCK_CACHE_NUM_SLOTS - 1)]);
+
+    block_cache_note_bank_switches(cache, map);
+    if (block->valid && block->start_pc == pc) {
+        cache->hits++;
+    }
+    else {
+        cache->misses++;
+        cache->memory_map = map;
+        decode_block(cache, block, map, pc);
+    }
+    return block;
+}
+
+static void invalidate_view(block_cache8080 *cache, uint16_t address) {
+    cached_block *block;
+    int start;
+
+    start = (int)address - (BLOCK_CACHE_MAX_BYTES - 1);
+    if (start < 0) {
+        start = 0;
+    }
+    for (; start <= address; start++) {
+        block = &(cache->slots[start & (BLOCK_CACHE_NUM_SLOTS - 1)]);
+        if (block->valid && block->start_pc == start && start + block->num_bytes > address) {
+            block->valid = false;
+            cache->invalidations++;
+        }
+    }
+}
+
+// Invalidates every cached block that contains address, or the same byte seen through a mirror.
+void block_cache_invalidate_address(block_cache8080 *cache, uint16_t address) {
+    memory_map8080 *map = cache->memory_map;
+    uint8_t source = map->source_page[address >> 8];
+    uint8_t page = source;
+
+    do {
+        invalidate_view(cache, (page << 8) | (address & 0xFF));
+        page = map->next_view[page];
+    } while (page != source);
+}
+
+/* Invalidates every cached block with code in the banked range, after a bank switch.  Their code map bits can be cleared,
+   since no block is left that covers them. */
+void block_cache_invalidate_banks(block_cache8080 *cache, memory_map8080 *map) {
+    uint32_t i, bit;
+    uint64_t word;
+
+    for (i = map->bank_start / 8; i < (map->bank_start + map->bank_length) / 8; i++) {
+        // Most of the code map is clear, so it is skipped a word at a time
+        if ((i & 7) == 0 && i + 8 <= (map->bank_start + map->bank_length) / 8) {
+            memcpy(&word, &cache->code_map[i], sizeof(word));
+            if (word == 0) {
+                i += 7;
+                continue;
+            }
+        }
+        if (cache->code_map[i] != 0) {
+            for (bit = 0; bit < 8; bit++) {
+                if (cache->code_map[i] & (1 << bit)) {
+                    invalidate_view(cache, i * 8 + bit);
+                }
+            }
+            cache->code_map[i] = 0;
+        }
+    }
+    cache->bank_switches = map->bank_switches;
+}
+
+// For changes to memory the CPU did not make itself, e.g. loading a ROM or the debugger's set command.
+void block_cache_invalidate_all(block_cache8080 *cache) {
+    int i;
+    for (i = 0; i < BLOCK_CACHE_NUM_SLOTS; i++) {
+        cache->slots[i].valid = false;
+    }
+    memset(cache->code_map, 0, sizeof(cache->code_map));
+}
+
+// Prints the hit, miss and invalidation counts, and how often each superinstruction ran.
+void print_block_cache_stats(block_cache8080 *cache) {
+    int i;
+    printf("Block cache: %lu hits, %lu misses, %lu invalidations\n", cache->hits, cache->misses, cache->invalidations);
+    for (i = FUSION_NONE + 1; i < NUM_FUSIONS; i++) {
+        printf("  %-32s %lu\n", fusion_names[i], cache->fusions[i]);
+    }
+    printf("Busy-wait loops: %lu skips, %lu states skipped\n", cache->busy_wait_skips, cache->busy_wait_states_skipped);
+}
@@ -0,0 +1,114 @@
+#ifndef BLOCKCACHE_8080_H
+#define BLOCKCACHE_8080_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "memory.h"
+
+/* A basic block is a run of instructions that starts at a given pc and ends with the first instruction that can change
+   the pc by something other than its own length (jumps, calls, returns, RST, PCHL), a HLT, an EI, or an invalid opcode.
+   Blocks are decoded once and then executed from the cache without re-reading opcodes and operands from memory. */
+#define BLOCK_CACHE_MAX_INSTRUCTIONS 32
+#define BLOCK_CACHE_MAX_BYTES (BLOCK_CACHE_MAX_INSTRUCTIONS * 3)
+
+/* Passes in a row that change a register or flag before a busy-wait candidate is given up on.  The first pass of a
+   real busy wait can change them, loading what it polls for the first time, but the next one can't. */
+#define BLOCK_CACHE_BUSY_WAIT_CHANGED_PASSES 2
+
+// Number of blocks in the cache.  Must be a power of 2; blocks are stored in slot (start_pc & (BLOCK_CACHE_NUM_SLOTS - 1)).
+#define BLOCK_CACHE_NUM_SLOTS 2048
+
+/* Idioms that the interpreter runs as a single superinstruction.  Each gives the same registers, flags, memory and states as
+   running its instructions one at a time. */
+typedef enum {
+    FUSION_NONE,
+    FUSION_DCR_JNZ,                     // DCR r; JNZ addr
+    FUSION_MOV_A_M_INX_H,               // MOV A,M; INX H
+    FUSION_LDAX_D_MOV_M_A_INX_H,        // LDAX D; MOV M,A; INX H
+    FUSION_LDAX_D_MOV_M_A_INX_H_INX_D,  // LDAX D; MOV M,A; INX H; INX D
+    FUSION_LDAX_D_STAX_B_INX_D,         // LDAX D; STAX B; INX D
+    FUSION_CPI_JZ,                      // CPI data; JZ addr
+    FUSION_CPI_JNZ,                     // CPI data; JNZ addr
+    NUM_FUSIONS
+} fusion_type;
+
+extern const char *const fusion_names[NUM_FUSIONS];
+
+/* Everything the interpreter needs to know about an instruction before running it, worked out once when the block is
+   decoded rather than every time the instruction runs. */
+typedef struct {
+    uint8_t bytes[3];  // opcode followed by up to two operand bytes
+    uint8_t length;
+    uint8_t states;    // states_per_opcode[] of the opcode; a conditional call or return that is taken adds 6
+    uint8_t fusion;    // fusion_type of the idiom starting with this instruction, if all of it is in the block
+    uint16_t operand;  // the operand bytes as a little-endian 16-bit value; 0 if there are none
+} decoded_instruction;
+
+typedef struct {
+    uint16_t start_pc;
+    uint16_t num_bytes;
+    uint16_t num_instructions;
+    bool valid;
+    decoded_instruction instructions[BLOCK_CACHE_MAX_INSTRUCTIONS];
+
+    /* The block ends with a jump back to its own start and nothing in it writes memory or does I/O, so it may be a loop
+       waiting for an interrupt handler to change memory.  run_cpu8080() checks whether it is and skips ahead if so.
+       A counting or delay loop changes its registers on every pass, and stops being a candidate after
+       BLOCK_CACHE_BUSY_WAIT_CHANGED_PASSES such passes in a row, so it can run like any other block. */
+    bool busy_wait_candidate;
+    uint8_t busy_wait_changed_passes;
+
+    // Used by the JIT (jit8080.c).  Decoding a block resets these, so a translation never outlives the code it came from.
+    uint32_t executions;           // times the JIT found the block untranslated
+    bool translation_failed;       // the first instruction is one the JIT leaves to the interpreter
+    uint32_t native_max_states;    // the most states the translation can execute
+    void *native_code;             // NULL if not translated
+} cached_block;
+
+typedef struct block_cache8080 {
+    cached_block slots[BLOCK_CACHE_NUM_SLOTS];
+
+    /* One bit per address, set if the byte has been decoded into a block.  Bits are never cleared, except by
+       block_cache_invalidate_all(), so a write to an address that used to hold code costs a scan of the slots that could
+       cover it, but stays correct. */
+    uint8_t code_map[0x10000 / 8];
+
+    // The memory map of the last lookup, for finding the other views of a written address
+    memory_map8080 *memory_map;
+    // The map's bank_switches when the cache last caught up with it
+    uint64_t bank_switches;
+
+    bool in_arena;  // belongs to a memory arena, which frees it
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t invalidations;
+    uint64_t fusions[NUM_FUSIONS];  // times each superinstruction was run
+    uint64_t busy_wait_skips;
+    uint64_t busy_wait_states_skipped;
+} block_cache8080;
+
+block_cache8080 *init_block_cache8080();
+block_cache8080 *init_block_cache8080_in_arena(memory_arena8080 *arena);
+void destroy_block_cache8080(block_cache8080 **cache_ptr);
+cached_block *block_cache_lookup(block_cache8080 *cache, memory_map8080 *map, uint16_t pc);
+void block_cache_invalidate_address(block_cache8080 *cache, uint16_t address);
+void block_cache_invalidate_all(block_cache8080 *cache);
+void block_cache_invalidate_banks(block_cache8080 *cache, memory_map8080 *map);
+void print_block_cache_stats(block_cache8080 *cache);
+
+// Called on every memory write the CPU makes, so the common case (the byte is not code) has to be cheap.
+static inline void block_cache_note_write(block_cache8080 *cache, uint16_t address) {
+    if (cache->code_map[address >> 3] & (1 << (address & 0x7))) {
+        block_cache_invalidate_address(cache, address);
+    }
+}
+
+// Called after anything that may have switched memory banks: the blocks in the banked range are for the old bank.
+static inline void block_cache_note_bank_switches(block_cache8080 *cache, memory_map8080 *map) {
+    if (cache->bank_switches != map->bank_switches) {
+        block_cache_invalidate_banks(cache, map);
+    }
+}
+
+#endif
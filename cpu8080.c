@@ -1,10 +1,19 @@
 #include <stdio.h>
 #include "cpu8080.h"
+#include "alu8080.h"
+#include "blockcache.h"
+#include "jit8080.h"
 
-#define GET_BC (((cpu->b) << 8) | (cpu->c))
-#define GET_DE (((cpu->d) << 8) | (cpu->e))
-#define GET_HL (((cpu->h) << 8) | (cpu->l))
-#define TWO_INSTR_TO_INT16 ((motherboard->memory[cpu->pc + 2] << 8) | motherboard->memory[cpu->pc + 1])
+#define TWO_INSTR_TO_INT16 ((instr[2] << 8) | instr[1])
+
+/* For the helpers the opcode handlers use.  The interpreter loop is big enough that GCC stops inlining into it, and a
+   helper the handlers pass the addresses of their states and pc_increments to would, if called, keep those two in
+   memory, so that every instruction stores them there. */
+#if defined(__GNUC__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
 
 // There are some exceptions, where the number of states will change based on conditions.  Those will be handled in cycle().
 // -1 is used for invalid opcodes.  Using 64-bit ints because they will get added to a 64-bit int and this
@@ -29,16 +38,14 @@ const int64_t states_per_opcode[256] = {
 };
 
 void init_cpu8080(cpu8080 *cpu) {
+    init_alu8080();
     cpu->pc = 0x0;
     cpu->sp = 0x0;
     cpu->stack_pointer_start = 0x0;
-    cpu->a = 0x0;
-    cpu->b = 0x0;
-    cpu->c = 0x0;
-    cpu->d = 0x0;
-    cpu->e = 0x0;
-    cpu->h = 0x0;
-    cpu->l = 0x0;
+    cpu->psw = 0x0;
+    cpu->bc = 0x0;
+    cpu->de = 0x0;
+    cpu->hl = 0x0;
     cpu->enable_interrupts_after_next_instruction = false;
     cpu->interrupts_enabled = true;
     cpu->halted = false;
@@ -46,6 +53,14 @@ void init_cpu8080(cpu8080 *cpu) {
     cpu->carry_flag = false;
     cpu->sign_flag = false;
     cpu->auxiliary_carry_flag = false;
+    cpu->flags_pending = false;
+    cpu->flags_result = 0x0;
+    cpu->flags_aux = 0x0;
+    cpu->dispatch = CPU8080_DEFAULT_DISPATCH;
+    cpu->block_cache = NULL;
+    cpu->jit = NULL;
+    cpu->breakpoints = NULL;
+    cpu->instructions_executed = 0;
 }
 
 void init_test_cpu8080(cpu8080 *cpu) {
@@ -55,24 +70,68 @@ void init_test_cpu8080(cpu8080 *cpu) {
     cpu->stack_pointer_start = 0xFF00;
 }
 
-void set_zero_sign_parity_from_byte(cpu8080 *cpu, uint8_t byte) {
+static inline bool parity_of_byte(uint8_t byte) {
+    // Note in i8080 the parity is based on number of bits set.  Odd number of bits = false, even number of bits = true
     uint8_t v;
-    
+
+    // http://www.graphics.stanford.edu/~seander/bithacks.html#ParityParallel
+    v = byte ^ (byte >> 4);
+    v = v & 0xf;
+    return (bool) (((0x6996 >> v) & 1) == 0);
+}
+
+void set_zero_sign_parity_from_byte(cpu8080 *cpu, uint8_t byte) {
     cpu->zero_flag = (bool) (byte == 0);
 
     // Per the Assembly Language Programming Manual, the sign flag is set to the value of bit 7.
     cpu->sign_flag = (bool) (byte & 0x80);
 
-    // http://www.graphics.stanford.edu/~seander/bithacks.html#ParityParallel
-    v = byte ^ (byte >> 4);
-    v = v & 0xf;
-    cpu->parity_flag = (bool) (((0x6996 >> v) & 1) == 0);
+    cpu->parity_flag = parity_of_byte(byte);
+}
+
+static inline void record_flags(cpu8080 *cpu, uint8_t result, uint8_t aux) {
+    /* Instead of computing zero, sign, parity and aux carry, remember what they would be computed from.  Bit 4 of aux
+       is the aux carry flag; the other bits are ignored. */
+    cpu->flags_result = result;
+    cpu->flags_aux = aux;
+    cpu->flags_pending = true;
+}
+
+void materialize_flags(cpu8080 *cpu) {
+    uint8_t zsp;
+    if (cpu->flags_pending) {
+        zsp = zsp_table[cpu->flags_result];
+        cpu->zero_flag = (bool)(zsp & FLAG_ZERO);
+        cpu->sign_flag = (bool)(zsp & FLAG_SIGN);
+        cpu->parity_flag = (bool)(zsp & FLAG_PARITY);
+        cpu->auxiliary_carry_flag = (bool)(cpu->flags_aux & FLAG_AUX_CARRY);
+        cpu->flags_pending = false;
+    }
+}
+
+/* The conditional instructions only need one flag each, so they compute that flag straight from the recorded result
+   rather than materializing all of them. */
+static inline bool get_zero_flag(cpu8080 *cpu) {
+    return (cpu->flags_pending) ? (bool)(cpu->flags_result == 0) : cpu->zero_flag;
+}
+
+static inline bool get_sign_flag(cpu8080 *cpu) {
+    return (cpu->flags_pending) ? (bool)(cpu->flags_result & 0x80) : cpu->sign_flag;
+}
+
+static inline bool get_parity_flag(cpu8080 *cpu) {
+    return (cpu->flags_pending) ? (bool)(zsp_table[cpu->flags_result] & FLAG_PARITY) : cpu->parity_flag;
+}
+
+static inline bool get_aux_carry_flag(cpu8080 *cpu) {
+    return (cpu->flags_pending) ? (bool)(cpu->flags_aux & FLAG_AUX_CARRY) : cpu->auxiliary_carry_flag;
 }
 
 uint8_t get_byte_from_flags(cpu8080 *const cpu){
     /* Because there are only 5 condition flags, PUSH PSW formats the flags into an 8-bit byte by
        setting bits 3 and 5 always to zero and bit one is always set to 1. */
     uint8_t retval = 0x02;
+    materialize_flags(cpu);
     if (cpu->sign_flag) retval = retval | 0x80;
     if (cpu->zero_flag) retval = retval | 0x40;
     if (cpu->auxiliary_carry_flag) retval = retval | 0x10;
@@ -88,13 +147,77 @@ void set_flags_from_byte(cpu8080 *cpu, uint8_t byte) {
     cpu->auxiliary_carry_flag = (bool) (byte & 0x10);
     cpu->parity_flag = (bool) (byte & 0x04);
     cpu->carry_flag = (bool) (byte & 0x01);
+    cpu->flags_pending = false;
+}
+
+// All memory writes the CPU makes go through here, so cached blocks can be invalidated when code is overwritten.
+/* A write to a page that is not plain RAM: I/O pages pass it to their handler, ROM and unmapped pages ignore it, and
+   mirrored RAM gets it in every copy. */
+static void write_mapped_byte(motherboard8080 *motherboard, cpu8080 *cpu, uint16_t address, uint8_t value) {
+    memory_map8080 *map = motherboard->memory_map;
+    uint8_t source = map->source_page[address >> 8];
+    uint8_t page = source;
+
+    if (map->page_type[source] == PAGE_IO) {
+        motherboard->memory_io_accesses++;
+        motherboard->memory_write_handler[source](motherboard, address, value);
+        return;
+    }
+    if (map->page_type[source] != PAGE_RAM) {
+        return;
+    }
+    do {
+        if (!(map->aliased[page])) {
+            map->backing[(page << 8) | (address & 0xFF)] = value;
+        }
+        page = map->next_view[page];
+    } while (page != source);
+    note_memory_write(map, (source << 8) | (address & 0xFF));
+    if (cpu->block_cache != NULL) {
+        block_cache_note_write(cpu->block_cache, address);
+    }
+}
+
+// A read of an I/O page.
+static uint8_t read_mapped_byte(motherboard8080 *motherboard, uint16_t address) {
+    uint8_t source = motherboard->memory_map->source_page[address >> 8];
+
+    motherboard->memory_io_accesses++;
+    return motherboard->memory_read_handler[source](motherboard, address);
+}
+
+static ALWAYS_INLINE uint8_t read_byte(motherboard8080 *motherboard, uint16_t address) {
+    if (!(motherboard->memory_map->read_direct[address >> 8])) {
+        return read_mapped_byte(motherboard, address);
+    }
+    return motherboard->memory[address];
+}
+
+// The low byte is read first, as on the 8080, which a memory-mapped device can tell.
+static ALWAYS_INLINE uint16_t read_word(motherboard8080 *motherboard, uint16_t address) {
+    uint8_t low = read_byte(motherboard, address);
+    return (read_byte(motherboard, address + 1) << 8) | low;
+}
+
+static ALWAYS_INLINE void write_byte(motherboard8080 *motherboard, cpu8080 *cpu, uint16_t address, uint8_t value) {
+    if (!(motherboard->memory_map->write_direct[address >> 8])) {
+        write_mapped_byte(motherboard, cpu, address, value);
+        return;
+    }
+    motherboard->memory[address] = value;
+    note_memory_write(motherboard->memory_map, address);
+    if (cpu->block_cache != NULL) {
+        block_cache_note_write(cpu->block_cache, address);
+    }
 }
 
-void do_interrupt(motherboard8080 *motherboard, cpu8080 *cpu, uint8_t interrupt, uint16_t *pc_increments) {
+ALWAYS_INLINE void do_interrupt(motherboard8080 *motherboard, cpu8080 *cpu, uint8_t interrupt, uint16_t *pc_increments) {
     if (cpu->interrupts_enabled) {
         cpu->interrupts_enabled = false;
-        motherboard->memory[cpu->sp - 1] = ((cpu->pc) >> 8);
-        motherboard->memory[cpu->sp - 2] = ((cpu->pc) & 0xFF);
+        // An interrupt is the only thing that restarts a halted CPU; pc is already past the HLT.
+        cpu->halted = false;
+        write_byte(motherboard, cpu, cpu->sp - 1, ((cpu->pc) >> 8));
+        write_byte(motherboard, cpu, cpu->sp - 2, ((cpu->pc) & 0xFF));
         cpu->sp = cpu ->sp - 2;
         // pc gets set to 8 * the interrupt number, which is interrupt << 3.
         cpu->pc = (interrupt << 3);
@@ -102,12 +225,12 @@ void do_interrupt(motherboard8080 *motherboard, cpu8080 *cpu, uint8_t interrupt,
     }
 }
 
-static inline void do_conditional_call(motherboard8080 *motherboard, cpu8080 *cpu, bool flag, uint64_t *num_states, uint16_t *pc_increments) {
+static ALWAYS_INLINE void do_conditional_call(motherboard8080 *motherboard, cpu8080 *cpu, bool flag, uint16_t address, int64_t *num_states, uint16_t *pc_increments) {
     if (flag) {
-        motherboard->memory[cpu->sp - 1] = ((cpu->pc + 3) >> 8);
-        motherboard->memory[cpu->sp - 2] = ((cpu->pc + 3) & 0xFF);
+        write_byte(motherboard, cpu, cpu->sp - 1, ((cpu->pc + 3) >> 8));
+        write_byte(motherboard, cpu, cpu->sp - 2, ((cpu->pc + 3) & 0xFF));
         cpu->sp = cpu ->sp - 2;
-        cpu->pc = (motherboard->memory[cpu->pc+2] << 8) | motherboard->memory[cpu->pc+1];
+        cpu->pc = address;
         (*pc_increments) = 0;
         (*num_states) = 17;
     }
@@ -116,9 +239,9 @@ static inline void do_conditional_call(motherboard8080 *motherboard, cpu8080 *cp
     }
 }
 
-static inline void do_conditional_jump(motherboard8080 *motherboard, cpu8080 *cpu, bool flag, uint16_t *pc_increments) {
+static ALWAYS_INLINE void do_conditional_jump(cpu8080 *cpu, bool flag, uint16_t address, uint16_t *pc_increments) {
     if (flag) {
-        cpu->pc = (motherboard->memory[cpu->pc+2] << 8) | motherboard->memory[cpu->pc+1];
+        cpu->pc = address;
         (*pc_increments) = 0;
     }
     else {
@@ -126,9 +249,9 @@ static inline void do_conditional_jump(motherboard8080 *motherboard, cpu8080 *cp
     }
 }
 
-static inline void do_conditional_return(motherboard8080 *motherboard, cpu8080 *cpu, bool flag, uint64_t *num_states, uint16_t *pc_increments){
+static ALWAYS_INLINE void do_conditional_return(motherboard8080 *motherboard, cpu8080 *cpu, bool flag, int64_t *num_states, uint16_t *pc_increments){
     if (flag) {
-        cpu->pc = (motherboard->memory[cpu->sp +1] << 8) | motherboard->memory[cpu->sp];
+        cpu->pc = read_word(motherboard, cpu->sp);
         cpu->sp = cpu->sp + 2;
         (*pc_increments) = 0;
         (*num_states) = 11;
@@ -137,36 +260,20 @@ static inline void do_conditional_return(motherboard8080 *motherboard, cpu8080 *
 }
 
 static inline void do_addition(cpu8080 *cpu, uint8_t byte, bool add_one_for_carry) {
-    uint8_t a_low, byte_low, low_tmp;
-    uint16_t tmp; // avoids overflow
-    // There is likely a better-performing way to compute AC but this is easy to understand.  If adding the low nibble causes a carry,
-    // then the AC flag is true.
-    a_low = cpu->a & 0x0F;
-    byte_low = byte & 0x0F;
-    low_tmp = a_low + byte_low;
-    if (add_one_for_carry) {
-        low_tmp++;
-    }
-    cpu->auxiliary_carry_flag = (bool)(low_tmp > 0xF);
-
-    tmp = (add_one_for_carry) ? byte + 1 : byte;
-    tmp = tmp + cpu->a;
-    cpu->carry_flag = (bool) (tmp > 0xFF);
-    cpu->a = (uint8_t)(tmp & 0xFF);
-    set_zero_sign_parity_from_byte(cpu, cpu->a);
+    // add_table has the result in the low byte and the flags in the high byte; AC is in bit 4 of the flags as record_flags() wants.
+    uint16_t entry = add_table[add_one_for_carry][cpu->a][byte];
+    cpu->carry_flag = (bool)(entry & (FLAG_CARRY << 8));
+    cpu->a = (uint8_t)(entry & 0xFF);
+    record_flags(cpu, cpu->a, (uint8_t)(entry >> 8));
 }
 
 static inline void do_subtraction(cpu8080 *cpu, uint8_t byte, bool subtract_one_for_borrow, bool store_value) {
     /* byte is the value subtracted from the accumulator.  If store_value is false, does a CMP and doesn't save the value to a. */
-    uint16_t tmp, q;  // avoids overflow
-    tmp = (subtract_one_for_borrow) ? byte + 1 : byte;
-    cpu -> carry_flag = (bool)((uint16_t) (cpu->a) < tmp);
-    q = ((uint16_t)(cpu->a)) - tmp;
-    set_zero_sign_parity_from_byte(cpu, (uint8_t)(q & 0xFF));
-    // taking logic from MAME emulator
-    cpu->auxiliary_carry_flag = (bool)((~(cpu->a ^ ((uint8_t)(q & 0xFF)) ^ byte)) & 0x10);
+    uint16_t entry = sub_table[subtract_one_for_borrow][cpu->a][byte];
+    cpu->carry_flag = (bool)(entry & (FLAG_CARRY << 8));
+    record_flags(cpu, (uint8_t)(entry & 0xFF), (uint8_t)(entry >> 8));
     if (store_value) {
-        cpu->a = (uint8_t)(q & 0xFF);
+        cpu->a = (uint8_t)(entry & 0xFF);
     }
 }
 
@@ -175,1213 +282,186 @@ static inline void do_and(cpu8080 *cpu, uint8_t byte) {
        Microcomputer Systems Manual says that the AC flag is cleared.  The various CPU tests expect it to be set, so 
        I am setting the flags on both ANA and ANI. */
     /* Per https://retrocomputing.stackexchange.com/questions/14977/auxiliary-carry-and-the-intel-8080s-logical-instructions
-       the Auxiliary Carry flag is set to the or of bit 3 (0x08) of the 2 values involved in the AND operation. */
-    cpu->auxiliary_carry_flag = (bool)((cpu->a | byte) & 0x08);
+       the Auxiliary Carry flag is set to the or of bit 3 (0x08) of the 2 values involved in the AND operation.  Shifting
+       left one moves bit 3 to bit 4, where record_flags() expects it. */
+    uint8_t aux = (cpu->a | byte) << 1;
     cpu->a = cpu->a & byte;
     cpu->carry_flag = false;
-    set_zero_sign_parity_from_byte(cpu, cpu->a);
+    record_flags(cpu, cpu->a, aux);
 }
 
 static inline void do_or(cpu8080 *cpu, uint8_t byte) {
     cpu->a = cpu->a | byte;
-    cpu->auxiliary_carry_flag = false;
     cpu->carry_flag = false;
-    set_zero_sign_parity_from_byte(cpu, cpu->a);
+    record_flags(cpu, cpu->a, 0);
 }
 
 static inline void do_xor(cpu8080 *cpu, uint8_t byte) {
     cpu->a = cpu->a ^ byte;
-    cpu->auxiliary_carry_flag = false;
     cpu->carry_flag = false;
-    set_zero_sign_parity_from_byte(cpu, cpu->a);
+    record_flags(cpu, cpu->a, 0);
 }
 
-bool do_opcode(motherboard8080 *motherboard, cpu8080 *cpu, uint64_t *num_states) {
-    uint8_t opcode;
-    uint16_t pc_increments = 1;  // assume we increment pc by one at the end of the function; instructions may override this.
-    uint8_t tmp_d, tmp_e; // used in XCHG
-    uint8_t tmp_h, tmp_l; // used in XTHL
-    uint16_t tmp_rp; // used in opcodes like INX, DCX where we operate on a register pair
-    uint32_t tmp_32; // used in opcodes like DAD where we operate on two 16-bit numbers and need to see if there is a carry.
-    uint8_t tmp_8; // used in DAA
-    bool tmp_bool; // used in RAL/RAR
-    
-    opcode = motherboard->memory[cpu->pc];
-    *num_states = states_per_opcode[opcode];
-    if ((*num_states) == -1) {
-        printf("Invalid Opcode %02X\n", opcode);
-        return(false);
-    }
+static inline uint8_t do_increment(cpu8080 *cpu, uint8_t byte) {
+    // INR r / INR M.  The carry flag is not affected.  AC is set if the low nibble wrapped, i.e. there was a carry into bit 4.
+    uint8_t result = byte + 1;
+    record_flags(cpu, result, byte ^ result);
+    return result;
+}
 
-    switch(opcode) {
-        case 0x00: 
-            // NOP
-            // do nothing
-            break;
-        case 0x01:
-            // LXI BC, data 16
-            cpu->b = motherboard->memory[cpu->pc + 2];
-            cpu->c = motherboard->memory[cpu->pc + 1];
-            pc_increments = 3;
-            break;
-        case 0x02: 
-            // STAX (BC)
-            motherboard->memory[GET_BC] = cpu->a;
-            break;
-        case 0x03: // INX
-            // INC BC (INX rp)
-            tmp_rp = GET_BC;
-            tmp_rp++;
-            cpu->b = (tmp_rp & 0xFF00) >> 8;
-            cpu->c = (tmp_rp & 0x00FF);
-            break;
-        case 0x04: 
-            // INC B (INR r)
-            cpu->b ++;
-            set_zero_sign_parity_from_byte(cpu, cpu->b);
-            cpu->auxiliary_carry_flag = (bool)(((cpu->b) & 0x0F) == 0);
-            break;
-        case 0x05:
-            // DEC B (DCR r)
-            cpu->b --;
-            set_zero_sign_parity_from_byte(cpu, cpu->b);
-            cpu->auxiliary_carry_flag = (bool)(((cpu->b) & 0x0F) != 0x0F);
-            break;
-        case 0x06: 
-            // MVI B, d8  (LD B, d8)
-            cpu->b = motherboard->memory[cpu->pc + 1];
-            pc_increments = 2;
-            break;
-        case 0x07: 
-            // RLC (Rotate Left with Carry)
-            // The content of the accumulator is rotated left one position.  The low order bit and the CY flag are both set
-            // to the value shifted out of the high order bit position.
-            cpu->carry_flag = (bool)(cpu->a & 0x80);
-            cpu->a = cpu->a << 1;
-            if (cpu->carry_flag) {
-                cpu->a = cpu->a | 0x01;
+static inline uint8_t do_decrement(cpu8080 *cpu, uint8_t byte) {
+    // DCR r / DCR M.  The carry flag is not affected.  AC is set unless the low nibble borrowed, i.e. wrapped to 0xF.
+    uint8_t result = byte - 1;
+    record_flags(cpu, result, ~(byte ^ result));
+    return result;
+}
+
+// States of every instruction in a superinstruction except the last, which is the most it can run without stopping early.
+static const uint8_t fusion_states_before_last[NUM_FUSIONS] = {0, 5, 7, 14, 19, 14, 7, 7};
+
+/* Runs the superinstruction that starts with decoded, which must be in block and at cpu->pc.  Adds the states and the
+   instructions executed to num_states and num_instructions, and returns the number of instructions executed.  That is
+   fewer than the whole idiom only if it wrote to the block's own code, in which case the rest must not run from the
+   block. */
+static inline int execute_fusion(motherboard8080 *motherboard, cpu8080 *cpu, const cached_block *block,
+                                 const decoded_instruction *decoded, uint64_t *num_states, uint64_t *num_instructions) {
+    uint8_t *reg;
+    int executed;
+
+    cpu->block_cache->fusions[decoded->fusion]++;
+    switch (decoded->fusion) {
+        case FUSION_DCR_JNZ:
+            switch (decoded->bytes[0]) {
+                case 0x05: reg = &(cpu->b); break;
+                case 0x0D: reg = &(cpu->c); break;
+                case 0x15: reg = &(cpu->d); break;
+                case 0x1D: reg = &(cpu->e); break;
+                case 0x25: reg = &(cpu->h); break;
+                case 0x2D: reg = &(cpu->l); break;
+                default: reg = &(cpu->a); break;
             }
-            break;
-        case 0x09: 
-            // ADD HL, BC (DAD rp)
-            // Only the carry flag is affected, and then if the 16-bit addition carries out.
-            tmp_32 = (uint32_t)(GET_HL) + (uint32_t)(GET_BC);
-            cpu->carry_flag = (bool)(tmp_32 > 0xFFFF);
-            cpu->h = (uint8_t)((tmp_32 & 0xFF00) >> 8);
-            cpu->l = (uint8_t)(tmp_32 & 0x00FF);
-            break;
-        case 0x0A: 
-            // LDAX (BC)
-            cpu->a = motherboard->memory[GET_BC];
-            break;
-        case 0x0B: 
-            // DEC BC (INX rp)
-            tmp_rp = GET_BC;
-            tmp_rp--;
-            cpu->b = (tmp_rp & 0xFF00) >> 8;
-            cpu->c = (tmp_rp & 0x00FF);
-            break;
-        case 0x0C: 
-            // INC C (INR r)
-            cpu->c ++;
-            set_zero_sign_parity_from_byte(cpu, cpu->c);
-            cpu->auxiliary_carry_flag = (bool)(((cpu->c) & 0x0F) == 0);
-            break;
-        case 0x0D: 
-            // DEC C (DCR r)
-            cpu->c --;
-            set_zero_sign_parity_from_byte(cpu, cpu->c);
-            cpu->auxiliary_carry_flag = (bool)(((cpu->c) & 0x0F) != 0x0F);
-            break;
-        case 0x0E: 
-            // MVI C, d8  (LD C, d8)
-            cpu->c = motherboard->memory[cpu->pc + 1];
-            pc_increments = 2;
-            break;
-        case 0x0F: 
-            // RRCA (Rotate Right with Carry)
-            // The high order bit and the CY flag are both set to the value shifted out of the low order bit position. 
-            // Only the CY flag is affected.
-            cpu->carry_flag = (bool)(cpu->a & 0x01);
-            cpu->a = cpu->a >> 1;
-            if (cpu->carry_flag) {
-                cpu->a |= 0x80;
+            *reg = do_decrement(cpu, *reg);
+            if (*reg != 0) {
+                cpu->pc = decoded[1].operand;
             }
-            break;
-        case 0x11:
-            // LXI DE, data 16
-            cpu->d = motherboard->memory[cpu->pc + 2];
-            cpu->e = motherboard->memory[cpu->pc + 1];
-            pc_increments = 3;
-            break;
-        case 0x12: 
-            // STAX (DE)
-            motherboard->memory[GET_DE] = cpu->a;
-            break;
-        case 0x13: 
-            // INC DE (INX rp)
-            tmp_rp = GET_DE;
-            tmp_rp++;
-            cpu->d = (tmp_rp & 0xFF00) >> 8;
-            cpu->e = (tmp_rp & 0x00FF);
-            break;
-        case 0x14: 
-            // INC D (INR r)
-            cpu->d ++;
-            set_zero_sign_parity_from_byte(cpu, cpu->d);
-            cpu->auxiliary_carry_flag = (bool)(((cpu->d) & 0x0F) == 0);
-            break;
-        case 0x15: 
-            // DEC D (DCR r)
-            cpu->d --;
-            set_zero_sign_parity_from_byte(cpu, cpu->d);
-            cpu->auxiliary_carry_flag = (bool)(((cpu->d) & 0x0F) != 0x0F);
-            break;
-        case 0x16: 
-            // MVI D, d8  (LD D, d8)
-            cpu->d = motherboard->memory[cpu->pc + 1];
-            pc_increments = 2;
-            break;
-        case 0x17: // RAL
-            // RAL (Rotate Accumulator Left through carry)
-            // The content of the accumulator is rotated left one position.  The low order bit is set
-            // equal to the CY flag and the CY flag is set to the value shifted out of the high order 
-            // bit position.
-            tmp_bool = cpu->carry_flag;
-            cpu->carry_flag = (bool)(cpu->a & 0x80);
-            cpu->a = cpu->a << 1;
-            if(tmp_bool) {
-                cpu->a = cpu->a | 0x01;
+            else {
+                cpu->pc = cpu->pc + 4;
             }
-            break;
-        case 0x19: 
-            // ADD HL, DE (DAD rp)
-            // Only the carry flag is affected, and then if the 16-bit addition carries out.
-            tmp_32 = (uint32_t)(GET_HL) + (uint32_t)(GET_DE);
-            cpu->carry_flag = (bool)(tmp_32 > 0xFFFF);
-            cpu->h = (uint8_t)((tmp_32 & 0xFF00) >> 8);
-            cpu->l = (uint8_t)(tmp_32 & 0x00FF);
-            break;
-        case 0x1A: 
-            // LDAX DE
-            cpu->a = motherboard->memory[GET_DE];
-            break;
-        case 0x1B: 
-            // DEC DE (INX rp)
-            tmp_rp = GET_DE;
-            tmp_rp--;
-            cpu->d = (tmp_rp & 0xFF00) >> 8;
-            cpu->e = (tmp_rp & 0x00FF);
-            break;
-        case 0x1C: 
-            // INC E (INR r)
-            cpu->e ++;
-            set_zero_sign_parity_from_byte(cpu, cpu->e);
-            cpu->auxiliary_carry_flag = (bool)(((cpu->e) & 0x0F) == 0);
-            break;
-        case 0x1D: 
-            // DEC E (DCR r)
-            cpu->e --;
-            set_zero_sign_parity_from_byte(cpu, cpu->e);
-            cpu->auxiliary_carry_flag = (bool)(((cpu->e) & 0x0F) != 0x0F);
-            break;
-        case 0x1E: 
-            // MVI E, d8  (LD E, d8)
-            cpu->e = motherboard->memory[cpu->pc + 1];
-            pc_increments = 2;
-            break;
-        case 0x1F: 
-            // RAR - Rotate right through carry
-            // The content of the accumulator is rotated right one position.  The high-order bit is set
-            // to the CY flag and the CY flag is set to the value shifted out of the low order bit position.
-            tmp_bool = cpu->carry_flag;
-            cpu->carry_flag = (bool)(cpu->a & 0x01);
-            cpu->a = cpu->a >> 1;
-            if (tmp_bool) {
-                cpu->a = cpu->a | 0x80;
+            *num_states = *num_states + 15;
+            executed = 2;
+            break;
+        case FUSION_MOV_A_M_INX_H:
+            cpu->a = read_byte(motherboard, cpu->hl);
+            cpu->hl++;
+            cpu->pc = cpu->pc + 2;
+            *num_states = *num_states + 12;
+            executed = 2;
+            break;
+        case FUSION_LDAX_D_MOV_M_A_INX_H:
+        case FUSION_LDAX_D_MOV_M_A_INX_H_INX_D:
+            cpu->a = read_byte(motherboard, cpu->de);
+            write_byte(motherboard, cpu, cpu->hl, cpu->a);
+            if (!block->valid) {
+                cpu->pc = cpu->pc + 2;
+                *num_states = *num_states + 14;
+                executed = 2;
+                break;
             }
-            break;
-        case 0x21: 
-            // LXI HL, data 16
-            cpu->h = motherboard->memory[cpu->pc + 2];
-            cpu->l = motherboard->memory[cpu->pc + 1];
-            pc_increments = 3;
-            break;
-        case 0x22: 
-            // SHLD addr  (store H and L direct)
-            // The content of register L is moved to teh memory location whose address is specified in byte 2 and
-            // byte 3.  The content of register H is moved to the succeeding memory location.  Flags are not 
-            // affected.
-            motherboard->memory[TWO_INSTR_TO_INT16] = cpu->l;
-            motherboard->memory[TWO_INSTR_TO_INT16 + 1] = cpu->h;
-            pc_increments = 3;
-            break;
-        case 0x23: 
-            // INC HL (INX rp)
-            tmp_rp = GET_HL;
-            tmp_rp++;
-            cpu->h = (tmp_rp & 0xFF00) >> 8;
-            cpu->l = (tmp_rp & 0x00FF);
-            break;
-        case 0x24: 
-            // INC H (INR r)
-            cpu->h ++;
-            set_zero_sign_parity_from_byte(cpu, cpu->h);
-            cpu->auxiliary_carry_flag = (bool)(((cpu->h) & 0x0F) == 0);
-            break;
-        case 0x25: 
-            // DEC H (DCR r)
-            cpu->h --;
-            set_zero_sign_parity_from_byte(cpu, cpu->h);
-            cpu->auxiliary_carry_flag = (bool)(((cpu->h) & 0x0F) != 0x0F);
-            break;
-        case 0x26: 
-            // MVI H, d8  (LD H, d8)
-            cpu->h = motherboard->memory[cpu->pc + 1];
-            pc_increments = 2;
-            break;
-        case 0x27: 
-            // DAA (Decimal adjust accumulator)
-            /* The eight-bit number in the accumulator is adjusted to form two four-bit Binary-Coded-Decimal digits
-               by the following process:
-               1. If the value of the least significant 4 bits of the accumulator is greater than 9 or if the AC flag
-               is set, 6 is added to the accumulator.
-               2. If the value of the most significant 4 bits of the accumulator is now greater than 9, or if the CY
-               flag is set, 6 is added to the most significant 4 bits of the accumulator.
-               NOTE: All flags are affected */
-        
-            // copying the MAME logic
-            tmp_8 = cpu->a;
-            if (cpu->auxiliary_carry_flag || ((cpu->a & 0xF) > 0x9)) {
-                tmp_8 = tmp_8 + 0x06;
+            cpu->hl++;
+            if (decoded->fusion == FUSION_LDAX_D_MOV_M_A_INX_H_INX_D) {
+                cpu->de++;
+                cpu->pc = cpu->pc + 4;
+                *num_states = *num_states + 24;
+                executed = 4;
             }
-            if (cpu->carry_flag || (cpu->a > 0x99)) {
-                tmp_8 = tmp_8 + 0x60;
+            else {
+                cpu->pc = cpu->pc + 3;
+                *num_states = *num_states + 19;
+                executed = 3;
             }
-            cpu->carry_flag = (bool)(cpu->carry_flag || (cpu->a > 0x99));
-            cpu->auxiliary_carry_flag = (bool)((cpu->a ^ tmp_8) & 0x10);
-            cpu->a = (uint8_t)(tmp_8 & 0xFF);
-            set_zero_sign_parity_from_byte(cpu, cpu->a);
-            break;
-        case 0x29: // DAD
-            // ADD HL, HL (DAD rp)
-            // Only the carry flag is affected, and then if the 16-bit addition carries out.
-            // TODO: This could be made faster by converting this to a shift left by 1 (because HL + HL == 2 * HL == HL << 1)
-            tmp_32 = (uint32_t)(GET_HL) + (uint32_t)(GET_HL);
-            cpu->carry_flag = (bool)(tmp_32 > 0xFFFF);
-            cpu->h = (uint8_t)((tmp_32 & 0xFF00) >> 8);
-            cpu->l = (uint8_t)(tmp_32 & 0x00FF);
-            break;
-        case 0x2A: 
-            // LHLD addr (load H and L direct)
-            // The content of the memory location is specified in byte 2 and byte 3 of the instruction, is moved to
-            // register L.  The content of the memory location at the succeeding address is moved to register H.
-            // flags are not affected.
-            cpu->l = motherboard->memory[TWO_INSTR_TO_INT16];
-            cpu->h = motherboard->memory[TWO_INSTR_TO_INT16 + 1];
-            pc_increments = 3;
-            break;
-        case 0x2B: 
-            // DEC HL (INX rp)
-            tmp_rp = GET_HL;
-            tmp_rp--;
-            cpu->h = (tmp_rp & 0xFF00) >> 8;
-            cpu->l = (tmp_rp & 0x00FF);
-            break;
-        case 0x2C: 
-            // INC L (INR r)
-            cpu->l ++;
-            set_zero_sign_parity_from_byte(cpu, cpu->l);
-            cpu->auxiliary_carry_flag = (bool)(((cpu->l) & 0x0F) == 0);
-            break;
-        case 0x2D:
-            // DEC L (DCR r)
-            cpu->l --;
-            set_zero_sign_parity_from_byte(cpu, cpu->l);
-            cpu->auxiliary_carry_flag = (bool)(((cpu->l) & 0x0F) != 0x0F);
-            break;
-        case 0x2E: 
-            // MVI L, d8  (LD L, d8)
-            cpu->l = motherboard->memory[cpu->pc + 1];
-            pc_increments = 2;
-            break;
-        case 0x2F: 
-            // CMA (complement accumulator)
-            cpu->a = ~(cpu->a);
-            break;
-        case 0x31:
-            // LXI SP, data 16
-            cpu->sp = TWO_INSTR_TO_INT16;
-            cpu->stack_pointer_start = cpu->sp;
-            pc_increments = 3;
-            break;
-        case 0x32: 
-            // STA data 16 (store accumulator direct)
-            motherboard->memory[TWO_INSTR_TO_INT16] = cpu->a;
-            pc_increments = 3;
-            break;
-        case 0x33: 
-            // INC SP (INX rp)
-            cpu->sp ++;
-            break;
-        case 0x34:
-            // INC (HL)  (INR M)
-            motherboard->memory[GET_HL]++;
-            set_zero_sign_parity_from_byte(cpu, motherboard->memory[GET_HL]);
-            cpu->auxiliary_carry_flag = (bool)(((motherboard->memory[GET_HL]) & 0x0F) == 0);
-            break;
-        case 0x35:
-            // DEC (HL)  (DCR M)
-            motherboard->memory[GET_HL]--;
-            set_zero_sign_parity_from_byte(cpu, motherboard->memory[GET_HL]);
-            cpu->auxiliary_carry_flag = (bool)(((motherboard->memory[GET_HL]) & 0x0F) != 0x0F);
-            break;
-        case 0x36: 
-            // MVI M, data (a.k.a. LD (HL), data)
-            motherboard->memory[GET_HL] = motherboard->memory[cpu->pc + 1];
-            pc_increments = 2;
-            break;
-        case 0x37: 
-            // STC (set carry)
-            cpu->carry_flag = true;
-            break;
-        case 0x39:
-            // ADD HL, SP (DAD rp)
-            // Only the carry flag is affected, and then if the 16-bit addition carries out.
-            tmp_32 = (uint32_t)(GET_HL) + (uint32_t)(cpu->sp);
-            cpu->carry_flag = (bool)(tmp_32 > 0xFFFF);
-            cpu->h = (uint8_t)((tmp_32 & 0xFF00) >> 8);
-            cpu->l = (uint8_t)(tmp_32 & 0x00FF);
-            break;
-        case 0x3A: 
-            // LDA data 16 (load accumulator direct)
-            cpu->a = motherboard->memory[TWO_INSTR_TO_INT16];
-            pc_increments = 3;
-            break;
-        case 0x3B: 
-            // DEC SP (DCX rp)
-            cpu->sp --;
-            break;
-        case 0x3C: 
-            // INC A (INR r)
-            cpu->a ++;
-            set_zero_sign_parity_from_byte(cpu, cpu->a);
-            cpu->auxiliary_carry_flag = (bool)(((cpu->a) & 0x0F) == 0);
-            break;
-        case 0x3D: 
-            // DEC A (DCR r)
-            cpu->a --;
-            set_zero_sign_parity_from_byte(cpu, cpu->a);
-            cpu->auxiliary_carry_flag = (bool)(((cpu->a) & 0x0F) != 0x0F);
-            break;
-        case 0x3E:
-            // MVI A, d8  (LD A, d8)
-            cpu->a = motherboard->memory[cpu->pc + 1];
-            pc_increments = 2;
-            break;
-        case 0x3F: 
-            // CMC (complement carry flag)
-            cpu->carry_flag = !(cpu->carry_flag);
-            break;
-        case 0x40: 
-            // LD B, B (MOV r1, r2)
-            cpu->b = cpu->b;
-            break;
-        case 0x41: 
-            // LD B, C (MOV r1, r2)
-            cpu->b = cpu->c;
-            break;
-        case 0x42:
-            // LD B, D (MOV r1, r2)
-            cpu->b = cpu->d;
-            break;
-        case 0x43:
-            // LD B, E (MOV r1, r2)
-            cpu->b = cpu->e;
-            break;
-        case 0x44:
-            // LD B, H (MOV r1, r2)
-            cpu->b = cpu->h;
-            break;
-        case 0x45:
-            // LD B, L (MOV r1, r2)
-            cpu->b = cpu->l;
-            break;
-        case 0x46:
-            // LD B, (HL) (MOV r, M)
-            cpu->b = motherboard->memory[GET_HL];
-            break;
-        case 0x47: 
-            // LD B, A (MOV r1, r2)
-            cpu->b = cpu->a;
-            break;
-        case 0x48: 
-            // LD C, B (MOV r1, r2)
-            cpu->c= cpu->b;
-            break;
-        case 0x49: 
-            // LD C, C (MOV r1, r2)
-            cpu->c= cpu->c;
-            break;
-        case 0x4A: 
-            // LD C, D (MOV r1, r2)
-            cpu->c= cpu->d;
-            break;
-        case 0x4B: 
-            // LD C, E (MOV r1, r2)
-            cpu->c= cpu->e;
-            break;
-        case 0x4C: 
-            // LD C, H (MOV r1, r2)
-            cpu->c= cpu->h;
-            break;
-        case 0x4D:
-            // LD C, L (MOV r1, r2)
-            cpu->c= cpu->l;
-            break;
-        case 0x4E: 
-            // LD C, (HL) (MOV r, M)
-            cpu->c= motherboard->memory[GET_HL];
-            break;
-        case 0x4F: 
-            // LD C, A (MOV r1, r2)
-            cpu->c= cpu->a;
-            break;
-        case 0x50: 
-            // LD D, B (MOV r1, r2)
-            cpu->d= cpu->b;
-            break;
-        case 0x51: 
-            // LD D, C (MOV r1, r2)
-            cpu->d= cpu->c;
-            break;
-        case 0x52: 
-            // LD D, D (MOV r1, r2)
-            cpu->d= cpu->d;
-            break;
-        case 0x53: 
-            // LD D, E (MOV r1, r2)
-            cpu->d= cpu->e;
-            break;
-        case 0x54: 
-            // LD D, H (MOV r1, r2)
-            cpu->d= cpu->h;
-            break;
-        case 0x55: 
-            // LD D, L (MOV r1, r2)
-            cpu->d= cpu->l;
-            break;
-        case 0x56: 
-            // LD D, (HL) (MOV r, M)
-            cpu->d= motherboard->memory[GET_HL];
-            break;
-        case 0x57: 
-            // LD D, A (MOV r1, r2)
-            cpu->d= cpu->a;
-            break;
-        case 0x58: 
-            // LD E, B (MOV r1, r2)
-            cpu->e= cpu->b;
-            break;
-        case 0x59: 
-            // LD E, C (MOV r1, r2)
-            cpu->e= cpu->c;
-            break;
-        case 0x5A: 
-            // LD E, D (MOV r1, r2)
-            cpu->e= cpu->d;
-            break;
-        case 0x5B: 
-           // LD E, E (MOV r1, r2)
-            cpu->e= cpu->e;
-            break;
-        case 0x5C: 
-            // LD E, H (MOV r1, r2)
-            cpu->e= cpu->h;
-            break;
-        case 0x5D: 
-            // LD E, L (MOV r1, r2)
-            cpu->e= cpu->l;
-            break;
-        case 0x5E:
-            // LD E, (HL) (MOV r, M)
-            cpu->e= motherboard->memory[GET_HL];
-            break;
-        case 0x5F:
-            // LD E, A (MOV r1, r2)
-            cpu->e= cpu->a;
-            break;
-        case 0x60:
-            // LD H, B (MOV r1, r2)
-            cpu->h= cpu->b;
-            break;
-        case 0x61:
-            // LD H, C (MOV r1, r2)
-            cpu->h= cpu->c;
-            break;
-        case 0x62:
-            // LD H, D (MOV r1, r2)
-            cpu->h= cpu->d;
-            break;
-        case 0x63:
-            // LD H, E (MOV r1, r2)
-            cpu->h= cpu->e;
-            break;
-        case 0x64:
-            // LD H, H (MOV r1, r2)
-            cpu->h= cpu->h;
-            break;
-        case 0x65:
-            // LD H, L (MOV r1, r2)
-            cpu->h= cpu->l;
-            break;
-        case 0x66:
-            // LD H, (HL) (MOV r, M)
-            cpu->h= motherboard->memory[GET_HL];
-            break;
-        case 0x67:
-            // LD H, A (MOV r1, r2)
-            cpu->h= cpu->a;
-            break;
-        case 0x68: 
-            // LD L, B (MOV r1, r2)
-            cpu->l= cpu->b;
-            break;
-        case 0x69: 
-            // LD L, C (MOV r1, r2)
-            cpu->l= cpu->c;
-            break;
-        case 0x6A: 
-            // LD L, D (MOV r1, r2)
-            cpu->l= cpu->d;
-            break;
-        case 0x6B: 
-            // LD L, E (MOV r1, r2)
-            cpu->l= cpu->e;
-            break;
-        case 0x6C: 
-            // LD L, H (MOV r1, r2)
-            cpu->l= cpu->h;
-            break;
-        case 0x6D: 
-            // LD L, L (MOV r1, r2)
-            cpu->l= cpu->l;
-            break;
-        case 0x6E: 
-            // LD L, (HL) (MOV r, M)
-            cpu->l= motherboard->memory[GET_HL];
-            break;
-        case 0x6F: 
-            // LD L, A (MOV r1, r2)
-            cpu->l= cpu->a;
-            break;
-        case 0x70: 
-            // LD (HL), B  (MOV M, r)
-            motherboard->memory[GET_HL] = cpu->b;
-            break;
-        case 0x71: 
-            // LD (HL), C  (MOV M, r)
-            motherboard->memory[GET_HL] = cpu->c;
-            break;
-        case 0x72: 
-            // LD (HL), D  (MOV M, r)
-            motherboard->memory[GET_HL] = cpu->d;
-            break;
-        case 0x73:
-            // LD (HL), E  (MOV M, r)
-            motherboard->memory[GET_HL] = cpu->e;
-            break;
-        case 0x74: 
-            // LD (HL), H  (MOV M, r)
-            motherboard->memory[GET_HL] = cpu->h;
-            break;
-        case 0x75: 
-            // LD (HL), L  (MOV M, r)
-            motherboard->memory[GET_HL] = cpu->l;
-            break;
-        case 0x76: 
-            // HLT
-            cpu->halted = true;
-            break;
-        case 0x77: 
-            // LD (HL), A  (MOV M, r)
-            motherboard->memory[GET_HL] = cpu->a;
-            break;
-        case 0x78: 
-            // LD A, B (MOV r1, r2)
-            cpu->a= cpu->b;
-            break;
-        case 0x79: // MOV
-            // LD A, C (MOV r1, r2)
-            cpu->a= cpu->c;
-            break;
-        case 0x7A: // MOV
-            // LD A, D (MOV r1, r2)
-            cpu->a= cpu->d;
-            break;
-        case 0x7B: // MOV
-            // LD A, E (MOV r1, r2)
-            cpu->a= cpu->e;
-            break;
-        case 0x7C: // MOV
-            // LD A, H (MOV r1, r2)
-            cpu->a= cpu->h;
             break;
-        case 0x7D: // MOV
-            // LD A, L (MOV r1, r2)
-            cpu->a= cpu->l;
-            break;
-        case 0x7E: // MOV
-            // LD A, (HL) (MOV r, M)
-            cpu->a= motherboard->memory[GET_HL];
-            break;
-        case 0x7F: // MOV
-            // LD A, A (MOV r1, r2)
-            cpu->a= cpu->a;
-            break;
-        case 0x80: 
-            // ADD A, B
-            do_addition(cpu, cpu->b, false);
-            break;
-        case 0x81: 
-            // ADD, C
-            do_addition(cpu, cpu->c, false);
-            break;
-        case 0x82: 
-            // ADD, D
-            do_addition(cpu, cpu->d, false);
-            break;
-        case 0x83: 
-            // ADD, E
-            do_addition(cpu, cpu->e, false);
-            break;
-        case 0x84: 
-            // ADD, C
-            do_addition(cpu, cpu->h, false);
-            break;
-        case 0x85: 
-            // ADD, C
-            do_addition(cpu, cpu->l, false);
-            break;
-        case 0x86: 
-            // ADD, (HL))
-            do_addition(cpu, motherboard->memory[GET_HL], false);
-            break;
-        case 0x87: 
-            // ADD, A
-            do_addition(cpu, cpu->a, false);
-            break;
-        case 0x88: 
-            // ADC A, B
-            do_addition(cpu, cpu->b, cpu->carry_flag);
-            break;
-        case 0x89: 
-            // ADC A, C
-            do_addition(cpu, cpu->c, cpu->carry_flag);
-            break;
-        case 0x8A: 
-            // ADC A, D
-            do_addition(cpu, cpu->d, cpu->carry_flag);
-            break;
-        case 0x8B: 
-            // ADC A, E
-            do_addition(cpu, cpu->e, cpu->carry_flag);
-            break;
-        case 0x8C: 
-            // ADC A, H
-            do_addition(cpu, cpu->h, cpu->carry_flag);
-            break;
-        case 0x8D: 
-            // ADC A, L
-            do_addition(cpu, cpu->l, cpu->carry_flag);
-            break;
-        case 0x8E: 
-            // ADC, (HL))
-            do_addition(cpu, motherboard->memory[GET_HL], cpu->carry_flag);
-            break;
-        case 0x8F: 
-            // ADC A, A
-            do_addition(cpu, cpu->a, cpu->carry_flag);
-            break;
-        case 0x90: 
-            //SUB A, B
-            do_subtraction(cpu, cpu->b, false, true);
-            break;
-        case 0x91: 
-            //SUB A, C
-            do_subtraction(cpu, cpu->c, false, true);
-            break;
-        case 0x92: 
-            //SUB A, D
-            do_subtraction(cpu, cpu->d, false, true);
-            break;
-        case 0x93: 
-            //SUB A, E
-            do_subtraction(cpu, cpu->e, false, true);
-            break;
-        case 0x94: 
-            //SUB A, H
-            do_subtraction(cpu, cpu->h, false, true);
-            break;
-        case 0x95: 
-            //SUB A, L
-            do_subtraction(cpu, cpu->l, false, true);
-            break;
-        case 0x96: 
-            //SUB A, (HL)
-            do_subtraction(cpu, motherboard->memory[GET_HL], false, true);
-            break;
-        case 0x97: 
-            //SUB A, A
-            do_subtraction(cpu, cpu->a, false, true);
-            break;
-        case 0x98:
-            // SBB A, B
-            do_subtraction(cpu, cpu->b, cpu->carry_flag, true);
-            break;
-        case 0x99: 
-            // SBB A, C
-            do_subtraction(cpu, cpu->c, cpu->carry_flag, true);
-            break;
-        case 0x9A: 
-            // SBB A, D
-            do_subtraction(cpu, cpu->d, cpu->carry_flag, true);
-            break;
-        case 0x9B: 
-            // SBB A, E
-            do_subtraction(cpu, cpu->e, cpu->carry_flag, true);
-            break;
-        case 0x9C: 
-            // SBB A, H
-            do_subtraction(cpu, cpu->h, cpu->carry_flag, true);
-            break;
-        case 0x9D: 
-            // SBB A, L
-            do_subtraction(cpu, cpu->l, cpu->carry_flag, true);
-            break;
-        case 0x9E: 
-            // SBB A, (HL)
-            do_subtraction(cpu, motherboard->memory[GET_HL], cpu->carry_flag, true);
-            break;
-        case 0x9F: 
-            // SBB A, A
-            do_subtraction(cpu, cpu->a, cpu->carry_flag, true);
-            break;
-        case 0xA0: 
-            // AND B (ANA r)
-            do_and(cpu, cpu->b);
-            break;
-        case 0xA1: 
-            // AND C (ANA r)
-            do_and(cpu, cpu->c);
-            break;
-        case 0xA2: 
-            // AND D (ANA r)
-            do_and(cpu, cpu->d);
-            break;
-        case 0xA3: 
-            // AND E (ANA r)
-            do_and(cpu, cpu->e);
-            break;
-        case 0xA4: 
-            // AND H (ANA r)
-            do_and(cpu, cpu->h);
-            break;
-        case 0xA5: 
-            // AND L (ANA r)
-            do_and(cpu, cpu->l);
-            break;
-        case 0xA6:
-            // AND (HL) (ANA M)
-            do_and(cpu, motherboard->memory[GET_HL]);
-            break; 
-        case 0xA7: 
-            // AND A (ANA r)
-            do_and(cpu, cpu->a);
-            break;
-        case 0xA8: 
-            // XOR B (XRA r)
-            do_xor(cpu, cpu->b);
-            break;
-        case 0xA9: 
-            // XOR C (XRA r)
-            do_xor(cpu, cpu->c);
-            break;
-        case 0xAA: 
-            // XOR D (XRA r)
-            do_xor(cpu, cpu->d);
-            break;
-        case 0xAB: 
-            // XOR E (XRA r)
-            do_xor(cpu, cpu->e);
-            break;
-        case 0xAC: 
-            // XOR H (XRA r)
-            do_xor(cpu, cpu->h);
-            break;
-        case 0xAD: 
-            // XOR L (XRA r)
-            do_xor(cpu, cpu->l);
-            break;
-        case 0xAE: 
-            // XOR (HL) (XRA M)
-            do_xor(cpu, motherboard->memory[GET_HL]);
-            break;
-        case 0xAF: 
-            // XOR A (XRA r)
-            do_xor(cpu, cpu->a);
-            break;
-        case 0xB0: 
-            // OR B (ORA r)
-            do_or(cpu, cpu->b); 
-            break;
-        case 0xB1: 
-            // OR C (ORA r)
-            do_or(cpu, cpu->c); 
-            break;
-        case 0xB2: 
-            // OR D (ORA r)
-            do_or(cpu, cpu->d); 
-            break;
-        case 0xB3: 
-            // OR E (ORA r)
-            do_or(cpu, cpu->e); 
-            break;
-        case 0xB4: 
-            // OR H (ORA r)
-            do_or(cpu, cpu->h); 
-            break;
-        case 0xB5: 
-            // OR L (ORA r)
-            do_or(cpu, cpu->l); 
-            break;
-        case 0xB6: 
-            // OR (HL) (ORA M)
-            do_or(cpu, motherboard->memory[GET_HL]); 
-            break;
-        case 0xB7: 
-            // OR A (ORA r)
-            do_or(cpu, cpu->a); 
-            break;
-        case 0xB8: 
-            // CMP B
-            do_subtraction(cpu, cpu->b, false, false);
-            break;
-        case 0xB9: 
-            // CMP C
-            do_subtraction(cpu, cpu->c, false, false);
-            break;
-        case 0xBA: 
-            // CMP D
-            do_subtraction(cpu, cpu->d, false, false);
-            break;
-        case 0xBB: 
-            // CMP E
-            do_subtraction(cpu, cpu->e, false, false);
-            break;
-        case 0xBC: 
-            // CMP H
-            do_subtraction(cpu, cpu->h, false, false);
-            break;
-        case 0xBD: 
-            // CMP L
-            do_subtraction(cpu, cpu->l, false, false);
-            break;
-        case 0xBE: 
-            // CMP M (CMP (HL))
-            do_subtraction(cpu, motherboard->memory[GET_HL], false, false);
-            break;
-        case 0xBF: 
-            // CMP A
-            do_subtraction(cpu, cpu->a, false, false);
-            break;
-        case 0xC0: 
-            // RET NZ
-            do_conditional_return(motherboard, cpu, !(cpu->zero_flag), num_states, &pc_increments);
-            break;
-        case 0xC1: // POP
-            // POP BC
-            cpu->b = motherboard->memory[cpu->sp + 1];
-            cpu->c = motherboard->memory[cpu->sp];
-            cpu->sp = cpu->sp + 2;
-            break;
-        case 0xC2: 
-            // JMP NZ
-            do_conditional_jump(motherboard, cpu, !(cpu->zero_flag), &pc_increments);
-            break;
-        case 0xC3: // JMP
-            cpu->pc = (motherboard->memory[cpu->pc+2] << 8) | motherboard->memory[cpu->pc+1];
-            pc_increments = 0;
-            break;
-        case 0xC4:
-            // CALL NZ addr
-            do_conditional_call(motherboard, cpu, !(cpu->zero_flag), num_states, &pc_increments);
-            break;
-        case 0xC5:
-            // PUSH BC
-            motherboard->memory[cpu->sp - 1] = cpu->b;
-            motherboard->memory[cpu->sp - 2] = cpu->c;
-            cpu->sp = cpu->sp - 2;
-            break;
-        case 0xC6: 
-            // ADI d8
-            do_addition(cpu, motherboard->memory[cpu->pc + 1], false);
-            pc_increments = 2;
-            break;
-        case 0xC7: 
-            // RST 0
-            do_interrupt(motherboard, cpu, 0, &pc_increments);
-            break;
-        case 0xC8: 
-            // RET Z
-            do_conditional_return(motherboard, cpu, cpu->zero_flag, num_states, &pc_increments);
-            break;
-        case 0xC9: 
-            // RET
-            do_conditional_return(motherboard, cpu, true, num_states, &pc_increments);
-            // conditional returns take 11 states if the condition is true.  This is an unconditional return
-            // which only takes 10.  I'll pull it from the table though, as the compiler should make this a static assignment anyway, 
-            // and this way if the table updates later for a different CPU I don't need to remember to change this code.
-            *num_states = states_per_opcode[0xC9];
-            break;
-        case 0xCA:
-            // JMP Z
-            do_conditional_jump(motherboard, cpu, cpu->zero_flag, &pc_increments);
-            break;
-        case 0xCC: 
-            // CALL Z addr
-            do_conditional_call(motherboard, cpu, cpu->zero_flag, num_states, &pc_increments);
-            break;
-        case 0xCD: 
-            // CALL addr
-            // this is an unconditional call, so pass in true for the flag
-            do_conditional_call(motherboard, cpu, true, num_states, &pc_increments);
-            break;
-        case 0xCE: 
-            // ACI data (add immediate with carry);
-            do_addition(cpu, motherboard->memory[cpu->pc + 1], cpu->carry_flag);
-            pc_increments = 2;
-            break;
-        case 0xCF: 
-            // RST 1
-            do_interrupt(motherboard, cpu, 1, &pc_increments);
-            break;
-        case 0xD0: 
-            // RET NC
-            do_conditional_return(motherboard, cpu, !(cpu->carry_flag), num_states, &pc_increments);
-            break;
-        case 0xD1:
-            // POP DE
-            cpu->d = motherboard->memory[cpu->sp + 1];
-            cpu->e = motherboard->memory[cpu->sp];
-            cpu->sp = cpu->sp + 2;
-            break;
-        case 0xD2: 
-            // JMP NC
-            do_conditional_jump(motherboard, cpu, !(cpu->carry_flag), &pc_increments);
-            break;
-        case 0xD3: 
-            // OUT port, A
-            if (!motherboard->output_handler(motherboard, motherboard->memory[cpu->pc + 1], cpu->a)) {
-                return false;
+        case FUSION_LDAX_D_STAX_B_INX_D:
+            cpu->a = read_byte(motherboard, cpu->de);
+            write_byte(motherboard, cpu, cpu->bc, cpu->a);
+            if (!block->valid) {
+                cpu->pc = cpu->pc + 2;
+                *num_states = *num_states + 14;
+                executed = 2;
+                break;
             }
-            pc_increments = 2;
-            break;
-        case 0xD4: 
-            // CALL NC addr
-            do_conditional_call(motherboard, cpu, !(cpu->carry_flag), num_states, &pc_increments);
-            break;
-        case 0xD5: 
-            // PUSH DE
-            motherboard->memory[cpu->sp - 1] = cpu->d;
-            motherboard->memory[cpu->sp - 2] = cpu->e;
-            cpu->sp = cpu->sp - 2;
-            break;
-        case 0xD6: 
-            // SUI data
-            do_subtraction(cpu, motherboard->memory[cpu->pc + 1], false, true);
-            pc_increments = 2;
-            break;
-        case 0xD7: 
-            // RST 2
-            do_interrupt(motherboard, cpu, 2, &pc_increments);
-            break;
-        case 0xD8: 
-            // RET C
-            do_conditional_return(motherboard, cpu, cpu->carry_flag, num_states, &pc_increments);
-            break;
-        case 0xDA:
-            // JMP C
-            do_conditional_jump(motherboard, cpu, cpu->carry_flag, &pc_increments);
-            break;
-        case 0xDB: 
-            // IN A port
-            if (!motherboard->input_handler(motherboard, motherboard->memory[cpu->pc + 1], &(cpu->a))) {
-                return false;
+            cpu->de++;
+            cpu->pc = cpu->pc + 3;
+            *num_states = *num_states + 19;
+            executed = 3;
+            break;
+        default:  // FUSION_CPI_JZ, FUSION_CPI_JNZ
+            do_subtraction(cpu, decoded->bytes[1], false, false);
+            if ((cpu->a == decoded->bytes[1]) == (decoded->fusion == FUSION_CPI_JZ)) {
+                cpu->pc = decoded[1].operand;
             }
-            pc_increments = 2;
-            break;
-        case 0xDC: 
-            // CALL C addr
-            do_conditional_call(motherboard, cpu, cpu->carry_flag, num_states, &pc_increments);
-            break;
-        case 0xDE: 
-            // SBI data (subtract intermediate with carry)
-            do_subtraction(cpu, motherboard->memory[cpu->pc + 1], cpu->carry_flag, true);
-            pc_increments = 2;
-            break;
-        case 0xDF: 
-            // RST 3
-            do_interrupt(motherboard, cpu, 3, &pc_increments);
-            break;
-        case 0xE0: 
-            // RET PO
-            do_conditional_return(motherboard, cpu, !(cpu->parity_flag), num_states, &pc_increments);
-            break;
-        case 0xE1: // POP
-            // POP HL
-            cpu->h = motherboard->memory[cpu->sp + 1];
-            cpu->l = motherboard->memory[cpu->sp];
-            cpu->sp = cpu->sp + 2;
-            break;
-        case 0xE2: 
-            // JMP PO
-            do_conditional_jump(motherboard, cpu, !(cpu->parity_flag), &pc_increments);
-            break;
-        case 0xE3: 
-            // XTHL
-            // Exchange stack top with H and L.
-            tmp_h = cpu->h;
-            tmp_l = cpu->l;
-            cpu->h = motherboard->memory[cpu->sp + 1];
-            cpu->l = motherboard->memory[cpu->sp];
-            motherboard->memory[cpu->sp] = tmp_l;
-            motherboard->memory[cpu->sp + 1] = tmp_h;
-            break;
-        case 0xE4: 
-            // CALL PO addr
-            do_conditional_call(motherboard, cpu, !(cpu->parity_flag), num_states, &pc_increments);
-            break;
-        case 0xE5:
-            // PUSH HL
-            motherboard->memory[cpu->sp - 1] = cpu->h;
-            motherboard->memory[cpu->sp - 2] = cpu->l;
-            cpu->sp = cpu->sp - 2;
-            break;
-        case 0xE6: 
-            // AND data (ANI data)
-            do_and(cpu, motherboard->memory[cpu->pc + 1]);
-            pc_increments = 2;
-            break;
-        case 0xE7: 
-            // RST 4
-            do_interrupt(motherboard, cpu, 4, &pc_increments);
-            break;
-        case 0xE8: 
-            // RET PE
-            do_conditional_return(motherboard, cpu, cpu->parity_flag, num_states, &pc_increments);
-            break;
-        case 0xE9: 
-            // PCHL - Jump to (HL) indirect 
-            cpu->pc = GET_HL;
-            pc_increments = 0;
-            break;
-        case 0xEA:
-            // JMP PE
-            do_conditional_jump(motherboard, cpu, cpu->parity_flag, &pc_increments);
-            break;
-        case 0xEB: 
-            // XCHG (a.k.a. EX DE, HL)
-            tmp_d = cpu->d;
-            tmp_e = cpu->e;
-            cpu->d = cpu->h;
-            cpu->e = cpu->l;
-            cpu->h = tmp_d;
-            cpu->l = tmp_e;
-            break;
-        case 0xEC: 
-            // CALL PE addr
-            do_conditional_call(motherboard, cpu, cpu->parity_flag, num_states, &pc_increments);
-            break;
-        case 0xEE: 
-            // XRI data (XOR intermediate)
-            do_xor(cpu, motherboard->memory[cpu->pc + 1]);
-            pc_increments = 2;
-            break;
-        case 0xEF: 
-            // RST 5
-            do_interrupt(motherboard, cpu, 5, &pc_increments);
-            break;
-        case 0xF0: 
-            // RET P
-            do_conditional_return(motherboard, cpu, !(cpu->sign_flag), num_states, &pc_increments);
-            break;
-        case 0xF1: 
-            // POP PSW (POP AF)
-            cpu->a = motherboard->memory[cpu->sp + 1];
-            set_flags_from_byte(cpu, motherboard->memory[cpu->sp]);
-            cpu->sp = cpu->sp + 2;
-            break;
-        case 0xF2: 
-            // JMP P
-            do_conditional_jump(motherboard, cpu, !(cpu->sign_flag), &pc_increments);
-            break;
-        case 0xF3: // DI
-            cpu->interrupts_enabled = false;
-            break;
-        case 0xF4: 
-            // CALL P addr
-            do_conditional_call(motherboard, cpu, !(cpu->sign_flag), num_states, &pc_increments);
-            break;
-        case 0xF5:
-            // PUSH PSW (a.k.a. PUSH AF)
-            motherboard->memory[cpu->sp - 1] = cpu->a;
-            motherboard->memory[cpu->sp - 2] = get_byte_from_flags(cpu);
-            cpu->sp = cpu->sp - 2;
-            break;
-        case 0xF6: 
-            // OR data (ORI data)
-            do_or(cpu, motherboard->memory[cpu->pc + 1]);
-            pc_increments = 2;
-            break;
-        case 0xF7: 
-            // RST 6
-            do_interrupt(motherboard, cpu, 6, &pc_increments);
-            break;
-        case 0xF8: 
-            // RET M
-            do_conditional_return(motherboard, cpu, cpu->sign_flag, num_states, &pc_increments);
-            break;
-        case 0xF9: 
-            // SPHL
-            cpu->sp = GET_HL;
-            break;
-        case 0xFA:
-            // JMP M
-            do_conditional_jump(motherboard, cpu, cpu->sign_flag, &pc_increments);
-            break;
-        case 0xFB: 
-            // EI
-            cpu->enable_interrupts_after_next_instruction = true;
-            break;
-        case 0xFC: 
-            // CALL M addr
-            do_conditional_call(motherboard, cpu, cpu->sign_flag, num_states, &pc_increments);
-            break;
-        case 0xFE: 
-            // CPI data (CMP data)
-            do_subtraction(cpu, motherboard->memory[cpu->pc + 1], false, false);
-            pc_increments = 2;
-            break;
-        case 0xFF: 
-            // RST 7
-            do_interrupt(motherboard, cpu, 7, &pc_increments);
+            else {
+                cpu->pc = cpu->pc + 5;
+            }
+            *num_states = *num_states + 17;
+            executed = 2;
             break;
-        default:  // 0x08, 0x10, 0x18, 0x20, 0x28, 0x30, 0x38, 0xCB, 0xD9, 0xDD, 0xED, 0xFD
-            printf("ERROR: Opcode %02X not valid\n", opcode); return (false); //(strbuff, "??");
     }
-    cpu->pc = cpu->pc + pc_increments;
-    return true;
+    *num_instructions = *num_instructions + executed;
+    return executed;
+}
+
+/* Executes instructions starting at cpu->pc.  Without a block, executes instructions from memory until the states
+   executed reach state_budget, the CPU halts, or it runs an EI; a budget of 0 executes just one.  With one, block
+   must be the cached block that starts at cpu->pc; its instructions are executed until one of them writes to the
+   block's own code or the states executed reach state_budget, and from the end of the block on into the next one
+   unless that one needs run_cpu8080().  Adds the states and the number of instructions executed to num_states and
+   num_instructions.  Returns false on error.  See execute8080.h. */
+typedef bool execute_function(motherboard8080 *motherboard, cpu8080 *cpu, const cached_block *block,
+                              uint64_t state_budget, uint64_t *num_states, uint64_t *num_instructions);
+
+#define EXECUTE_FUNCTION interpret_switch
+#include "execute8080.h"
+#undef EXECUTE_FUNCTION
+
+#define EXECUTE_FROM_BLOCK
+#define EXECUTE_FUNCTION execute_block_switch
+#include "execute8080.h"
+#undef EXECUTE_FUNCTION
+#undef EXECUTE_FROM_BLOCK
+
+#ifdef CPU8080_HAS_THREADED_DISPATCH
+#define EXECUTE_THREADED
+#define EXECUTE_FUNCTION interpret_threaded
+#include "execute8080.h"
+#undef EXECUTE_FUNCTION
+
+#define EXECUTE_FROM_BLOCK
+#define EXECUTE_FUNCTION execute_block_threaded
+#include "execute8080.h"
+#undef EXECUTE_FUNCTION
+#undef EXECUTE_FROM_BLOCK
+#undef EXECUTE_THREADED
+#endif
+
+// The engine is picked once per call into the CPU, not for every instruction.
+typedef struct {
+    execute_function *from_memory;
+    execute_function *from_block;
+} execute_engine;
+
+static const execute_engine execute_engines[] = {
+    [DISPATCH_SWITCH] = {&interpret_switch, &execute_block_switch},
+#ifdef CPU8080_HAS_THREADED_DISPATCH
+    [DISPATCH_THREADED] = {&interpret_threaded, &execute_block_threaded}
+#else
+    [DISPATCH_THREADED] = {&interpret_switch, &execute_block_switch}
+#endif
+};
+
+bool do_opcode(motherboard8080 *motherboard, cpu8080 *cpu, uint64_t *num_states) {
+    uint64_t num_instructions = 0;
+    *num_states = 0;
+    return execute_engines[cpu->dispatch].from_memory(motherboard, cpu, NULL, 0, num_states, &num_instructions);
 }
 
 // cycle() returns false on error
@@ -1390,6 +470,9 @@ bool cycle_cpu8080(motherboard8080 *motherboard, cpu8080 *cpu, uint64_t *num_sta
     if (!(cpu->halted)){
         flip_interrupts_on = cpu->enable_interrupts_after_next_instruction;
         retval = do_opcode(motherboard, cpu, num_states);
+        if (retval) {
+            cpu->instructions_executed++;
+        }
         if (flip_interrupts_on){
             cpu->interrupts_enabled = true;
             cpu->enable_interrupts_after_next_instruction = false;
@@ -1400,4 +483,123 @@ bool cycle_cpu8080(motherboard8080 *motherboard, cpu8080 *cpu, uint64_t *num_sta
         *num_states = 0;
         return true;
     }
-}
\ No newline at end of file
+}
+
+/* Runs block, which must be a busy-wait candidate starting at cpu->pc, like an execute_function.  If the pass leaves
+   the registers and flags as they were and ends back at the start of the block, then every later pass will too: the
+   block does not write memory, and nothing else can until run_cpu8080() returns.  That doesn't hold if the pass read
+   a memory-mapped device, which may change on its own, so those loops are left to run.  Otherwise the passes that
+   would fit in the budget are skipped, leaving the last one to run normally so the CPU stops at the same instruction
+   it would have anyway.  A loop that reads a device, or keeps changing its registers, is no longer a candidate. */
+static bool run_busy_wait(motherboard8080 *motherboard, cpu8080 *cpu, const execute_engine *engine, cached_block *block,
+                          uint64_t state_budget, uint64_t *num_states, uint64_t *num_instructions) {
+    uint16_t bc = cpu->bc, de = cpu->de, hl = cpu->hl, sp = cpu->sp;
+    uint8_t a = cpu->a, flags = get_byte_from_flags(cpu);
+    uint64_t memory_io_accesses = motherboard->memory_io_accesses;
+    uint64_t passes;
+
+    if (!engine->from_block(motherboard, cpu, block, state_budget, num_states, num_instructions)) {
+        return false;
+    }
+    if (cpu->pc != block->start_pc || *num_instructions != block->num_instructions || *num_states >= state_budget) {
+        // left the loop, or ran out of budget partway through a pass
+        return true;
+    }
+    if (motherboard->memory_io_accesses != memory_io_accesses) {
+        block->busy_wait_candidate = false;
+    }
+    else if (cpu->a == a && cpu->bc == bc && cpu->de == de && cpu->hl == hl && cpu->sp == sp &&
+             get_byte_from_flags(cpu) == flags) {
+        block->busy_wait_changed_passes = 0;
+        passes = (state_budget - *num_states - 1) / *num_states;
+        cpu->block_cache->busy_wait_skips++;
+        cpu->block_cache->busy_wait_states_skipped += passes * *num_states;
+        *num_instructions += passes * *num_instructions;
+        *num_states += passes * *num_states;
+    }
+    else if (++(block->busy_wait_changed_passes) == BLOCK_CACHE_BUSY_WAIT_CHANGED_PASSES) {
+        block->busy_wait_candidate = false;
+    }
+    return true;
+}
+
+/* Runs the CPU until it has executed at least state_budget states, and returns the number of states executed.  Stops early,
+   setting stop_reason to say why, when the CPU halts, when an instruction fails, or when pc reaches a breakpoint after an
+   instruction.  With a block cache this executes whole blocks, and with a JIT translated blocks, except that a block stops
+   as soon as it has used up the budget, so the last instruction executed is the same either way.  Busy-wait loops are
+   skipped over (see run_busy_wait()), and their states and instructions are counted as if they had run. */
+uint64_t run_cpu8080(motherboard8080 *motherboard, cpu8080 *cpu, uint64_t state_budget, cpu8080_stop_reason *stop_reason) {
+    const execute_engine *engine = &(execute_engines[cpu->dispatch]);
+    cached_block *block;
+    uint64_t states = 0, num_states, num_instructions, interpreter_budget;
+    bool flip_interrupts_on, ok;
+
+    *stop_reason = STOP_BUDGET_USED;
+    while (states < state_budget) {
+        if (cpu->halted) {
+            *stop_reason = STOP_HALTED;
+            break;
+        }
+        num_states = 0;
+        num_instructions = 0;
+        ok = true;
+        block = NULL;
+        // Blocks would run past breakpoints, and the instruction after EI has to be run on its own.
+        if (cpu->block_cache != NULL && cpu->breakpoints == NULL && !(cpu->enable_interrupts_after_next_instruction)) {
+            block = block_cache_lookup(cpu->block_cache, motherboard->memory_map, cpu->pc);
+            if (block->num_instructions == 0) {
+                block = NULL;
+            }
+            else if (block->busy_wait_candidate) {
+                ok = run_busy_wait(motherboard, cpu, engine, block, state_budget - states, &num_states,
+                                   &num_instructions);
+            }
+            else if (cpu->jit != NULL) {
+                run_jit_cpu8080(motherboard, cpu, state_budget - states, &num_states, &num_instructions);
+            }
+        }
+
+        if (num_instructions > 0 || !ok) {
+            // already run
+        }
+        else if (block != NULL) {
+            ok = engine->from_block(motherboard, cpu, block, state_budget - states, &num_states, &num_instructions);
+        }
+        else {
+            /* EI enables interrupts after the instruction that follows it, so that one runs on its own.  So does each
+               instruction run outside a block when there is a block cache, which gets the next one, or breakpoints. */
+            flip_interrupts_on = cpu->enable_interrupts_after_next_instruction;
+            interpreter_budget = (flip_interrupts_on || cpu->block_cache != NULL || cpu->breakpoints != NULL) ? 0 :
+                                 state_budget - states;
+            ok = engine->from_memory(motherboard, cpu, NULL, interpreter_budget, &num_states, &num_instructions);
+            if (flip_interrupts_on) {
+                cpu->interrupts_enabled = true;
+                cpu->enable_interrupts_after_next_instruction = false;
+            }
+        }
+        states += num_states;
+        cpu->instructions_executed += num_instructions;
+
+        if (!ok) {
+            *stop_reason = STOP_ERROR;
+            break;
+        }
+        if (cpu->breakpoints != NULL && (cpu->breakpoints[cpu->pc >> 3] & (1 << (cpu->pc & 0x7)))) {
+            *stop_reason = STOP_BREAKPOINT;
+            break;
+        }
+    }
+    return states;
+}
+
+/* Runs the CPU for the state_budget states left until the next interrupt.  A halted CPU does nothing until the interrupt
+   arrives, so if it halts the rest of the budget passes at once.  Returns the states that passed, which are fewer than
+   state_budget only if the CPU stopped with an error or at a breakpoint. */
+uint64_t run_cpu8080_until_interrupt(motherboard8080 *motherboard, cpu8080 *cpu, uint64_t state_budget,
+                                     cpu8080_stop_reason *stop_reason) {
+    uint64_t states = run_cpu8080(motherboard, cpu, state_budget, stop_reason);
+    if (*stop_reason == STOP_HALTED) {
+        states = state_budget;
+    }
+    return states;
+}
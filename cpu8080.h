@@ -5,7 +5,32 @@
 #include <stdbool.h>
 #include "motherboard.h"
 
+/* Labels-as-values (&&label, goto *ptr) is a GCC extension that clang also supports.  Without it, the threaded dispatch 
+   engine is not compiled in and DISPATCH_THREADED falls back to the switch. */
+#if defined(__GNUC__)
+#define CPU8080_HAS_THREADED_DISPATCH
+#endif
 
+/* How the interpreter gets from an opcode to the code that implements it.  DISPATCH_SWITCH is the plain 256-way switch.
+   DISPATCH_THREADED ends each handler with its own jump, through a table of label addresses, to the next instruction's
+   handler, which skips the switch's range check and gives the branch predictor one jump per opcode to learn from. */
+typedef enum {
+    DISPATCH_SWITCH,
+    DISPATCH_THREADED
+} cpu8080_dispatch;
+
+// Build with -DCPU8080_DEFAULT_DISPATCH=DISPATCH_THREADED to make the threaded engine the default.
+#ifndef CPU8080_DEFAULT_DISPATCH
+#define CPU8080_DEFAULT_DISPATCH DISPATCH_SWITCH
+#endif
+
+/* A 16-bit register pair with views of its high and low bytes.  The pair is kept in host byte order, so the order of the
+   byte views depends on the host.  Against separate bytes, this is only a few percent faster in the interpreter. */
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define CPU8080_REGISTER_PAIR(high, low, pair) union { uint16_t pair; struct { uint8_t high; uint8_t low; }; }
+#else
+#define CPU8080_REGISTER_PAIR(high, low, pair) union { uint16_t pair; struct { uint8_t low; uint8_t high; }; }
+#endif
 
 typedef struct {
     uint16_t pc;  // program counter
@@ -15,13 +40,13 @@ typedef struct {
        updated on increment/decrement to SP. */
     uint16_t stack_pointer_start; 
 
-    uint8_t a;  // accumulator
-    uint8_t b;  // b, c, d, e, h, l are registers
-    uint8_t c; 
-    uint8_t d;
-    uint8_t e;
-    uint8_t h; 
-    uint8_t l;
+    /* The registers are stored in their pairs, so instructions that work on a whole pair (LDAX, INX, DAD, MOV M and the
+       like) use bc, de and hl directly and the single-register instructions use the byte views.  a is the accumulator.  f
+       is only a staging area for PUSH PSW and POP PSW; the flags themselves are the bools below. */
+    CPU8080_REGISTER_PAIR(a, f, psw);
+    CPU8080_REGISTER_PAIR(b, c, bc);
+    CPU8080_REGISTER_PAIR(d, e, de);
+    CPU8080_REGISTER_PAIR(h, l, hl);
 
     /* Interrupts can be disabled via the DI opcode, but the interrupt bit is also cleared whenever an interrupt is triggered.  So
        interupt handlers have to re-enable interrupts via the EI opcode.  EI enables interrupts after the instruction following the 
@@ -32,17 +57,61 @@ typedef struct {
     // If the CPU is halted, it will only handle interrupts
     bool halted;
 
-    // Flags are single-bit flip-flops in the 8080, not a register.
+    /* Flags are single-bit flip-flops in the 8080, not a register.  Zero, sign, parity and aux carry are evaluated lazily
+       (see flags_pending below), so they may be stale; call materialize_flags() before reading them directly. */
     bool zero_flag;  // false for not zero, true for zero.
     bool carry_flag; // false for no carry, true for carry.
     bool sign_flag;  // false for plus/positive, true for minus/negative
     bool parity_flag;// Note in i8080 the parity is based on number of bits set.  Odd number of bits = false, even number of bits = true
     bool auxiliary_carry_flag;
+
+    /* Most instructions that set zero/sign/parity/aux carry have their result overwritten by the next one before any
+       instruction looks at the flags.  So arithmetic and logical instructions only record the result byte (flags_result)
+       and a byte whose bit 4 is the aux carry (flags_aux), and set flags_pending.  The flags are computed from these when a
+       conditional instruction, PUSH PSW or the debugger needs them.  Carry is always kept up to date: it's cheap, and ADC,
+       SBB, RAL, RAR and DAA read it all the time. */
+    bool flags_pending;
+    uint8_t flags_result;
+    uint8_t flags_aux;
+
+    /* Which dispatch engine the interpreter uses.  Both produce identical results; this can be changed whenever the CPU is
+       not running. */
+    cpu8080_dispatch dispatch;
+
+    /* Decoded basic blocks used by run_cpu8080(), or NULL to always decode from memory.  The CPU invalidates blocks
+       when it writes to their code; anything else that changes memory holding code must call block_cache_invalidate_all(). */
+    struct block_cache8080 *block_cache;
+
+    // Translates hot blocks to native code, or NULL to only interpret.  Needs block_cache; see jit8080.h.
+    struct jit8080 *jit;
+
+    // One bit per address; run_cpu8080() stops when pc reaches an address whose bit is set.  NULL for no breakpoints.
+    uint8_t *breakpoints;
+
+    // Counts the instructions executed by cycle_cpu8080() and run_cpu8080().
+    uint64_t instructions_executed;
 } cpu8080;
 
+// Why run_cpu8080() returned.
+typedef enum {
+    STOP_BUDGET_USED,
+    STOP_HALTED,
+    STOP_ERROR,
+    STOP_BREAKPOINT
+} cpu8080_stop_reason;
+
 void init_cpu8080(cpu8080 *cpu);
 void init_test_cpu8080(cpu8080 *cpu);
 bool cycle_cpu8080(motherboard8080 *motherboard, cpu8080 *cpu, uint64_t *num_states);
+uint64_t run_cpu8080(motherboard8080 *motherboard, cpu8080 *cpu, uint64_t state_budget, cpu8080_stop_reason *stop_reason);
+uint64_t run_cpu8080_until_interrupt(motherboard8080 *motherboard, cpu8080 *cpu, uint64_t state_budget,
+                                     cpu8080_stop_reason *stop_reason);
+void set_zero_sign_parity_from_byte(cpu8080 *cpu, uint8_t byte);
+uint8_t get_byte_from_flags(cpu8080 *const cpu);
+void set_flags_from_byte(cpu8080 *cpu, uint8_t byte);
+void materialize_flags(cpu8080 *cpu);
 void do_interrupt(motherboard8080 *motherboard, cpu8080 *cpu, uint8_t interrupt, uint16_t *pc_increments);
 
+extern const int64_t states_per_opcode[256];
+
 #endif
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <limits.h>
 #include "debugger.h"
 #include "disassembler.h"
+#include "blockcache.h"
 
 #define RUN_FOREVER -1
 
@@ -31,6 +32,7 @@ void display_help() {
 }
 
 void debug_dump_8080(cpu8080 cpu) {
+    materialize_flags(&cpu);
     printf("PC: 0x%04X\n", cpu.pc);
     printf("A: 0x%02X\n", cpu.a);
     printf("Flags: ");
@@ -137,8 +139,10 @@ bool parse_long(const char *str, long *val) {
 }
 
 // Returns true if execution should continue; false if execution should stop.
-bool debug_8080(motherboard8080 *motherboard, cpu8080 *cpu, uint64_t *total_states, uint64_t *total_instructions) {
+bool debug_8080(motherboard8080 *motherboard, cpu8080 *cpu, uint64_t *total_states) {
     int breakpoint_list[16] = {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1};
+    uint8_t breakpoint_map[0x10000 / 8];  // the breakpoint list in the form run_cpu8080() wants
+    cpu8080_stop_reason stop_reason;
     const int breakpoint_list_size = 16;
     char cmd_buffer[32], parsed_command0[32], parsed_command1[32], parsed_command2[32];
     bool running = true, retval = true;
@@ -154,7 +158,7 @@ bool debug_8080(motherboard8080 *motherboard, cpu8080 *cpu, uint64_t *total_stat
         printf("\n");
         debug_dump_8080(*cpu);
         printf("\n");
-        printf("Instructions: %ld\tStates: %ld\n\n", *total_instructions, *total_states);
+        printf("Instructions: %ld\tStates: %ld\n\n", cpu->instructions_executed, *total_states);
         printf("Current +/- 10 bytes of instructions:\n");
         start = (cpu->pc >= 0xA) ? (cpu->pc) - 10 : 0;
         end = (cpu->pc <= 0xFFF6) ? (cpu->pc) + 10 : 0xFFFF;
@@ -259,11 +263,22 @@ bool debug_8080(motherboard8080 *motherboard, cpu8080 *cpu, uint64_t *total_stat
                     instr_to_run = 1;
                 }
                 keep_running = true;
-                for (i = 0; ((instr_to_run == RUN_FOREVER || i < instr_to_run) && keep_running); i++) {
+                if (instr_to_run == RUN_FOREVER) {
+                    // runs until a breakpoint, a HLT or an error
+                    memset(breakpoint_map, 0, sizeof(breakpoint_map));
+                    for (i = 0; i < breakpoint_list_size; i++) {
+                        if (breakpoint_list[i] != -1) {
+                            breakpoint_map[breakpoint_list[i] >> 3] |= (1 << (breakpoint_list[i] & 0x7));
+                        }
+                    }
+                    cpu->breakpoints = breakpoint_map;
+                    (*total_states) = (*total_states) + run_cpu8080(motherboard, cpu, UINT64_MAX, &stop_reason);
+                    cpu->breakpoints = NULL;
+                }
+                for (i = 0; (instr_to_run != RUN_FOREVER && i < instr_to_run && keep_running); i++) {
                     keep_running = cycle_cpu8080(motherboard, cpu, &num_states);
                     if (keep_running) {
                         (*total_states) = (*total_states) + num_states;
-                        (*total_instructions) ++;
                         if (is_breakpoint(breakpoint_list, cpu->pc, breakpoint_list_size)) {
                             keep_running = false;
                         }
@@ -305,7 +320,10 @@ bool debug_8080(motherboard8080 *motherboard, cpu8080 *cpu, uint64_t *total_stat
                             printf("Invalid command %s\nsecond argument to set must be a valid 8-bit value.\n", cmd_buffer);
                         }
                         else {
-                            motherboard->memory[hex1] = (uint8_t)hex2;
+                            poke_memory(motherboard->memory_map, (uint16_t)hex1, (uint8_t)hex2);
+                            if (cpu->block_cache != NULL) {
+                                block_cache_note_write(cpu->block_cache, (uint16_t)hex1);
+                            }
                         }
                     }
                 }
@@ -0,0 +1,1276 @@
+/*
+The interpreter loop behind run_cpu8080() and cycle_cpu8080().  There is no include guard: cpu8080.c includes this once
+for each dispatch engine and source of instructions, with EXECUTE_FUNCTION set to the name to compile it under.
+
+Without EXECUTE_THREADED, each handler is a case of one 256-way switch and breaks out to the code after it, which
+finishes the instruction and goes back to the top of the switch for the next one, so every instruction goes through the
+same indirect jump.  With EXECUTE_THREADED, each handler is a label, and DISPATCH() ends it with its own copy of that
+code and its own jump through dispatch_table to the next handler.  Each of those jumps is predicted on its own, from the
+instructions that tend to follow that one.
+
+With EXECUTE_FROM_BLOCK, instructions come from a cached block; otherwise they are read from memory.  Compiling the two
+separately keeps the code at the end of each handler down to what one of them needs.
+*/
+/* Starts the handler for an opcode.  Its states and length are constants there, or were decoded with the block, and
+   jumps and calls override them, as do conditional calls and returns that are taken. */
+#ifdef EXECUTE_THREADED
+#define OPCODE(op) op_##op: START_INSTRUCTION(op);
+#define INVALID_OPCODE op_invalid:
+#define DISPATCH() FINISH_INSTRUCTION(); if (!MORE_INSTRUCTIONS()) { goto STOP_LABEL; } FETCH_INSTRUCTION(); \
+                   goto *dispatch_table[opcode]
+#else
+#define OPCODE(op) case op: START_INSTRUCTION(op);
+#define INVALID_OPCODE default:
+#define DISPATCH() break
+#endif
+
+#define FINISH_INSTRUCTION() \
+    cpu->pc = cpu->pc + pc_increments; \
+    executed_states = executed_states + states; \
+    executed_instructions++
+
+#ifdef EXECUTE_FROM_BLOCK
+// A superinstruction goes to run_fusion instead, unless it might run past the budget.
+#define FETCH_INSTRUCTION() \
+    if (decoded->fusion != FUSION_NONE && \
+            executed_states + fusion_states_before_last[decoded->fusion] < state_budget) { \
+        goto run_fusion; \
+    } \
+    instr = decoded->bytes; \
+    opcode = instr[0]
+
+#define START_INSTRUCTION(op) states = decoded->states; pc_increments = decoded->length
+#define OPERAND16 (decoded->operand)
+
+/* A write to the block's own code invalidates it, and the rest of the block may no longer match memory.  The next
+   lookup decodes it again.  At the end of the block, end_of_block goes on to the next one. */
+#define MORE_INSTRUCTIONS() (++decoded < block_end && block->valid && executed_states < state_budget)
+#define STOP_LABEL end_of_block
+#else
+#define FETCH_INSTRUCTION() \
+    instr = &(motherboard->memory[cpu->pc]); \
+    opcode = instr[0]
+
+#define START_INSTRUCTION(op) states = states_per_opcode[op]; pc_increments = 1
+#define OPERAND16 TWO_INSTR_TO_INT16
+
+// HLT and EI set state_budget to 0, since a halted CPU has to wait and the instruction after an EI runs on its own.
+#define MORE_INSTRUCTIONS() (executed_states < state_budget)
+#define STOP_LABEL done
+#endif
+
+static bool EXECUTE_FUNCTION(motherboard8080 *motherboard, cpu8080 *cpu, const cached_block *block,
+                             uint64_t state_budget, uint64_t *num_states, uint64_t *num_instructions) {
+    uint8_t opcode;
+    const uint8_t *instr;  // the opcode and its operands
+#ifdef EXECUTE_FROM_BLOCK
+    const decoded_instruction *decoded = block->instructions;
+    const decoded_instruction *block_end = block->instructions + block->num_instructions;
+#endif
+    int64_t states;
+    uint16_t pc_increments;  // how far to move pc at the end of the instruction; jumps, calls and returns override this.
+    uint16_t tmp_rp; // used in XCHG, XTHL, SHLD and LHLD, and for the DAA table entry
+    uint32_t tmp_32; // used in opcodes like DAD where we operate on two 16-bit numbers and need to see if there is a carry.
+    bool tmp_bool; // used in RAL/RAR
+    /* Counted here and added to num_states and num_instructions on the way out, since a memory write could be to
+       anything a pointer points to, as far as the compiler knows, and these would go to memory every instruction. */
+    uint64_t executed_states = 0, executed_instructions = 0;
+    bool ok = true;
+#ifdef EXECUTE_THREADED
+    // Handler for each opcode, in opcode order.  The 12 invalid opcodes all go to op_invalid.
+    static void *const dispatch_table[256] = {
+        &&op_0x00, &&op_0x01, &&op_0x02, &&op_0x03, &&op_0x04, &&op_0x05, &&op_0x06, &&op_0x07,
+        &&op_invalid, &&op_0x09, &&op_0x0A, &&op_0x0B, &&op_0x0C, &&op_0x0D, &&op_0x0E, &&op_0x0F,
+        &&op_invalid, &&op_0x11, &&op_0x12, &&op_0x13, &&op_0x14, &&op_0x15, &&op_0x16, &&op_0x17,
+        &&op_invalid, &&op_0x19, &&op_0x1A, &&op_0x1B, &&op_0x1C, &&op_0x1D, &&op_0x1E, &&op_0x1F,
+        &&op_invalid, &&op_0x21, &&op_0x22, &&op_0x23, &&op_0x24, &&op_0x25, &&op_0x26, &&op_0x27,
+        &&op_invalid, &&op_0x29, &&op_0x2A, &&op_0x2B, &&op_0x2C, &&op_0x2D, &&op_0x2E, &&op_0x2F,
+        &&op_invalid, &&op_0x31, &&op_0x32, &&op_0x33, &&op_0x34, &&op_0x35, &&op_0x36, &&op_0x37,
+        &&op_invalid, &&op_0x39, &&op_0x3A, &&op_0x3B, &&op_0x3C, &&op_0x3D, &&op_0x3E, &&op_0x3F,
+        &&op_0x40, &&op_0x41, &&op_0x42, &&op_0x43, &&op_0x44, &&op_0x45, &&op_0x46, &&op_0x47,
+        &&op_0x48, &&op_0x49, &&op_0x4A, &&op_0x4B, &&op_0x4C, &&op_0x4D, &&op_0x4E, &&op_0x4F,
+        &&op_0x50, &&op_0x51, &&op_0x52, &&op_0x53, &&op_0x54, &&op_0x55, &&op_0x56, &&op_0x57,
+        &&op_0x58, &&op_0x59, &&op_0x5A, &&op_0x5B, &&op_0x5C, &&op_0x5D, &&op_0x5E, &&op_0x5F,
+        &&op_0x60, &&op_0x61, &&op_0x62, &&op_0x63, &&op_0x64, &&op_0x65, &&op_0x66, &&op_0x67,
+        &&op_0x68, &&op_0x69, &&op_0x6A, &&op_0x6B, &&op_0x6C, &&op_0x6D, &&op_0x6E, &&op_0x6F,
+        &&op_0x70, &&op_0x71, &&op_0x72, &&op_0x73, &&op_0x74, &&op_0x75, &&op_0x76, &&op_0x77,
+        &&op_0x78, &&op_0x79, &&op_0x7A, &&op_0x7B, &&op_0x7C, &&op_0x7D, &&op_0x7E, &&op_0x7F,
+        &&op_0x80, &&op_0x81, &&op_0x82, &&op_0x83, &&op_0x84, &&op_0x85, &&op_0x86, &&op_0x87,
+        &&op_0x88, &&op_0x89, &&op_0x8A, &&op_0x8B, &&op_0x8C, &&op_0x8D, &&op_0x8E, &&op_0x8F,
+        &&op_0x90, &&op_0x91, &&op_0x92, &&op_0x93, &&op_0x94, &&op_0x95, &&op_0x96, &&op_0x97,
+        &&op_0x98, &&op_0x99, &&op_0x9A, &&op_0x9B, &&op_0x9C, &&op_0x9D, &&op_0x9E, &&op_0x9F,
+        &&op_0xA0, &&op_0xA1, &&op_0xA2, &&op_0xA3, &&op_0xA4, &&op_0xA5, &&op_0xA6, &&op_0xA7,
+        &&op_0xA8, &&op_0xA9, &&op_0xAA, &&op_0xAB, &&op_0xAC, &&op_0xAD, &&op_0xAE, &&op_0xAF,
+        &&op_0xB0, &&op_0xB1, &&op_0xB2, &&op_0xB3, &&op_0xB4, &&op_0xB5, &&op_0xB6, &&op_0xB7,
+        &&op_0xB8, &&op_0xB9, &&op_0xBA, &&op_0xBB, &&op_0xBC, &&op_0xBD, &&op_0xBE, &&op_0xBF,
+        &&op_0xC0, &&op_0xC1, &&op_0xC2, &&op_0xC3, &&op_0xC4, &&op_0xC5, &&op_0xC6, &&op_0xC7,
+        &&op_0xC8, &&op_0xC9, &&op_0xCA, &&op_invalid, &&op_0xCC, &&op_0xCD, &&op_0xCE, &&op_0xCF,
+        &&op_0xD0, &&op_0xD1, &&op_0xD2, &&op_0xD3, &&op_0xD4, &&op_0xD5, &&op_0xD6, &&op_0xD7,
+        &&op_0xD8, &&op_invalid, &&op_0xDA, &&op_0xDB, &&op_0xDC, &&op_invalid, &&op_0xDE, &&op_0xDF,
+        &&op_0xE0, &&op_0xE1, &&op_0xE2, &&op_0xE3, &&op_0xE4, &&op_0xE5, &&op_0xE6, &&op_0xE7,
+        &&op_0xE8, &&op_0xE9, &&op_0xEA, &&op_0xEB, &&op_0xEC, &&op_invalid, &&op_0xEE, &&op_0xEF,
+        &&op_0xF0, &&op_0xF1, &&op_0xF2, &&op_0xF3, &&op_0xF4, &&op_0xF5, &&op_0xF6, &&op_0xF7,
+        &&op_0xF8, &&op_0xF9, &&op_0xFA, &&op_0xFB, &&op_0xFC, &&op_invalid, &&op_0xFE, &&op_0xFF
+    };
+#endif
+
+#if !defined(EXECUTE_THREADED) || defined(EXECUTE_FROM_BLOCK)
+next_instruction:
+#endif
+    FETCH_INSTRUCTION();
+#ifdef EXECUTE_THREADED
+    goto *dispatch_table[opcode];
+#else
+    switch(opcode) {
+#endif
+        OPCODE(0x00)
+            // NOP
+            // do nothing
+            DISPATCH();
+        OPCODE(0x01)
+            // LXI BC, data 16
+            cpu->bc = OPERAND16;
+            pc_increments = 3;
+            DISPATCH();
+        OPCODE(0x02)
+            // STAX (BC)
+            write_byte(motherboard, cpu, cpu->bc, cpu->a);
+            DISPATCH();
+        OPCODE(0x03)  // INX
+            // INC BC (INX rp)
+            cpu->bc++;
+            DISPATCH();
+        OPCODE(0x04)
+            // INC B (INR r)
+            cpu->b = do_increment(cpu, cpu->b);
+            DISPATCH();
+        OPCODE(0x05)
+            // DEC B (DCR r)
+            cpu->b = do_decrement(cpu, cpu->b);
+            DISPATCH();
+        OPCODE(0x06)
+            // MVI B, d8  (LD B, d8)
+            cpu->b = instr[1];
+            pc_increments = 2;
+            DISPATCH();
+        OPCODE(0x07)
+            // RLC (Rotate Left with Carry)
+            // The content of the accumulator is rotated left one position.  The low order bit and the CY flag are both set
+            // to the value shifted out of the high order bit position.
+            cpu->carry_flag = (bool)(cpu->a & 0x80);
+            cpu->a = cpu->a << 1;
+            if (cpu->carry_flag) {
+                cpu->a = cpu->a | 0x01;
+            }
+            DISPATCH();
+        OPCODE(0x09)
+            // ADD HL, BC (DAD rp)
+            // Only the carry flag is affected, and then if the 16-bit addition carries out.
+            tmp_32 = (uint32_t)cpu->hl + (uint32_t)cpu->bc;
+            cpu->carry_flag = (bool)(tmp_32 > 0xFFFF);
+            cpu->hl = (uint16_t)tmp_32;
+            DISPATCH();
+        OPCODE(0x0A)
+            // LDAX (BC)
+            cpu->a = read_byte(motherboard, cpu->bc);
+            DISPATCH();
+        OPCODE(0x0B)
+            // DEC BC (INX rp)
+            cpu->bc--;
+            DISPATCH();
+        OPCODE(0x0C)
+            // INC C (INR r)
+            cpu->c = do_increment(cpu, cpu->c);
+            DISPATCH();
+        OPCODE(0x0D)
+            // DEC C (DCR r)
+            cpu->c = do_decrement(cpu, cpu->c);
+            DISPATCH();
+        OPCODE(0x0E)
+            // MVI C, d8  (LD C, d8)
+            cpu->c = instr[1];
+            pc_increments = 2;
+            DISPATCH();
+        OPCODE(0x0F)
+            // RRCA (Rotate Right with Carry)
+            // The high order bit and the CY flag are both set to the value shifted out of the low order bit position. 
+            // Only the CY flag is affected.
+            cpu->carry_flag = (bool)(cpu->a & 0x01);
+            cpu->a = cpu->a >> 1;
+            if (cpu->carry_flag) {
+                cpu->a |= 0x80;
+            }
+            DISPATCH();
+        OPCODE(0x11)
+            // LXI DE, data 16
+            cpu->de = OPERAND16;
+            pc_increments = 3;
+            DISPATCH();
+        OPCODE(0x12)
+            // STAX (DE)
+            write_byte(motherboard, cpu, cpu->de, cpu->a);
+            DISPATCH();
+        OPCODE(0x13)
+            // INC DE (INX rp)
+            cpu->de++;
+            DISPATCH();
+        OPCODE(0x14)
+            // INC D (INR r)
+            cpu->d = do_increment(cpu, cpu->d);
+            DISPATCH();
+        OPCODE(0x15)
+            // DEC D (DCR r)
+            cpu->d = do_decrement(cpu, cpu->d);
+            DISPATCH();
+        OPCODE(0x16)
+            // MVI D, d8  (LD D, d8)
+            cpu->d = instr[1];
+            pc_increments = 2;
+            DISPATCH();
+        OPCODE(0x17)  // RAL
+            // RAL (Rotate Accumulator Left through carry)
+            // The content of the accumulator is rotated left one position.  The low order bit is set
+            // equal to the CY flag and the CY flag is set to the value shifted out of the high order 
+            // bit position.
+            tmp_bool = cpu->carry_flag;
+            cpu->carry_flag = (bool)(cpu->a & 0x80);
+            cpu->a = cpu->a << 1;
+            if(tmp_bool) {
+                cpu->a = cpu->a | 0x01;
+            }
+            DISPATCH();
+        OPCODE(0x19)
+            // ADD HL, DE (DAD rp)
+            // Only the carry flag is affected, and then if the 16-bit addition carries out.
+            tmp_32 = (uint32_t)cpu->hl + (uint32_t)cpu->de;
+            cpu->carry_flag = (bool)(tmp_32 > 0xFFFF);
+            cpu->hl = (uint16_t)tmp_32;
+            DISPATCH();
+        OPCODE(0x1A)
+            // LDAX DE
+            cpu->a = read_byte(motherboard, cpu->de);
+            DISPATCH();
+        OPCODE(0x1B)
+            // DEC DE (INX rp)
+            cpu->de--;
+            DISPATCH();
+        OPCODE(0x1C)
+            // INC E (INR r)
+            cpu->e = do_increment(cpu, cpu->e);
+            DISPATCH();
+        OPCODE(0x1D)
+            // DEC E (DCR r)
+            cpu->e = do_decrement(cpu, cpu->e);
+            DISPATCH();
+        OPCODE(0x1E)
+            // MVI E, d8  (LD E, d8)
+            cpu->e = instr[1];
+            pc_increments = 2;
+            DISPATCH();
+        OPCODE(0x1F)
+            // RAR - Rotate right through carry
+            // The content of the accumulator is rotated right one position.  The high-order bit is set
+            // to the CY flag and the CY flag is set to the value shifted out of the low order bit position.
+            tmp_bool = cpu->carry_flag;
+            cpu->carry_flag = (bool)(cpu->a & 0x01);
+            cpu->a = cpu->a >> 1;
+            if (tmp_bool) {
+                cpu->a = cpu->a | 0x80;
+            }
+            DISPATCH();
+        OPCODE(0x21)
+            // LXI HL, data 16
+            cpu->hl = OPERAND16;
+            pc_increments = 3;
+            DISPATCH();
+        OPCODE(0x22)
+            // SHLD addr  (store H and L direct)
+            // The content of register L is moved to teh memory location whose address is specified in byte 2 and
+            // byte 3.  The content of register H is moved to the succeeding memory location.  Flags are not 
+            // affected.
+            // Read the address once: the first write may land on the operand bytes themselves.
+            tmp_rp = OPERAND16;
+            write_byte(motherboard, cpu, tmp_rp, cpu->l);
+            write_byte(motherboard, cpu, tmp_rp + 1, cpu->h);
+            pc_increments = 3;
+            DISPATCH();
+        OPCODE(0x23)
+            // INC HL (INX rp)
+            cpu->hl++;
+            DISPATCH();
+        OPCODE(0x24)
+            // INC H (INR r)
+            cpu->h = do_increment(cpu, cpu->h);
+            DISPATCH();
+        OPCODE(0x25)
+            // DEC H (DCR r)
+            cpu->h = do_decrement(cpu, cpu->h);
+            DISPATCH();
+        OPCODE(0x26)
+            // MVI H, d8  (LD H, d8)
+            cpu->h = instr[1];
+            pc_increments = 2;
+            DISPATCH();
+        OPCODE(0x27)
+            // DAA (Decimal adjust accumulator)
+            /* The eight-bit number in the accumulator is adjusted to form two four-bit Binary-Coded-Decimal digits
+               by the following process:
+               1. If the value of the least significant 4 bits of the accumulator is greater than 9 or if the AC flag
+               is set, 6 is added to the accumulator.
+               2. If the value of the most significant 4 bits of the accumulator is now greater than 9, or if the CY
+               flag is set, 6 is added to the most significant 4 bits of the accumulator.
+               NOTE: All flags are affected */
+        
+            // daa_table follows the MAME logic; see init_alu8080().
+            tmp_rp = daa_table[(get_aux_carry_flag(cpu) << 1) | cpu->carry_flag][cpu->a];
+            cpu->carry_flag = (bool)(tmp_rp & (FLAG_CARRY << 8));
+            cpu->a = (uint8_t)(tmp_rp & 0xFF);
+            record_flags(cpu, cpu->a, (uint8_t)(tmp_rp >> 8));
+            DISPATCH();
+        OPCODE(0x29)  // DAD
+            // ADD HL, HL (DAD rp)
+            // Only the carry flag is affected, and then if the 16-bit addition carries out.
+            // TODO: This could be made faster by converting this to a shift left by 1 (because HL + HL == 2 * HL == HL << 1)
+            tmp_32 = (uint32_t)cpu->hl + (uint32_t)cpu->hl;
+            cpu->carry_flag = (bool)(tmp_32 > 0xFFFF);
+            cpu->hl = (uint16_t)tmp_32;
+            DISPATCH();
+        OPCODE(0x2A)
+            // LHLD addr (load H and L direct)
+            // The content of the memory location is specified in byte 2 and byte 3 of the instruction, is moved to
+            // register L.  The content of the memory location at the succeeding address is moved to register H.
+            // flags are not affected.
+            tmp_rp = OPERAND16;
+            cpu->hl = read_word(motherboard, tmp_rp);
+            pc_increments = 3;
+            DISPATCH();
+        OPCODE(0x2B)
+            // DEC HL (INX rp)
+            cpu->hl--;
+            DISPATCH();
+        OPCODE(0x2C)
+            // INC L (INR r)
+            cpu->l = do_increment(cpu, cpu->l);
+            DISPATCH();
+        OPCODE(0x2D)
+            // DEC L (DCR r)
+            cpu->l = do_decrement(cpu, cpu->l);
+            DISPATCH();
+        OPCODE(0x2E)
+            // MVI L, d8  (LD L, d8)
+            cpu->l = instr[1];
+            pc_increments = 2;
+            DISPATCH();
+        OPCODE(0x2F)
+            // CMA (complement accumulator)
+            cpu->a = ~(cpu->a);
+            DISPATCH();
+        OPCODE(0x31)
+            // LXI SP, data 16
+            cpu->sp = OPERAND16;
+            cpu->stack_pointer_start = cpu->sp;
+            pc_increments = 3;
+            DISPATCH();
+        OPCODE(0x32)
+            // STA data 16 (store accumulator direct)
+            write_byte(motherboard, cpu, OPERAND16, cpu->a);
+            pc_increments = 3;
+            DISPATCH();
+        OPCODE(0x33)
+            // INC SP (INX rp)
+            cpu->sp ++;
+            DISPATCH();
+        OPCODE(0x34)
+            // INC (HL)  (INR M)
+            write_byte(motherboard, cpu, cpu->hl, do_increment(cpu, read_byte(motherboard, cpu->hl)));
+            DISPATCH();
+        OPCODE(0x35)
+            // DEC (HL)  (DCR M)
+            write_byte(motherboard, cpu, cpu->hl, do_decrement(cpu, read_byte(motherboard, cpu->hl)));
+            DISPATCH();
+        OPCODE(0x36)
+            // MVI M, data (a.k.a. LD (HL), data)
+            write_byte(motherboard, cpu, cpu->hl, instr[1]);
+            pc_increments = 2;
+            DISPATCH();
+        OPCODE(0x37)
+            // STC (set carry)
+            cpu->carry_flag = true;
+            DISPATCH();
+        OPCODE(0x39)
+            // ADD HL, SP (DAD rp)
+            // Only the carry flag is affected, and then if the 16-bit addition carries out.
+            tmp_32 = (uint32_t)cpu->hl + (uint32_t)cpu->sp;
+            cpu->carry_flag = (bool)(tmp_32 > 0xFFFF);
+            cpu->hl = (uint16_t)tmp_32;
+            DISPATCH();
+        OPCODE(0x3A)
+            // LDA data 16 (load accumulator direct)
+            cpu->a = read_byte(motherboard, OPERAND16);
+            pc_increments = 3;
+            DISPATCH();
+        OPCODE(0x3B)
+            // DEC SP (DCX rp)
+            cpu->sp --;
+            DISPATCH();
+        OPCODE(0x3C)
+            // INC A (INR r)
+            cpu->a = do_increment(cpu, cpu->a);
+            DISPATCH();
+        OPCODE(0x3D)
+            // DEC A (DCR r)
+            cpu->a = do_decrement(cpu, cpu->a);
+            DISPATCH();
+        OPCODE(0x3E)
+            // MVI A, d8  (LD A, d8)
+            cpu->a = instr[1];
+            pc_increments = 2;
+            DISPATCH();
+        OPCODE(0x3F)
+            // CMC (complement carry flag)
+            cpu->carry_flag = !(cpu->carry_flag);
+            DISPATCH();
+        OPCODE(0x40)
+            // LD B, B (MOV r1, r2)
+            cpu->b = cpu->b;
+            DISPATCH();
+        OPCODE(0x41)
+            // LD B, C (MOV r1, r2)
+            cpu->b = cpu->c;
+            DISPATCH();
+        OPCODE(0x42)
+            // LD B, D (MOV r1, r2)
+            cpu->b = cpu->d;
+            DISPATCH();
+        OPCODE(0x43)
+            // LD B, E (MOV r1, r2)
+            cpu->b = cpu->e;
+            DISPATCH();
+        OPCODE(0x44)
+            // LD B, H (MOV r1, r2)
+            cpu->b = cpu->h;
+            DISPATCH();
+        OPCODE(0x45)
+            // LD B, L (MOV r1, r2)
+            cpu->b = cpu->l;
+            DISPATCH();
+        OPCODE(0x46)
+            // LD B, (HL) (MOV r, M)
+            cpu->b = read_byte(motherboard, cpu->hl);
+            DISPATCH();
+        OPCODE(0x47)
+            // LD B, A (MOV r1, r2)
+            cpu->b = cpu->a;
+            DISPATCH();
+        OPCODE(0x48)
+            // LD C, B (MOV r1, r2)
+            cpu->c= cpu->b;
+            DISPATCH();
+        OPCODE(0x49)
+            // LD C, C (MOV r1, r2)
+            cpu->c= cpu->c;
+            DISPATCH();
+        OPCODE(0x4A)
+            // LD C, D (MOV r1, r2)
+            cpu->c= cpu->d;
+            DISPATCH();
+        OPCODE(0x4B)
+            // LD C, E (MOV r1, r2)
+            cpu->c= cpu->e;
+            DISPATCH();
+        OPCODE(0x4C)
+            // LD C, H (MOV r1, r2)
+            cpu->c= cpu->h;
+            DISPATCH();
+        OPCODE(0x4D)
+            // LD C, L (MOV r1, r2)
+            cpu->c= cpu->l;
+            DISPATCH();
+        OPCODE(0x4E)
+            // LD C, (HL) (MOV r, M)
+            cpu->c= read_byte(motherboard, cpu->hl);
+            DISPATCH();
+        OPCODE(0x4F)
+            // LD C, A (MOV r1, r2)
+            cpu->c= cpu->a;
+            DISPATCH();
+        OPCODE(0x50)
+            // LD D, B (MOV r1, r2)
+            cpu->d= cpu->b;
+            DISPATCH();
+        OPCODE(0x51)
+            // LD D, C (MOV r1, r2)
+            cpu->d= cpu->c;
+            DISPATCH();
+        OPCODE(0x52)
+            // LD D, D (MOV r1, r2)
+            cpu->d= cpu->d;
+            DISPATCH();
+        OPCODE(0x53)
+            // LD D, E (MOV r1, r2)
+            cpu->d= cpu->e;
+            DISPATCH();
+        OPCODE(0x54)
+            // LD D, H (MOV r1, r2)
+            cpu->d= cpu->h;
+            DISPATCH();
+        OPCODE(0x55)
+            // LD D, L (MOV r1, r2)
+            cpu->d= cpu->l;
+            DISPATCH();
+        OPCODE(0x56)
+            // LD D, (HL) (MOV r, M)
+            cpu->d= read_byte(motherboard, cpu->hl);
+            DISPATCH();
+        OPCODE(0x57)
+            // LD D, A (MOV r1, r2)
+            cpu->d= cpu->a;
+            DISPATCH();
+        OPCODE(0x58)
+            // LD E, B (MOV r1, r2)
+            cpu->e= cpu->b;
+            DISPATCH();
+        OPCODE(0x59)
+            // LD E, C (MOV r1, r2)
+            cpu->e= cpu->c;
+            DISPATCH();
+        OPCODE(0x5A)
+            // LD E, D (MOV r1, r2)
+            cpu->e= cpu->d;
+            DISPATCH();
+        OPCODE(0x5B)
+           // LD E, E (MOV r1, r2)
+            cpu->e= cpu->e;
+            DISPATCH();
+        OPCODE(0x5C)
+            // LD E, H (MOV r1, r2)
+            cpu->e= cpu->h;
+            DISPATCH();
+        OPCODE(0x5D)
+            // LD E, L (MOV r1, r2)
+            cpu->e= cpu->l;
+            DISPATCH();
+        OPCODE(0x5E)
+            // LD E, (HL) (MOV r, M)
+            cpu->e= read_byte(motherboard, cpu->hl);
+            DISPATCH();
+        OPCODE(0x5F)
+            // LD E, A (MOV r1, r2)
+            cpu->e= cpu->a;
+            DISPATCH();
+        OPCODE(0x60)
+            // LD H, B (MOV r1, r2)
+            cpu->h= cpu->b;
+            DISPATCH();
+        OPCODE(0x61)
+            // LD H, C (MOV r1, r2)
+            cpu->h= cpu->c;
+            DISPATCH();
+        OPCODE(0x62)
+            // LD H, D (MOV r1, r2)
+            cpu->h= cpu->d;
+            DISPATCH();
+        OPCODE(0x63)
+            // LD H, E (MOV r1, r2)
+            cpu->h= cpu->e;
+            DISPATCH();
+        OPCODE(0x64)
+            // LD H, H (MOV r1, r2)
+            cpu->h= cpu->h;
+            DISPATCH();
+        OPCODE(0x65)
+            // LD H, L (MOV r1, r2)
+            cpu->h= cpu->l;
+            DISPATCH();
+        OPCODE(0x66)
+            // LD H, (HL) (MOV r, M)
+            cpu->h= read_byte(motherboard, cpu->hl);
+            DISPATCH();
+        OPCODE(0x67)
+            // LD H, A (MOV r1, r2)
+            cpu->h= cpu->a;
+            DISPATCH();
+        OPCODE(0x68)
+            // LD L, B (MOV r1, r2)
+            cpu->l= cpu->b;
+            DISPATCH();
+        OPCODE(0x69)
+            // LD L, C (MOV r1, r2)
+            cpu->l= cpu->c;
+            DISPATCH();
+        OPCODE(0x6A)
+            // LD L, D (MOV r1, r2)
+            cpu->l= cpu->d;
+            DISPATCH();
+        OPCODE(0x6B)
+            // LD L, E (MOV r1, r2)
+            cpu->l= cpu->e;
+            DISPATCH();
+        OPCODE(0x6C)
+            // LD L, H (MOV r1, r2)
+            cpu->l= cpu->h;
+            DISPATCH();
+        OPCODE(0x6D)
+            // LD L, L (MOV r1, r2)
+            cpu->l= cpu->l;
+            DISPATCH();
+        OPCODE(0x6E)
+            // LD L, (HL) (MOV r, M)
+            cpu->l= read_byte(motherboard, cpu->hl);
+            DISPATCH();
+        OPCODE(0x6F)
+            // LD L, A (MOV r1, r2)
+            cpu->l= cpu->a;
+            DISPATCH();
+        OPCODE(0x70)
+            // LD (HL), B  (MOV M, r)
+            write_byte(motherboard, cpu, cpu->hl, cpu->b);
+            DISPATCH();
+        OPCODE(0x71)
+            // LD (HL), C  (MOV M, r)
+            write_byte(motherboard, cpu, cpu->hl, cpu->c);
+            DISPATCH();
+        OPCODE(0x72)
+            // LD (HL), D  (MOV M, r)
+            write_byte(motherboard, cpu, cpu->hl, cpu->d);
+            DISPATCH();
+        OPCODE(0x73)
+            // LD (HL), E  (MOV M, r)
+            write_byte(motherboard, cpu, cpu->hl, cpu->e);
+            DISPATCH();
+        OPCODE(0x74)
+            // LD (HL), H  (MOV M, r)
+            write_byte(motherboard, cpu, cpu->hl, cpu->h);
+            DISPATCH();
+        OPCODE(0x75)
+            // LD (HL), L  (MOV M, r)
+            write_byte(motherboard, cpu, cpu->hl, cpu->l);
+            DISPATCH();
+        OPCODE(0x76)
+            // HLT
+            cpu->halted = true;
+            state_budget = 0;
+            DISPATCH();
+        OPCODE(0x77)
+            // LD (HL), A  (MOV M, r)
+            write_byte(motherboard, cpu, cpu->hl, cpu->a);
+            DISPATCH();
+        OPCODE(0x78)
+            // LD A, B (MOV r1, r2)
+            cpu->a= cpu->b;
+            DISPATCH();
+        OPCODE(0x79)  // MOV
+            // LD A, C (MOV r1, r2)
+            cpu->a= cpu->c;
+            DISPATCH();
+        OPCODE(0x7A)  // MOV
+            // LD A, D (MOV r1, r2)
+            cpu->a= cpu->d;
+            DISPATCH();
+        OPCODE(0x7B)  // MOV
+            // LD A, E (MOV r1, r2)
+            cpu->a= cpu->e;
+            DISPATCH();
+        OPCODE(0x7C)  // MOV
+            // LD A, H (MOV r1, r2)
+            cpu->a= cpu->h;
+            DISPATCH();
+        OPCODE(0x7D)  // MOV
+            // LD A, L (MOV r1, r2)
+            cpu->a= cpu->l;
+            DISPATCH();
+        OPCODE(0x7E)  // MOV
+            // LD A, (HL) (MOV r, M)
+            cpu->a= read_byte(motherboard, cpu->hl);
+            DISPATCH();
+        OPCODE(0x7F)  // MOV
+            // LD A, A (MOV r1, r2)
+            cpu->a= cpu->a;
+            DISPATCH();
+        OPCODE(0x80)
+            // ADD A, B
+            do_addition(cpu, cpu->b, false);
+            DISPATCH();
+        OPCODE(0x81)
+            // ADD, C
+            do_addition(cpu, cpu->c, false);
+            DISPATCH();
+        OPCODE(0x82)
+            // ADD, D
+            do_addition(cpu, cpu->d, false);
+            DISPATCH();
+        OPCODE(0x83)
+            // ADD, E
+            do_addition(cpu, cpu->e, false);
+            DISPATCH();
+        OPCODE(0x84)
+            // ADD, C
+            do_addition(cpu, cpu->h, false);
+            DISPATCH();
+        OPCODE(0x85)
+            // ADD, C
+            do_addition(cpu, cpu->l, false);
+            DISPATCH();
+        OPCODE(0x86)
+            // ADD, (HL))
+            do_addition(cpu, read_byte(motherboard, cpu->hl), false);
+            DISPATCH();
+        OPCODE(0x87)
+            // ADD, A
+            do_addition(cpu, cpu->a, false);
+            DISPATCH();
+        OPCODE(0x88)
+            // ADC A, B
+            do_addition(cpu, cpu->b, cpu->carry_flag);
+            DISPATCH();
+        OPCODE(0x89)
+            // ADC A, C
+            do_addition(cpu, cpu->c, cpu->carry_flag);
+            DISPATCH();
+        OPCODE(0x8A)
+            // ADC A, D
+            do_addition(cpu, cpu->d, cpu->carry_flag);
+            DISPATCH();
+        OPCODE(0x8B)
+            // ADC A, E
+            do_addition(cpu, cpu->e, cpu->carry_flag);
+            DISPATCH();
+        OPCODE(0x8C)
+            // ADC A, H
+            do_addition(cpu, cpu->h, cpu->carry_flag);
+            DISPATCH();
+        OPCODE(0x8D)
+            // ADC A, L
+            do_addition(cpu, cpu->l, cpu->carry_flag);
+            DISPATCH();
+        OPCODE(0x8E)
+            // ADC, (HL))
+            do_addition(cpu, read_byte(motherboard, cpu->hl), cpu->carry_flag);
+            DISPATCH();
+        OPCODE(0x8F)
+            // ADC A, A
+            do_addition(cpu, cpu->a, cpu->carry_flag);
+            DISPATCH();
+        OPCODE(0x90)
+            //SUB A, B
+            do_subtraction(cpu, cpu->b, false, true);
+            DISPATCH();
+        OPCODE(0x91)
+            //SUB A, C
+            do_subtraction(cpu, cpu->c, false, true);
+            DISPATCH();
+        OPCODE(0x92)
+            //SUB A, D
+            do_subtraction(cpu, cpu->d, false, true);
+            DISPATCH();
+        OPCODE(0x93)
+            //SUB A, E
+            do_subtraction(cpu, cpu->e, false, true);
+            DISPATCH();
+        OPCODE(0x94)
+            //SUB A, H
+            do_subtraction(cpu, cpu->h, false, true);
+            DISPATCH();
+        OPCODE(0x95)
+            //SUB A, L
+            do_subtraction(cpu, cpu->l, false, true);
+            DISPATCH();
+        OPCODE(0x96)
+            //SUB A, (HL)
+            do_subtraction(cpu, read_byte(motherboard, cpu->hl), false, true);
+            DISPATCH();
+        OPCODE(0x97)
+            //SUB A, A
+            do_subtraction(cpu, cpu->a, false, true);
+            DISPATCH();
+        OPCODE(0x98)
+            // SBB A, B
+            do_subtraction(cpu, cpu->b, cpu->carry_flag, true);
+            DISPATCH();
+        OPCODE(0x99)
+            // SBB A, C
+            do_subtraction(cpu, cpu->c, cpu->carry_flag, true);
+            DISPATCH();
+        OPCODE(0x9A)
+            // SBB A, D
+            do_subtraction(cpu, cpu->d, cpu->carry_flag, true);
+            DISPATCH();
+        OPCODE(0x9B)
+            // SBB A, E
+            do_subtraction(cpu, cpu->e, cpu->carry_flag, true);
+            DISPATCH();
+        OPCODE(0x9C)
+            // SBB A, H
+            do_subtraction(cpu, cpu->h, cpu->carry_flag, true);
+            DISPATCH();
+        OPCODE(0x9D)
+            // SBB A, L
+            do_subtraction(cpu, cpu->l, cpu->carry_flag, true);
+            DISPATCH();
+        OPCODE(0x9E)
+            // SBB A, (HL)
+            do_subtraction(cpu, read_byte(motherboard, cpu->hl), cpu->carry_flag, true);
+            DISPATCH();
+        OPCODE(0x9F)
+            // SBB A, A
+            do_subtraction(cpu, cpu->a, cpu->carry_flag, true);
+            DISPATCH();
+        OPCODE(0xA0)
+            // AND B (ANA r)
+            do_and(cpu, cpu->b);
+            DISPATCH();
+        OPCODE(0xA1)
+            // AND C (ANA r)
+            do_and(cpu, cpu->c);
+            DISPATCH();
+        OPCODE(0xA2)
+            // AND D (ANA r)
+            do_and(cpu, cpu->d);
+            DISPATCH();
+        OPCODE(0xA3)
+            // AND E (ANA r)
+            do_and(cpu, cpu->e);
+            DISPATCH();
+        OPCODE(0xA4)
+            // AND H (ANA r)
+            do_and(cpu, cpu->h);
+            DISPATCH();
+        OPCODE(0xA5)
+            // AND L (ANA r)
+            do_and(cpu, cpu->l);
+            DISPATCH();
+        OPCODE(0xA6)
+            // AND (HL) (ANA M)
+            do_and(cpu, read_byte(motherboard, cpu->hl));
+            DISPATCH();
+        OPCODE(0xA7)
+            // AND A (ANA r)
+            do_and(cpu, cpu->a);
+            DISPATCH();
+        OPCODE(0xA8)
+            // XOR B (XRA r)
+            do_xor(cpu, cpu->b);
+            DISPATCH();
+        OPCODE(0xA9)
+            // XOR C (XRA r)
+            do_xor(cpu, cpu->c);
+            DISPATCH();
+        OPCODE(0xAA)
+            // XOR D (XRA r)
+            do_xor(cpu, cpu->d);
+            DISPATCH();
+        OPCODE(0xAB)
+            // XOR E (XRA r)
+            do_xor(cpu, cpu->e);
+            DISPATCH();
+        OPCODE(0xAC)
+            // XOR H (XRA r)
+            do_xor(cpu, cpu->h);
+            DISPATCH();
+        OPCODE(0xAD)
+            // XOR L (XRA r)
+            do_xor(cpu, cpu->l);
+            DISPATCH();
+        OPCODE(0xAE)
+            // XOR (HL) (XRA M)
+            do_xor(cpu, read_byte(motherboard, cpu->hl));
+            DISPATCH();
+        OPCODE(0xAF)
+            // XOR A (XRA r)
+            do_xor(cpu, cpu->a);
+            DISPATCH();
+        OPCODE(0xB0)
+            // OR B (ORA r)
+            do_or(cpu, cpu->b); 
+            DISPATCH();
+        OPCODE(0xB1)
+            // OR C (ORA r)
+            do_or(cpu, cpu->c); 
+            DISPATCH();
+        OPCODE(0xB2)
+            // OR D (ORA r)
+            do_or(cpu, cpu->d); 
+            DISPATCH();
+        OPCODE(0xB3)
+            // OR E (ORA r)
+            do_or(cpu, cpu->e); 
+            DISPATCH();
+        OPCODE(0xB4)
+            // OR H (ORA r)
+            do_or(cpu, cpu->h); 
+            DISPATCH();
+        OPCODE(0xB5)
+            // OR L (ORA r)
+            do_or(cpu, cpu->l); 
+            DISPATCH();
+        OPCODE(0xB6)
+            // OR (HL) (ORA M)
+            do_or(cpu, read_byte(motherboard, cpu->hl)); 
+            DISPATCH();
+        OPCODE(0xB7)
+            // OR A (ORA r)
+            do_or(cpu, cpu->a); 
+            DISPATCH();
+        OPCODE(0xB8)
+            // CMP B
+            do_subtraction(cpu, cpu->b, false, false);
+            DISPATCH();
+        OPCODE(0xB9)
+            // CMP C
+            do_subtraction(cpu, cpu->c, false, false);
+            DISPATCH();
+        OPCODE(0xBA)
+            // CMP D
+            do_subtraction(cpu, cpu->d, false, false);
+            DISPATCH();
+        OPCODE(0xBB)
+            // CMP E
+            do_subtraction(cpu, cpu->e, false, false);
+            DISPATCH();
+        OPCODE(0xBC)
+            // CMP H
+            do_subtraction(cpu, cpu->h, false, false);
+            DISPATCH();
+        OPCODE(0xBD)
+            // CMP L
+            do_subtraction(cpu, cpu->l, false, false);
+            DISPATCH();
+        OPCODE(0xBE)
+            // CMP M (CMP (HL))
+            do_subtraction(cpu, read_byte(motherboard, cpu->hl), false, false);
+            DISPATCH();
+        OPCODE(0xBF)
+            // CMP A
+            do_subtraction(cpu, cpu->a, false, false);
+            DISPATCH();
+        OPCODE(0xC0)
+            // RET NZ
+            do_conditional_return(motherboard, cpu, !get_zero_flag(cpu), &states, &pc_increments);
+            DISPATCH();
+        OPCODE(0xC1)  // POP
+            // POP BC
+            cpu->bc = read_word(motherboard, cpu->sp);
+            cpu->sp = cpu->sp + 2;
+            DISPATCH();
+        OPCODE(0xC2)
+            // JMP NZ
+            do_conditional_jump(cpu, !get_zero_flag(cpu), OPERAND16, &pc_increments);
+            DISPATCH();
+        OPCODE(0xC3)  // JMP
+            cpu->pc = OPERAND16;
+            pc_increments = 0;
+            DISPATCH();
+        OPCODE(0xC4)
+            // CALL NZ addr
+            do_conditional_call(motherboard, cpu, !get_zero_flag(cpu), OPERAND16, &states, &pc_increments);
+            DISPATCH();
+        OPCODE(0xC5)
+            // PUSH BC
+            write_byte(motherboard, cpu, cpu->sp - 1, cpu->b);
+            write_byte(motherboard, cpu, cpu->sp - 2, cpu->c);
+            cpu->sp = cpu->sp - 2;
+            DISPATCH();
+        OPCODE(0xC6)
+            // ADI d8
+            do_addition(cpu, instr[1], false);
+            pc_increments = 2;
+            DISPATCH();
+        OPCODE(0xC7)
+            // RST 0
+            do_interrupt(motherboard, cpu, 0, &pc_increments);
+            DISPATCH();
+        OPCODE(0xC8)
+            // RET Z
+            do_conditional_return(motherboard, cpu, get_zero_flag(cpu), &states, &pc_increments);
+            DISPATCH();
+        OPCODE(0xC9)
+            // RET
+            do_conditional_return(motherboard, cpu, true, &states, &pc_increments);
+            // conditional returns take 11 states if the condition is true.  This is an unconditional return
+            // which only takes 10.  I'll pull it from the table though, as the compiler should make this a static assignment anyway, 
+            // and this way if the table updates later for a different CPU I don't need to remember to change this code.
+            states = states_per_opcode[0xC9];
+            DISPATCH();
+        OPCODE(0xCA)
+            // JMP Z
+            do_conditional_jump(cpu, get_zero_flag(cpu), OPERAND16, &pc_increments);
+            DISPATCH();
+        OPCODE(0xCC)
+            // CALL Z addr
+            do_conditional_call(motherboard, cpu, get_zero_flag(cpu), OPERAND16, &states, &pc_increments);
+            DISPATCH();
+        OPCODE(0xCD)
+            // CALL addr
+            // this is an unconditional call, so pass in true for the flag
+            do_conditional_call(motherboard, cpu, true, OPERAND16, &states, &pc_increments);
+            DISPATCH();
+        OPCODE(0xCE)
+            // ACI data (add immediate with carry);
+            do_addition(cpu, instr[1], cpu->carry_flag);
+            pc_increments = 2;
+            DISPATCH();
+        OPCODE(0xCF)
+            // RST 1
+            do_interrupt(motherboard, cpu, 1, &pc_increments);
+            DISPATCH();
+        OPCODE(0xD0)
+            // RET NC
+            do_conditional_return(motherboard, cpu, !(cpu->carry_flag), &states, &pc_increments);
+            DISPATCH();
+        OPCODE(0xD1)
+            // POP DE
+            cpu->de = read_word(motherboard, cpu->sp);
+            cpu->sp = cpu->sp + 2;
+            DISPATCH();
+        OPCODE(0xD2)
+            // JMP NC
+            do_conditional_jump(cpu, !(cpu->carry_flag), OPERAND16, &pc_increments);
+            DISPATCH();
+        OPCODE(0xD3)
+            // OUT port, A
+            if (!motherboard->output_handler(motherboard, instr[1], cpu->a)) {
+                ok = false;
+                goto done;
+            }
+            // the port may switch memory banks, including the one this block is in
+            if (cpu->block_cache != NULL) {
+                block_cache_note_bank_switches(cpu->block_cache, motherboard->memory_map);
+            }
+            pc_increments = 2;
+            DISPATCH();
+        OPCODE(0xD4)
+            // CALL NC addr
+            do_conditional_call(motherboard, cpu, !(cpu->carry_flag), OPERAND16, &states, &pc_increments);
+            DISPATCH();
+        OPCODE(0xD5)
+            // PUSH DE
+            write_byte(motherboard, cpu, cpu->sp - 1, cpu->d);
+            write_byte(motherboard, cpu, cpu->sp - 2, cpu->e);
+            cpu->sp = cpu->sp - 2;
+            DISPATCH();
+        OPCODE(0xD6)
+            // SUI data
+            do_subtraction(cpu, instr[1], false, true);
+            pc_increments = 2;
+            DISPATCH();
+        OPCODE(0xD7)
+            // RST 2
+            do_interrupt(motherboard, cpu, 2, &pc_increments);
+            DISPATCH();
+        OPCODE(0xD8)
+            // RET C
+            do_conditional_return(motherboard, cpu, cpu->carry_flag, &states, &pc_increments);
+            DISPATCH();
+        OPCODE(0xDA)
+            // JMP C
+            do_conditional_jump(cpu, cpu->carry_flag, OPERAND16, &pc_increments);
+            DISPATCH();
+        OPCODE(0xDB)
+            // IN A port
+            if (!motherboard->input_handler(motherboard, instr[1], &(cpu->a))) {
+                ok = false;
+                goto done;
+            }
+            pc_increments = 2;
+            DISPATCH();
+        OPCODE(0xDC)
+            // CALL C addr
+            do_conditional_call(motherboard, cpu, cpu->carry_flag, OPERAND16, &states, &pc_increments);
+            DISPATCH();
+        OPCODE(0xDE)
+            // SBI data (subtract intermediate with carry)
+            do_subtraction(cpu, instr[1], cpu->carry_flag, true);
+            pc_increments = 2;
+            DISPATCH();
+        OPCODE(0xDF)
+            // RST 3
+            do_interrupt(motherboard, cpu, 3, &pc_increments);
+            DISPATCH();
+        OPCODE(0xE0)
+            // RET PO
+            do_conditional_return(motherboard, cpu, !get_parity_flag(cpu), &states, &pc_increments);
+            DISPATCH();
+        OPCODE(0xE1)  // POP
+            // POP HL
+            cpu->hl = read_word(motherboard, cpu->sp);
+            cpu->sp = cpu->sp + 2;
+            DISPATCH();
+        OPCODE(0xE2)
+            // JMP PO
+            do_conditional_jump(cpu, !get_parity_flag(cpu), OPERAND16, &pc_increments);
+            DISPATCH();
+        OPCODE(0xE3)
+            // XTHL
+            // Exchange stack top with H and L.
+            tmp_rp = cpu->hl;
+            cpu->hl = read_word(motherboard, cpu->sp);
+            write_byte(motherboard, cpu, cpu->sp, tmp_rp & 0xFF);
+            write_byte(motherboard, cpu, cpu->sp + 1, tmp_rp >> 8);
+            DISPATCH();
+        OPCODE(0xE4)
+            // CALL PO addr
+            do_conditional_call(motherboard, cpu, !get_parity_flag(cpu), OPERAND16, &states, &pc_increments);
+            DISPATCH();
+        OPCODE(0xE5)
+            // PUSH HL
+            write_byte(motherboard, cpu, cpu->sp - 1, cpu->h);
+            write_byte(motherboard, cpu, cpu->sp - 2, cpu->l);
+            cpu->sp = cpu->sp - 2;
+            DISPATCH();
+        OPCODE(0xE6)
+            // AND data (ANI data)
+            do_and(cpu, instr[1]);
+            pc_increments = 2;
+            DISPATCH();
+        OPCODE(0xE7)
+            // RST 4
+            do_interrupt(motherboard, cpu, 4, &pc_increments);
+            DISPATCH();
+        OPCODE(0xE8)
+            // RET PE
+            do_conditional_return(motherboard, cpu, get_parity_flag(cpu), &states, &pc_increments);
+            DISPATCH();
+        OPCODE(0xE9)
+            // PCHL - Jump to (HL) indirect 
+            cpu->pc = cpu->hl;
+            pc_increments = 0;
+            DISPATCH();
+        OPCODE(0xEA)
+            // JMP PE
+            do_conditional_jump(cpu, get_parity_flag(cpu), OPERAND16, &pc_increments);
+            DISPATCH();
+        OPCODE(0xEB)
+            // XCHG (a.k.a. EX DE, HL)
+            tmp_rp = cpu->de;
+            cpu->de = cpu->hl;
+            cpu->hl = tmp_rp;
+            DISPATCH();
+        OPCODE(0xEC)
+            // CALL PE addr
+            do_conditional_call(motherboard, cpu, get_parity_flag(cpu), OPERAND16, &states, &pc_increments);
+            DISPATCH();
+        OPCODE(0xEE)
+            // XRI data (XOR intermediate)
+            do_xor(cpu, instr[1]);
+            pc_increments = 2;
+            DISPATCH();
+        OPCODE(0xEF)
+            // RST 5
+            do_interrupt(motherboard, cpu, 5, &pc_increments);
+            DISPATCH();
+        OPCODE(0xF0)
+            // RET P
+            do_conditional_return(motherboard, cpu, !get_sign_flag(cpu), &states, &pc_increments);
+            DISPATCH();
+        OPCODE(0xF1)
+            // POP PSW (POP AF)
+            cpu->psw = read_word(motherboard, cpu->sp);
+            set_flags_from_byte(cpu, cpu->f);
+            cpu->sp = cpu->sp + 2;
+            DISPATCH();
+        OPCODE(0xF2)
+            // JMP P
+            do_conditional_jump(cpu, !get_sign_flag(cpu), OPERAND16, &pc_increments);
+            DISPATCH();
+        OPCODE(0xF3)  // DI
+            cpu->interrupts_enabled = false;
+            DISPATCH();
+        OPCODE(0xF4)
+            // CALL P addr
+            do_conditional_call(motherboard, cpu, !get_sign_flag(cpu), OPERAND16, &states, &pc_increments);
+            DISPATCH();
+        OPCODE(0xF5)
+            // PUSH PSW (a.k.a. PUSH AF)
+            cpu->f = get_byte_from_flags(cpu);
+            write_byte(motherboard, cpu, cpu->sp - 1, cpu->a);
+            write_byte(motherboard, cpu, cpu->sp - 2, cpu->f);
+            cpu->sp = cpu->sp - 2;
+            DISPATCH();
+        OPCODE(0xF6)
+            // OR data (ORI data)
+            do_or(cpu, instr[1]);
+            pc_increments = 2;
+            DISPATCH();
+        OPCODE(0xF7)
+            // RST 6
+            do_interrupt(motherboard, cpu, 6, &pc_increments);
+            DISPATCH();
+        OPCODE(0xF8)
+            // RET M
+            do_conditional_return(motherboard, cpu, get_sign_flag(cpu), &states, &pc_increments);
+            DISPATCH();
+        OPCODE(0xF9)
+            // SPHL
+            cpu->sp = cpu->hl;
+            DISPATCH();
+        OPCODE(0xFA)
+            // JMP M
+            do_conditional_jump(cpu, get_sign_flag(cpu), OPERAND16, &pc_increments);
+            DISPATCH();
+        OPCODE(0xFB)
+            // EI
+            cpu->enable_interrupts_after_next_instruction = true;
+            state_budget = 0;
+            DISPATCH();
+        OPCODE(0xFC)
+            // CALL M addr
+            do_conditional_call(motherboard, cpu, get_sign_flag(cpu), OPERAND16, &states, &pc_increments);
+            DISPATCH();
+        OPCODE(0xFE)
+            // CPI data (CMP data)
+            do_subtraction(cpu, instr[1], false, false);
+            pc_increments = 2;
+            DISPATCH();
+        OPCODE(0xFF)
+            // RST 7
+            do_interrupt(motherboard, cpu, 7, &pc_increments);
+            DISPATCH();
+        INVALID_OPCODE  // 0x08, 0x10, 0x18, 0x20, 0x28, 0x30, 0x38, 0xCB, 0xD9, 0xDD, 0xED, 0xFD
+            printf("Invalid Opcode %02X\n", opcode);
+            ok = false;
+            goto done;
+#ifndef EXECUTE_THREADED
+    }
+    FINISH_INSTRUCTION();
+    if (MORE_INSTRUCTIONS()) {
+        goto next_instruction;
+    }
+    goto STOP_LABEL;
+#endif
+
+#ifdef EXECUTE_FROM_BLOCK
+run_fusion:
+    decoded += execute_fusion(motherboard, cpu, block, decoded, &executed_states, &executed_instructions) - 1;
+    if (MORE_INSTRUCTIONS()) {
+        goto next_instruction;
+    }
+
+end_of_block:
+    /* Having run all of the block, go straight on to the one at the new pc, as run_cpu8080() would, unless the budget
+       is spent or run_cpu8080() has something else to do with it first: check it for a busy wait or run it with the
+       JIT. */
+    if (decoded == block_end && executed_states < state_budget && cpu->jit == NULL) {
+        block = block_cache_lookup(cpu->block_cache, motherboard->memory_map, cpu->pc);
+        if (block->num_instructions > 0 && !block->busy_wait_candidate) {
+            decoded = block->instructions;
+            block_end = block->instructions + block->num_instructions;
+            goto next_instruction;
+        }
+    }
+#endif
+
+done:
+    *num_states = *num_states + executed_states;
+    *num_instructions = *num_instructions + executed_instructions;
+    return ok;
+}
+
+#undef OPCODE
+#undef INVALID_OPCODE
+#undef DISPATCH
+#undef FETCH_INSTRUCTION
+#undef FINISH_INSTRUCTION
+#undef MORE_INSTRUCTIONS
+#undef START_INSTRUCTION
+#undef OPERAND16
+#undef STOP_LABEL
@@ -0,0 +1,1008 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "jit8080.h"
+#include "blockcache.h"
+#include "alu8080.h"
+
+#ifdef CPU8080_HAS_JIT
+#include <sys/mman.h>
+
+/*
+How translated code works
+
+A translated block is a function that takes a jit_registers.  While it runs, the 8080 registers live in host registers,
+arranged so that every 8-bit 8080 register is also an 8-bit host register:
+    A and the flags     eax     al = A, ah = flags in PUSH PSW layout
+    BC                  ecx     ch = B, cl = C
+    DE                  edx     dh = D, dl = E
+    HL                  ebx     bh = H, bl = L
+    SP                  r13d
+The upper 16 bits of these are always zero, so rbx, rcx and rdx can index memory directly.  rbp holds the base of 8080
+memory, r12 the memory map's write_direct table (followed by read_direct), r14 the block cache's code map and r15 the
+jit_registers.  r10d and r11d count the states and instructions of earlier passes through a block that loops back to
+its own start.  rsi, rdi, r8 and r9 are scratch.  ah, bh, ch and dh can't be used in an instruction with a REX prefix,
+which is why values headed for them go through esi and edi.
+
+Flags come from the same precomputed tables the interpreter uses, so the results are identical by construction.
+
+Every exit stores the registers back, along with the 8080 pc to continue at and the states and instructions executed.  A
+block exits early, after the instruction that did it, when it writes to memory that holds cached code; run_jit_cpu8080()
+then invalidates the blocks that covered it.  A block whose last jump goes back to its own start runs again without
+exiting while another pass fits in the budget, so a counting loop stays in native code.  A write to a page that is not
+plain RAM, or a read of an I/O page, exits in front of the instruction, since only the interpreter knows what to do with
+it.  Writes also set the map's dirty line bits for its tracked range, the way the interpreter does.  Instructions that
+need the rest of the machine (IN, OUT, HLT, EI, DI, RST and invalid opcodes) are not translated: the block exits in
+front of them and the interpreter runs them.
+*/
+
+typedef struct {
+    uint32_t af;
+    uint32_t bc;
+    uint32_t de;
+    uint32_t hl;
+    uint32_t sp;
+    uint32_t pc;
+    uint32_t states;
+    uint32_t instructions;
+    uint32_t budget;         // a block that jumps back to its own start goes round again only if a pass fits in this
+    uint32_t write_address;  // lowest address written, if write_length is not 0
+    uint32_t write_length;   // bytes written to cached code by the last instruction, 0, or MAPPED_ACCESS
+    uint8_t *memory;
+    uint8_t *code_map;
+    bool *write_direct;
+} jit_registers;
+
+typedef void (*native_block)(jit_registers *registers);
+
+// write_length of a block that stopped in front of a read or write the memory map has to handle
+#define MAPPED_ACCESS 0xFF
+
+// Most code one block can need; translation starts over in an empty buffer if less than this is left.
+#define JIT_MAX_BLOCK_CODE 16384
+
+// Host registers, in x86 encoding order.
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+// Host 8-bit registers without a REX prefix.  With a REX prefix, 4-7 are spl, bpl, sil and dil instead.
+enum { AL, CL, DL, BL, AH, CH, DH, BH };
+#define SIL 6
+#define NO_INDEX -1
+
+// Prefix flags for the emit functions
+#define OP16 0x1   // 16-bit operand size
+#define OP64 0x2   // REX.W
+#define OPREX 0x4  // REX prefix even without extension bits, to reach sil
+
+// Group opcode extensions
+#define ALU_ADD 0
+#define ALU_OR 1
+#define ALU_AND 4
+#define ALU_XOR 6
+#define SHIFT_SHL 4
+#define SHIFT_SHR 5
+
+// Host 8-bit register for each 8080 register, in the order of the register fields of 8080 opcodes.  6 is M.
+static const int host_byte_register[8] = {CH, CL, DH, DL, BH, BL, -1, AL};
+// Host register for each 8080 register pair, in the order of the register pair fields of 8080 opcodes.
+static const int host_pair_register[4] = {RCX, RDX, RBX, R13};
+// Flag tested by conditional jumps, calls and returns, indexed by bits 4-5 of the opcode.  Bit 3 set means jump if set.
+static const uint8_t condition_flag[4] = {FLAG_ZERO, FLAG_CARRY, FLAG_PARITY, FLAG_SIGN};
+
+typedef struct {
+    size_t jump_at;          // offset of the rel32 to patch
+    uint16_t pc;             // where the 8080 continues
+    uint32_t states;
+    uint32_t instructions;
+    int address_register;    // host register holding the lowest address written, or -1 if it is address
+    uint16_t address;
+    uint8_t length;
+} pending_exit;
+
+typedef struct {
+    uint8_t *code;
+    size_t size;
+    bool overflow;
+    size_t epilogue;  // offset of the code that stores the registers and returns
+    uint16_t start_pc;
+    size_t loop_start;  // offset of the first instruction, where a jump back to start_pc goes
+
+    pending_exit exits[BLOCK_CACHE_MAX_INSTRUCTIONS * 4];
+    int num_exits;
+} jit_emitter;
+
+static void emit8(jit_emitter *e, uint8_t byte) {
+    if (e->size < JIT_MAX_BLOCK_CODE) {
+        e->code[e->size] = byte;
+        e->size++;
+    }
+    else {
+        e->overflow = true;
+    }
+}
+
+static void emit32(jit_emitter *e, uint32_t value) {
+    int i;
+    for (i = 0; i < 4; i++) {
+        emit8(e, (uint8_t)(value >> (8 * i)));
+    }
+}
+
+static void emit64(jit_emitter *e, uint64_t value) {
+    emit32(e, (uint32_t)value);
+    emit32(e, (uint32_t)(value >> 32));
+}
+
+static void emit_prefixes(jit_emitter *e, int flags, int reg, int index, int base) {
+    uint8_t rex = 0x40 | ((flags & OP64) ? 0x8 : 0) | ((reg & 8) ? 0x4 : 0) | ((index & 8) ? 0x2 : 0) | ((base & 8) ? 0x1 : 0);
+    if (flags & OP16) {
+        emit8(e, 0x66);
+    }
+    if (rex != 0x40 || (flags & OPREX)) {
+        emit8(e, rex);
+    }
+}
+
+static void emit_opcode(jit_emitter *e, uint32_t opcode) {
+    if (opcode > 0xFF) {
+        emit8(e, (uint8_t)(opcode >> 8));
+    }
+    emit8(e, (uint8_t)opcode);
+}
+
+// opcode with a register operand: reg goes in the ModRM reg field (or is the /digit), rm in the r/m field.
+static void emit_rr(jit_emitter *e, int flags, uint32_t opcode, int reg, int rm) {
+    emit_prefixes(e, flags, reg, 0, rm);
+    emit_opcode(e, opcode);
+    emit8(e, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// opcode with a memory operand [base + index * (1 << scale) + disp].
+static void emit_rm(jit_emitter *e, int flags, uint32_t opcode, int reg, int base, int index, int scale, int32_t disp) {
+    int mod;
+
+    emit_prefixes(e, flags, reg, (index == NO_INDEX) ? 0 : index, base);
+    emit_opcode(e, opcode);
+    if (disp == 0 && (base & 7) != RBP) {
+        mod = 0;
+    }
+    else if (disp >= -128 && disp <= 127) {
+        mod = 1;
+    }
+    else {
+        mod = 2;
+    }
+    if (index == NO_INDEX && (base & 7) != RSP) {
+        emit8(e, (mod << 6) | ((reg & 7) << 3) | (base & 7));
+    }
+    else {
+        emit8(e, (mod << 6) | ((reg & 7) << 3) | 4);
+        emit8(e, (scale << 6) | ((((index == NO_INDEX) ? RSP : index) & 7) << 3) | (base & 7));
+    }
+    if (mod == 1) {
+        emit8(e, (uint8_t)disp);
+    }
+    else if (mod == 2) {
+        emit32(e, (uint32_t)disp);
+    }
+}
+
+static void emit_mov(jit_emitter *e, int dst, int src) {
+    emit_rr(e, 0, 0x89, src, dst);
+}
+
+static void emit_or(jit_emitter *e, int dst, int src) {
+    emit_rr(e, 0, 0x09, src, dst);
+}
+
+static void emit_alu_imm(jit_emitter *e, int operation, int reg, uint32_t imm) {
+    emit_rr(e, 0, 0x81, operation, reg);
+    emit32(e, imm);
+}
+
+static void emit_shift(jit_emitter *e, int operation, int reg, uint8_t count) {
+    emit_rr(e, 0, 0xC1, operation, reg);
+    emit8(e, count);
+}
+
+static void emit_mov_imm32(jit_emitter *e, int reg, uint32_t imm) {
+    emit_prefixes(e, 0, 0, 0, reg);
+    emit8(e, 0xB8 + (reg & 7));
+    emit32(e, imm);
+}
+
+static void emit_mov_imm64(jit_emitter *e, int reg, const void *imm) {
+    emit_prefixes(e, OP64, 0, 0, reg);
+    emit8(e, 0xB8 + (reg & 7));
+    emit64(e, (uint64_t)(uintptr_t)imm);
+}
+
+// dst = (base + disp) & 0xFFFF
+static void emit_address(jit_emitter *e, int dst, int base, int32_t disp) {
+    emit_rm(e, 0, 0x8D, dst, base, NO_INDEX, 0, disp);
+    emit_rr(e, 0, 0x0FB7, dst, dst);
+}
+
+// dst (esi or edi) = 8080 register r, zero extended.  r may be M.
+static void emit_load_register(jit_emitter *e, int dst, int r) {
+    if (r == 6) {
+        emit_rm(e, 0, 0x0FB6, dst, RBP, RBX, 0, 0);
+    }
+    else {
+        emit_rr(e, 0, 0x0FB6, dst, host_byte_register[r]);
+    }
+}
+
+// Flags = the high byte of esi, except carry, which INR and DCR leave alone.  Clobbers edi.
+static void emit_flags_except_carry_from_esi(jit_emitter *e) {
+    emit_mov(e, RDI, RSI);
+    emit_alu_imm(e, ALU_AND, RDI, 0xFE00);
+    emit_alu_imm(e, ALU_AND, RAX, 0x01FF);
+    emit_or(e, RAX, RDI);
+}
+
+// Carry flag = the host carry flag.  Clobbers esi.
+static void emit_carry_from_host(jit_emitter *e) {
+    emit_rr(e, 0, 0x19, RSI, RSI);  // sbb esi, esi
+    emit_alu_imm(e, ALU_AND, RSI, FLAG_CARRY << 8);
+    emit_alu_imm(e, ALU_AND, RAX, ~(uint32_t)(FLAG_CARRY << 8));
+    emit_or(e, RAX, RSI);
+}
+
+// Host carry flag = the 8080 carry flag.
+static void emit_host_carry_from_carry(jit_emitter *e) {
+    emit_rr(e, 0, 0x0FBA, 4, RAX);  // bt eax, 8
+    emit8(e, 8);
+}
+
+/* Stores the registers and the exit state and jumps to the epilogue.  pc comes from pc_register, or is pc if pc_register is
+   -1.  states and instructions are those of this pass through the block, which r10d and r11d add the earlier passes to.
+   If length is not 0, the instruction wrote length bytes of cached code starting at the address in address_register, or
+   at address if address_register is -1.  Clobbers r8d. */
+static void emit_exit(jit_emitter *e, int pc_register, uint16_t pc, uint32_t states, uint32_t instructions,
+                      int address_register, uint16_t address, uint8_t length) {
+    if (pc_register >= 0) {
+        emit_rm(e, 0, 0x89, pc_register, R15, NO_INDEX, 0, offsetof(jit_registers, pc));
+    }
+    else {
+        emit_rm(e, 0, 0xC7, 0, R15, NO_INDEX, 0, offsetof(jit_registers, pc));
+        emit32(e, pc);
+    }
+    emit_rm(e, 0, 0x8D, R8, R10, NO_INDEX, 0, states);  // lea r8d, [r10 + states]
+    emit_rm(e, 0, 0x89, R8, R15, NO_INDEX, 0, offsetof(jit_registers, states));
+    emit_rm(e, 0, 0x8D, R8, R11, NO_INDEX, 0, instructions);
+    emit_rm(e, 0, 0x89, R8, R15, NO_INDEX, 0, offsetof(jit_registers, instructions));
+    emit_rm(e, 0, 0xC7, 0, R15, NO_INDEX, 0, offsetof(jit_registers, write_length));
+    emit32(e, length);
+    if (length > 0) {
+        if (address_register >= 0) {
+            emit_rm(e, 0, 0x89, address_register, R15, NO_INDEX, 0, offsetof(jit_registers, write_address));
+        }
+        else {
+            emit_rm(e, 0, 0xC7, 0, R15, NO_INDEX, 0, offsetof(jit_registers, write_address));
+            emit32(e, address);
+        }
+    }
+    emit8(e, 0xE9);  // jmp rel32
+    emit32(e, (uint32_t)(e->epilogue - (e->size + 4)));
+}
+
+/* A jump to pc, at the end of a pass that took states and instructions.  If pc is the start of the block and another
+   pass of the same states fits in the budget, goes round again without leaving the translated code; otherwise exits. */
+static void emit_jump_to(jit_emitter *e, uint16_t pc, uint32_t states, uint32_t instructions) {
+    if (pc == e->start_pc) {
+        emit_alu_imm(e, ALU_ADD, R10, states);
+        emit_alu_imm(e, ALU_ADD, R11, instructions);
+        emit_rm(e, 0, 0x8D, R8, R10, NO_INDEX, 0, states);  // lea r8d, [r10 + states]
+        emit_rm(e, 0, 0x3B, R8, R15, NO_INDEX, 0, offsetof(jit_registers, budget));  // cmp r8d, [r15 + budget]
+        emit8(e, 0x0F);
+        emit8(e, 0x86);  // jbe rel32
+        emit32(e, (uint32_t)(e->loop_start - (e->size + 4)));
+        emit_exit(e, -1, pc, 0, 0, -1, 0, 0);
+    }
+    else {
+        emit_exit(e, -1, pc, states, instructions, -1, 0, 0);
+    }
+}
+
+// Emits jcc rel32 (condition is the second opcode byte, e.g. 0x82 for jc) and returns the offset of the rel32.
+static size_t emit_jump_forward(jit_emitter *e, uint8_t condition) {
+    emit8(e, 0x0F);
+    emit8(e, condition);
+    emit32(e, 0);
+    return e->size - 4;
+}
+
+static void patch_jump(jit_emitter *e, size_t jump_at) {
+    uint32_t rel = (uint32_t)(e->size - (jump_at + 4));
+    if (jump_at + 4 <= JIT_MAX_BLOCK_CODE) {
+        memcpy(&(e->code[jump_at]), &rel, 4);
+    }
+}
+
+static void add_pending_exit(jit_emitter *e, size_t jump_at, uint16_t pc, uint32_t states, uint32_t instructions,
+                             int address_register, uint16_t address, uint8_t length) {
+    pending_exit *exit = &(e->exits[e->num_exits]);
+    exit->jump_at = jump_at;
+    exit->pc = pc;
+    exit->states = states;
+    exit->instructions = instructions;
+    exit->address_register = address_register;
+    exit->address = address;
+    exit->length = length;
+    e->num_exits++;
+}
+
+/* After a write: exit if the byte at the address in check_register (or at check_address, if check_register is -1) is cached
+   code.  The exit reports length bytes written starting at the address in address_register / address. */
+static void emit_code_write_check(jit_emitter *e, int check_register, uint16_t check_address, uint16_t pc, uint32_t states,
+                                  uint32_t instructions, int address_register, uint16_t address, uint8_t length) {
+    if (check_register >= 0) {
+        emit_rm(e, 0, 0x0FA3, check_register, R14, NO_INDEX, 0, 0);  // bt [r14], reg
+        add_pending_exit(e, emit_jump_forward(e, 0x82), pc, states, instructions, address_register, address, length);
+    }
+    else {
+        emit_rm(e, 0, 0xF6, 0, R14, NO_INDEX, 0, check_address >> 3);  // test byte [r14 + address / 8], bit
+        emit8(e, 1 << (check_address & 7));
+        add_pending_exit(e, emit_jump_forward(e, 0x85), pc, states, instructions, address_register, address, length);
+    }
+}
+
+// Offset of the map's read_direct table from write_direct, which r12 points to
+#define READ_DIRECT (offsetof(memory_map8080, read_direct) - offsetof(memory_map8080, write_direct))
+
+/* Exits in front of the instruction at pc, to have the interpreter run it, if the page of the address in check_register
+   (or check_address, if check_register is -1) is 0 in the table at r12 + table.  Clobbers r8d. */
+static void emit_mapped_access_check(jit_emitter *e, int32_t table, int check_register, uint16_t check_address,
+                                     uint16_t pc, uint32_t states_before, uint32_t instructions_before) {
+    if (check_register >= 0) {
+        emit_mov(e, R8, check_register);
+        emit_shift(e, SHIFT_SHR, R8, 8);
+        emit_rm(e, 0, 0x80, 7, R12, R8, 0, table);  // cmp byte [r12 + r8 + table], 0
+    }
+    else {
+        emit_rm(e, 0, 0x80, 7, R12, NO_INDEX, 0, table + (check_address >> 8));  // cmp byte [r12 + table + page], 0
+    }
+    emit8(e, 0);
+    add_pending_exit(e, emit_jump_forward(e, 0x84), pc, states_before, instructions_before, -1, 0, MAPPED_ACCESS);
+}
+
+// Offsets of the map's tracked write range and its dirty line bitmap from write_direct
+#define DIRTY_START (offsetof(memory_map8080, dirty_start) - offsetof(memory_map8080, write_direct))
+#define DIRTY_LENGTH (offsetof(memory_map8080, dirty_length) - offsetof(memory_map8080, write_direct))
+#define DIRTY_LINES (offsetof(memory_map8080, dirty_lines) - offsetof(memory_map8080, write_direct))
+
+/* Before a write, for pages that are not plain RAM.  Pages that can't be read directly can't be written directly either.
+   Also marks the address's line dirty if it is in the map's tracked range, as note_memory_write() does; if the
+   instruction exits instead, the interpreter writes the same address.  Clobbers r8d. */
+static void emit_mapped_write_check(jit_emitter *e, int check_register, uint16_t check_address, uint16_t pc,
+                                    uint32_t states_before, uint32_t instructions_before) {
+    size_t untracked;
+
+    emit_mapped_access_check(e, 0, check_register, check_address, pc, states_before, instructions_before);
+    if (check_register >= 0) {
+        emit_mov(e, R8, check_register);
+    }
+    else {
+        emit_mov_imm32(e, R8, check_address);
+    }
+    emit_rm(e, 0, 0x2B, R8, R12, NO_INDEX, 0, DIRTY_START);  // sub r8d, [r12 + DIRTY_START]
+    emit_alu_imm(e, ALU_AND, R8, 0xFFFF);
+    emit_rm(e, 0, 0x3B, R8, R12, NO_INDEX, 0, DIRTY_LENGTH);  // cmp r8d, [r12 + DIRTY_LENGTH]
+    untracked = emit_jump_forward(e, 0x83);  // jae
+    emit_shift(e, SHIFT_SHR, R8, __builtin_ctz(MEMORY_DIRTY_LINE_SIZE));
+    emit_rm(e, 0, 0x0FAB, R8, R12, NO_INDEX, 0, DIRTY_LINES);  // bts [r12 + DIRTY_LINES], r8d
+    patch_jump(e, untracked);
+}
+
+// Before a read, for I/O pages.
+static void emit_mapped_read_check(jit_emitter *e, int check_register, uint16_t check_address, uint16_t pc,
+                                   uint32_t states_before, uint32_t instructions_before) {
+    emit_mapped_access_check(e, READ_DIRECT, check_register, check_address, pc, states_before, instructions_before);
+}
+
+/* Pushes the two bytes in hi_register and lo_register (host byte registers, or -1 to use hi and lo) and updates SP, for
+   the instruction at pc.  Leaves the address of the low byte in edi for the code write check. */
+static void emit_push(jit_emitter *e, int hi_register, uint8_t hi, int lo_register, uint8_t lo, uint16_t pc,
+                      uint32_t states_before, uint32_t instructions_before) {
+    emit_address(e, RSI, R13, -1);
+    emit_address(e, RDI, R13, -2);
+    emit_mapped_write_check(e, RSI, 0, pc, states_before, instructions_before);
+    emit_mapped_write_check(e, RDI, 0, pc, states_before, instructions_before);
+    if (hi_register >= 0) {
+        emit_rm(e, 0, 0x88, hi_register, RBP, RSI, 0, 0);
+    }
+    else {
+        emit_rm(e, 0, 0xC6, 0, RBP, RSI, 0, 0);
+        emit8(e, hi);
+    }
+    if (lo_register >= 0) {
+        emit_rm(e, 0, 0x88, lo_register, RBP, RDI, 0, 0);
+    }
+    else {
+        emit_rm(e, 0, 0xC6, 0, RBP, RDI, 0, 0);
+        emit8(e, lo);
+    }
+    emit_mov(e, R13, RDI);
+}
+
+static void emit_push_write_checks(jit_emitter *e, uint16_t pc, uint32_t states, uint32_t instructions) {
+    emit_code_write_check(e, RSI, 0, pc, states, instructions, RDI, 0, 2);
+    emit_code_write_check(e, RDI, 0, pc, states, instructions, RDI, 0, 2);
+}
+
+// esi = the 16-bit word at SP; SP += 2, for the instruction at pc.
+static void emit_pop_to_esi(jit_emitter *e, uint16_t pc, uint32_t states_before, uint32_t instructions_before) {
+    emit_mapped_read_check(e, R13, 0, pc, states_before, instructions_before);
+    emit_address(e, R8, R13, 1);
+    emit_mapped_read_check(e, R8, 0, pc, states_before, instructions_before);
+    emit_address(e, R8, R13, 1);
+    emit_rm(e, 0, 0x0FB6, RSI, RBP, R13, 0, 0);
+    emit_rm(e, 0, 0x0FB6, RDI, RBP, R8, 0, 0);
+    emit_shift(e, SHIFT_SHL, RDI, 8);
+    emit_or(e, RSI, RDI);
+    emit_address(e, R13, R8, 1);
+}
+
+// ADD, ADC, SUB, SBB, ANA, XRA, ORA or CMP (operation 0-7, from bits 3-5 of the opcode) of A and edi.
+static void emit_alu(jit_emitter *e, int operation) {
+    emit_rr(e, 0, 0x0FB6, RSI, AL);
+    if (operation < 4 || operation == 7) {
+        // index into add_table / sub_table: carry << 16 | a << 8 | operand
+        emit_shift(e, SHIFT_SHL, RSI, 8);
+        emit_or(e, RSI, RDI);
+        if (operation == 1 || operation == 3) {
+            emit_host_carry_from_carry(e);
+            emit_rr(e, 0, 0x19, RDI, RDI);  // sbb edi, edi
+            emit_alu_imm(e, ALU_AND, RDI, 0x10000);
+            emit_or(e, RSI, RDI);
+        }
+        emit_mov_imm64(e, RDI, (operation < 2) ? (void *)add_table : (void *)sub_table);
+        if (operation == 7) {
+            // CMP only sets the flags
+            emit_rm(e, 0, 0x0FB7, RSI, RDI, RSI, 1, 0);
+            emit_alu_imm(e, ALU_AND, RSI, 0xFF00);
+            emit_alu_imm(e, ALU_AND, RAX, 0x00FF);
+            emit_or(e, RAX, RSI);
+        }
+        else {
+            emit_rm(e, 0, 0x0FB7, RAX, RDI, RSI, 1, 0);
+        }
+        return;
+    }
+    // logical operations: flags from zsp_table, carry clear, aux carry from bit 3 of a | operand for ANA and clear otherwise
+    if (operation == 4) {
+        emit_mov(e, R8, RSI);
+        emit_or(e, R8, RDI);
+        emit_alu_imm(e, ALU_AND, R8, 0x08);
+        emit_shift(e, SHIFT_SHL, R8, 1);
+        emit_rr(e, 0, 0x21, RDI, RSI);  // and esi, edi
+    }
+    else if (operation == 5) {
+        emit_rr(e, 0, 0x31, RDI, RSI);  // xor esi, edi
+    }
+    else {
+        emit_or(e, RSI, RDI);
+    }
+    emit_mov_imm64(e, RDI, zsp_table);
+    emit_rm(e, 0, 0x0FB6, RDI, RDI, RSI, 0, 0);
+    if (operation == 4) {
+        emit_or(e, RDI, R8);
+    }
+    emit_shift(e, SHIFT_SHL, RDI, 8);
+    emit_or(e, RSI, RDI);
+    emit_mov(e, RAX, RSI);
+}
+
+static bool is_translatable(uint8_t opcode) {
+    switch (opcode) {
+        case 0xDB:  // IN
+        case 0xD3:  // OUT
+        case 0x76:  // HLT
+        case 0xFB:  // EI
+        case 0xF3:  // DI
+        case 0x31:  // LXI SP, which also sets stack_pointer_start for the debugger
+        case 0x08: case 0x10: case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:  // invalid
+        case 0xCB: case 0xD9: case 0xDD: case 0xED: case 0xFD:  // invalid
+            return false;
+    }
+    // RST behaves differently depending on whether interrupts are enabled, which the translated code doesn't track.
+    return ((opcode & 0xC7) != 0xC7);
+}
+
+/* Emits one instruction.  states and instructions are the totals up to the end of the instruction, for exits it takes.
+   Sets *max_states to the most states the instruction can take, and *ends to true if it always exits. */
+static void emit_instruction(jit_emitter *e, const decoded_instruction *decoded, uint16_t pc, uint32_t states_before,
+                             uint32_t instructions, uint32_t *max_states, bool *ends) {
+    uint8_t opcode = decoded->bytes[0];
+    uint16_t address = decoded->operand;
+    uint16_t next_pc = pc + decoded->length;
+    uint32_t states = states_before + states_per_opcode[opcode];
+    int dst = (opcode >> 3) & 7, src = opcode & 7, pair = host_pair_register[(opcode >> 4) & 3];
+    bool jump_if_set = (opcode & 0x08) != 0;
+    size_t condition_jump;
+
+    *max_states = states_per_opcode[opcode];
+    *ends = false;
+
+    if (opcode >= 0x40 && opcode <= 0x7F) {
+        // MOV (0x76 is HLT and is not translated)
+        if (dst == 6) {
+            emit_mapped_write_check(e, RBX, 0, pc, states_before, instructions - 1);
+            emit_rm(e, 0, 0x88, host_byte_register[src], RBP, RBX, 0, 0);
+            emit_code_write_check(e, RBX, 0, next_pc, states, instructions, RBX, 0, 1);
+        }
+        else if (src == 6) {
+            emit_mapped_read_check(e, RBX, 0, pc, states_before, instructions - 1);
+            emit_rm(e, 0, 0x8A, host_byte_register[dst], RBP, RBX, 0, 0);
+        }
+        else if (src != dst) {
+            emit_rr(e, 0, 0x88, host_byte_register[src], host_byte_register[dst]);
+        }
+        return;
+    }
+    if (opcode >= 0x80 && opcode <= 0xBF) {
+        if (src == 6) {
+            emit_mapped_read_check(e, RBX, 0, pc, states_before, instructions - 1);
+        }
+        emit_load_register(e, RDI, src);
+        emit_alu(e, dst);
+        return;
+    }
+    if ((opcode & 0xC7) == 0xC6) {
+        // ADI, ACI, SUI, SBI, ANI, XRI, ORI, CPI
+        emit_mov_imm32(e, RDI, decoded->bytes[1]);
+        emit_alu(e, dst);
+        return;
+    }
+    if ((opcode & 0xC7) == 0x06) {
+        // MVI
+        if (dst == 6) {
+            emit_mapped_write_check(e, RBX, 0, pc, states_before, instructions - 1);
+            emit_rm(e, 0, 0xC6, 0, RBP, RBX, 0, 0);
+            emit8(e, decoded->bytes[1]);
+            emit_code_write_check(e, RBX, 0, next_pc, states, instructions, RBX, 0, 1);
+        }
+        else {
+            emit8(e, 0xB0 + host_byte_register[dst]);
+            emit8(e, decoded->bytes[1]);
+        }
+        return;
+    }
+    if ((opcode & 0xC6) == 0x04) {
+        /* INR and DCR: the tables give the flags for byte + 1 and byte - 1; carry is left alone.  A register is
+           incremented or decremented in place, so a counting loop doesn't wait on the table load for its next pass. */
+        if (dst == 6) {
+            emit_mapped_write_check(e, RBX, 0, pc, states_before, instructions - 1);
+        }
+        emit_load_register(e, RSI, dst);
+        if (dst != 6) {
+            emit_rr(e, 0, 0xFE, opcode & 1, host_byte_register[dst]);  // inc or dec
+        }
+        emit_shift(e, SHIFT_SHL, RSI, 8);
+        emit_alu_imm(e, ALU_OR, RSI, 1);
+        emit_mov_imm64(e, RDI, (opcode & 1) ? (void *)sub_table : (void *)add_table);
+        emit_rm(e, 0, 0x0FB7, RSI, RDI, RSI, 1, 0);
+        emit_flags_except_carry_from_esi(e);
+        if (dst == 6) {
+            emit_rm(e, OPREX, 0x88, SIL, RBP, RBX, 0, 0);
+            emit_code_write_check(e, RBX, 0, next_pc, states, instructions, RBX, 0, 1);
+        }
+        return;
+    }
+    if ((opcode & 0xC0) == 0x00 && (opcode & 0x0F) == 0x01) {
+        // LXI
+        emit_mov_imm32(e, pair, address);
+        return;
+    }
+    if ((opcode & 0xC0) == 0x00 && (opcode & 0x0F) == 0x03) {
+        // INX
+        emit_rr(e, OP16, 0xFF, 0, pair);
+        return;
+    }
+    if ((opcode & 0xC0) == 0x00 && (opcode & 0x0F) == 0x0B) {
+        // DCX
+        emit_rr(e, OP16, 0xFF, 1, pair);
+        return;
+    }
+    if ((opcode & 0xC0) == 0x00 && (opcode & 0x0F) == 0x09) {
+        // DAD: carry out of the 16-bit add
+        emit_rr(e, OP16, 0x01, pair, RBX);
+        emit_carry_from_host(e);
+        return;
+    }
+    if ((opcode & 0xCF) == 0xC5 || (opcode & 0xCF) == 0xC1) {
+        // PUSH and POP
+        if (opcode == 0xF5) {
+            // the flags byte always has bit 1 set and bits 3 and 5 clear, like get_byte_from_flags()
+            emit_mov(e, R9, RAX);
+            emit_shift(e, SHIFT_SHR, R9, 8);
+            emit_alu_imm(e, ALU_AND, R9, FLAG_SIGN | FLAG_ZERO | FLAG_AUX_CARRY | FLAG_PARITY | FLAG_CARRY);
+            emit_alu_imm(e, ALU_OR, R9, 0x02);
+            emit_push(e, AL, 0, R9, 0, pc, states_before, instructions - 1);
+            emit_push_write_checks(e, next_pc, states, instructions);
+        }
+        else if (opcode == 0xF1) {
+            // the word popped has A in the high byte, but A is in al
+            emit_pop_to_esi(e, pc, states_before, instructions - 1);
+            emit_rr(e, OP16, 0xC1, 0, RSI);  // rol si, 8
+            emit8(e, 8);
+            emit_rr(e, 0, 0x0FB7, RAX, RSI);
+        }
+        else if (opcode & 0x04) {
+            emit_push(e, host_byte_register[((opcode >> 4) & 3) * 2], 0, host_byte_register[((opcode >> 4) & 3) * 2 + 1], 0,
+                      pc, states_before, instructions - 1);
+            emit_push_write_checks(e, next_pc, states, instructions);
+        }
+        else {
+            emit_pop_to_esi(e, pc, states_before, instructions - 1);
+            emit_mov(e, pair, RSI);
+        }
+        return;
+    }
+    switch (opcode) {
+        case 0x00:  // NOP
+            return;
+        case 0x02:  // STAX B
+        case 0x12:  // STAX D
+            emit_mapped_write_check(e, pair, 0, pc, states_before, instructions - 1);
+            emit_rm(e, 0, 0x88, AL, RBP, pair, 0, 0);
+            emit_code_write_check(e, pair, 0, next_pc, states, instructions, pair, 0, 1);
+            return;
+        case 0x0A:  // LDAX B
+        case 0x1A:  // LDAX D
+            emit_mapped_read_check(e, pair, 0, pc, states_before, instructions - 1);
+            emit_rm(e, 0, 0x8A, AL, RBP, pair, 0, 0);
+            return;
+        case 0x22:  // SHLD
+            emit_mapped_write_check(e, -1, address, pc, states_before, instructions - 1);
+            emit_mapped_write_check(e, -1, address + 1, pc, states_before, instructions - 1);
+            emit_rm(e, 0, 0x88, BL, RBP, NO_INDEX, 0, address);
+            emit_rm(e, 0, 0x88, BH, RBP, NO_INDEX, 0, (uint16_t)(address + 1));
+            emit_code_write_check(e, -1, address, next_pc, states, instructions, -1, address, 2);
+            emit_code_write_check(e, -1, address + 1, next_pc, states, instructions, -1, address, 2);
+            return;
+        case 0x2A:  // LHLD
+            emit_mapped_read_check(e, -1, address, pc, states_before, instructions - 1);
+            emit_mapped_read_check(e, -1, address + 1, pc, states_before, instructions - 1);
+            emit_rm(e, 0, 0x8A, BL, RBP, NO_INDEX, 0, address);
+            emit_rm(e, 0, 0x8A, BH, RBP, NO_INDEX, 0, (uint16_t)(address + 1));
+            return;
+        case 0x32:  // STA
+            emit_mapped_write_check(e, -1, address, pc, states_before, instructions - 1);
+            emit_rm(e, 0, 0x88, AL, RBP, NO_INDEX, 0, address);
+            emit_code_write_check(e, -1, address, next_pc, states, instructions, -1, address, 1);
+            return;
+        case 0x3A:  // LDA
+            emit_mapped_read_check(e, -1, address, pc, states_before, instructions - 1);
+            emit_rm(e, 0, 0x8A, AL, RBP, NO_INDEX, 0, address);
+            return;
+        case 0x07:  // RLC
+            emit_rr(e, 0, 0xD0, 0, AL);
+            emit_carry_from_host(e);
+            return;
+        case 0x0F:  // RRC
+            emit_rr(e, 0, 0xD0, 1, AL);
+            emit_carry_from_host(e);
+            return;
+        case 0x17:  // RAL
+            emit_host_carry_from_carry(e);
+            emit_rr(e, 0, 0xD0, 2, AL);
+            emit_carry_from_host(e);
+            return;
+        case 0x1F:  // RAR
+            emit_host_carry_from_carry(e);
+            emit_rr(e, 0, 0xD0, 3, AL);
+            emit_carry_from_host(e);
+            return;
+        case 0x27:  // DAA: index daa_table with (aux carry << 1 | carry) << 8 | a
+            emit_rr(e, 0, 0x0FB6, RSI, AH);
+            emit_mov(e, RDI, RSI);
+            emit_alu_imm(e, ALU_AND, RSI, FLAG_CARRY);
+            emit_shift(e, SHIFT_SHR, RDI, 3);
+            emit_alu_imm(e, ALU_AND, RDI, FLAG_AUX_CARRY >> 3);
+            emit_or(e, RSI, RDI);
+            emit_shift(e, SHIFT_SHL, RSI, 8);
+            emit_rr(e, 0, 0x0FB6, RDI, AL);
+            emit_or(e, RSI, RDI);
+            emit_mov_imm64(e, RDI, daa_table);
+            emit_rm(e, 0, 0x0FB7, RAX, RDI, RSI, 1, 0);
+            return;
+        case 0x2F:  // CMA
+            emit_rr(e, 0, 0xF6, 2, AL);
+            return;
+        case 0x37:  // STC
+            emit_alu_imm(e, ALU_OR, RAX, FLAG_CARRY << 8);
+            return;
+        case 0x3F:  // CMC
+            emit_alu_imm(e, ALU_XOR, RAX, FLAG_CARRY << 8);
+            return;
+        case 0xEB:  // XCHG
+            emit_rr(e, 0, 0x87, RDX, RBX);
+            return;
+        case 0xF9:  // SPHL
+            emit_rr(e, 0, 0x0FB7, R13, RBX);
+            return;
+        case 0xE3:  // XTHL
+            emit_mov(e, RSI, R13);
+            emit_address(e, RDI, R13, 1);
+            emit_mapped_write_check(e, RSI, 0, pc, states_before, instructions - 1);
+            emit_mapped_write_check(e, RDI, 0, pc, states_before, instructions - 1);
+            emit_rm(e, 0, 0x86, BL, RBP, RSI, 0, 0);
+            emit_rm(e, 0, 0x86, BH, RBP, RDI, 0, 0);
+            emit_code_write_check(e, RSI, 0, next_pc, states, instructions, RSI, 0, 2);
+            emit_code_write_check(e, RDI, 0, next_pc, states, instructions, RSI, 0, 2);
+            return;
+        case 0xE9:  // PCHL
+            emit_exit(e, RBX, 0, states, instructions, -1, 0, 0);
+            *ends = true;
+            return;
+        case 0xC3:  // JMP
+            emit_jump_to(e, address, states, instructions);
+            *ends = true;
+            return;
+        case 0xCD:  // CALL
+            emit_push(e, -1, next_pc >> 8, -1, next_pc & 0xFF, pc, states_before, instructions - 1);
+            emit_push_write_checks(e, address, states, instructions);
+            emit_exit(e, -1, address, states, instructions, -1, 0, 0);
+            *ends = true;
+            return;
+        case 0xC9:  // RET
+            emit_pop_to_esi(e, pc, states_before, instructions - 1);
+            emit_exit(e, RSI, 0, states, instructions, -1, 0, 0);
+            *ends = true;
+            return;
+    }
+
+    // Conditional jumps, calls and returns.  Skip to the not-taken exit if the condition is false.
+    emit_rr(e, 0, 0xF6, 0, AH);  // test ah, flag
+    emit8(e, condition_flag[(opcode >> 4) & 3]);
+    condition_jump = emit_jump_forward(e, jump_if_set ? 0x84 : 0x85);
+    switch (opcode & 0xC7) {
+        case 0xC2:  // Jcc
+            emit_jump_to(e, address, states, instructions);
+            patch_jump(e, condition_jump);
+            emit_exit(e, -1, next_pc, states, instructions, -1, 0, 0);
+            break;
+        case 0xC4:  // Ccc: 17 states if the call is taken
+            *max_states = 17;
+            emit_push(e, -1, next_pc >> 8, -1, next_pc & 0xFF, pc, states_before, instructions - 1);
+            emit_push_write_checks(e, address, states_before + 17, instructions);
+            emit_exit(e, -1, address, states_before + 17, instructions, -1, 0, 0);
+            patch_jump(e, condition_jump);
+            emit_exit(e, -1, next_pc, states, instructions, -1, 0, 0);
+            break;
+        case 0xC0:  // Rcc: 11 states if the return is taken
+            *max_states = 11;
+            emit_pop_to_esi(e, pc, states_before, instructions - 1);
+            emit_exit(e, RSI, 0, states_before + 11, instructions, -1, 0, 0);
+            patch_jump(e, condition_jump);
+            emit_exit(e, -1, next_pc, states, instructions, -1, 0, 0);
+            break;
+    }
+    *ends = true;
+}
+
+/* Makes the JIT buffer read/write, or read/execute.  Only the switches cost a system call, so a run of translations
+   pays for one pair of them however many blocks it translates. */
+static bool set_buffer_writable(jit8080 *jit, bool writable) {
+    if (jit->writable == writable) {
+        return true;
+    }
+    if (mprotect(jit->buffer, JIT_BUFFER_SIZE, writable ? (PROT_READ | PROT_WRITE) : (PROT_READ | PROT_EXEC)) != 0) {
+        perror("Unable to change the protection of the JIT buffer");
+        return false;
+    }
+    jit->writable = writable;
+    return true;
+}
+
+// Translates block into the JIT buffer.  Returns false if its first instruction can't be translated.
+static bool translate_block(jit8080 *jit, block_cache8080 *cache, cached_block *block) {
+    jit_emitter e;
+    size_t entry;
+    uint32_t states = 0, instruction_states;
+    uint16_t pc = block->start_pc;
+    bool ends = false;
+    int i;
+
+    if (!is_translatable(block->instructions[0].bytes[0]) || !set_buffer_writable(jit, true)) {
+        return false;
+    }
+    if (JIT_BUFFER_SIZE - jit->buffer_used < JIT_MAX_BLOCK_CODE) {
+        // Start over.  Translations of hot blocks come back quickly: their execution counts are past the threshold.
+        for (i = 0; i < BLOCK_CACHE_NUM_SLOTS; i++) {
+            cache->slots[i].native_code = NULL;
+        }
+        jit->buffer_used = 0;
+        jit->flushes++;
+    }
+    e.code = jit->buffer + jit->buffer_used;
+    e.size = 0;
+    e.overflow = false;
+    e.num_exits = 0;
+
+    // epilogue: store the registers back and return
+    e.epilogue = e.size;
+    emit_rm(&e, 0, 0x89, RAX, R15, NO_INDEX, 0, offsetof(jit_registers, af));
+    emit_rm(&e, 0, 0x89, RCX, R15, NO_INDEX, 0, offsetof(jit_registers, bc));
+    emit_rm(&e, 0, 0x89, RDX, R15, NO_INDEX, 0, offsetof(jit_registers, de));
+    emit_rm(&e, 0, 0x89, RBX, R15, NO_INDEX, 0, offsetof(jit_registers, hl));
+    emit_rm(&e, 0, 0x89, R13, R15, NO_INDEX, 0, offsetof(jit_registers, sp));
+    emit8(&e, 0x41); emit8(&e, 0x58 + (R15 & 7));  // pop r15
+    emit8(&e, 0x41); emit8(&e, 0x58 + (R14 & 7));  // pop r14
+    emit8(&e, 0x41); emit8(&e, 0x58 + (R13 & 7));  // pop r13
+    emit8(&e, 0x41); emit8(&e, 0x58 + (R12 & 7));  // pop r12
+    emit8(&e, 0x58 + RBP);
+    emit8(&e, 0x58 + RBX);
+    emit8(&e, 0xC3);  // ret
+
+    // entry point: save the callee-saved registers we use and load the 8080 registers
+    entry = e.size;
+    emit8(&e, 0x50 + RBX);
+    emit8(&e, 0x50 + RBP);
+    emit8(&e, 0x41); emit8(&e, 0x50 + (R12 & 7));
+    emit8(&e, 0x41); emit8(&e, 0x50 + (R13 & 7));
+    emit8(&e, 0x41); emit8(&e, 0x50 + (R14 & 7));
+    emit8(&e, 0x41); emit8(&e, 0x50 + (R15 & 7));
+    emit_rr(&e, OP64, 0x89, RDI, R15);
+    emit_rm(&e, 0, 0x8B, RAX, R15, NO_INDEX, 0, offsetof(jit_registers, af));
+    emit_rm(&e, 0, 0x8B, RCX, R15, NO_INDEX, 0, offsetof(jit_registers, bc));
+    emit_rm(&e, 0, 0x8B, RDX, R15, NO_INDEX, 0, offsetof(jit_registers, de));
+    emit_rm(&e, 0, 0x8B, RBX, R15, NO_INDEX, 0, offsetof(jit_registers, hl));
+    emit_rm(&e, 0, 0x8B, R13, R15, NO_INDEX, 0, offsetof(jit_registers, sp));
+    emit_rm(&e, OP64, 0x8B, RBP, R15, NO_INDEX, 0, offsetof(jit_registers, memory));
+    emit_rm(&e, OP64, 0x8B, R12, R15, NO_INDEX, 0, offsetof(jit_registers, write_direct));
+    emit_rm(&e, OP64, 0x8B, R14, R15, NO_INDEX, 0, offsetof(jit_registers, code_map));
+    emit_rr(&e, 0, 0x31, R10, R10);  // xor r10d, r10d: states of the passes before this one
+    emit_rr(&e, 0, 0x31, R11, R11);  // and their instructions
+    e.start_pc = block->start_pc;
+    e.loop_start = e.size;
+
+    for (i = 0; i < block->num_instructions && !ends; i++) {
+        if (!is_translatable(block->instructions[i].bytes[0])) {
+            break;
+        }
+        emit_instruction(&e, &(block->instructions[i]), pc, states, i + 1, &instruction_states, &ends);
+        states += instruction_states;
+        pc += block->instructions[i].length;
+    }
+    if (!ends) {
+        // fell off the end of the block, or reached an instruction the interpreter has to run
+        emit_exit(&e, -1, pc, states, i, -1, 0, 0);
+    }
+    for (i = 0; i < e.num_exits; i++) {
+        patch_jump(&e, e.exits[i].jump_at);
+        emit_exit(&e, -1, e.exits[i].pc, e.exits[i].states, e.exits[i].instructions, e.exits[i].address_register,
+                  e.exits[i].address, e.exits[i].length);
+    }
+    if (e.overflow) {
+        return false;
+    }
+
+    block->native_code = e.code + entry;
+    block->native_max_states = states;
+    jit->buffer_used += (e.size + 15) & ~(size_t)15;
+    jit->blocks_translated++;
+    return true;
+}
+
+jit8080 *init_jit8080() {
+    jit8080 *jit = (jit8080 *) calloc(1, sizeof(jit8080));
+    if (jit == NULL) {
+        return NULL;
+    }
+    jit->buffer = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->buffer == MAP_FAILED) {
+        perror("Unable to map JIT buffer");
+        free(jit);
+        return NULL;
+    }
+    jit->writable = true;
+    return jit;
+}
+
+void destroy_jit8080(jit8080 **jit_ptr) {
+    if (*jit_ptr != NULL) {
+        munmap((*jit_ptr)->buffer, JIT_BUFFER_SIZE);
+        free(*jit_ptr);
+        *jit_ptr = NULL;
+    }
+}
+
+/* Runs translated blocks starting at cpu->pc for as long as there are translations for them and their states fit in
+   state_budget.  Blocks that are not translated yet get translated once they have been seen JIT_HOT_THRESHOLD times.
+   Sets num_states and num_instructions to what was executed, which is nothing if the block at pc is not translated; the
+   caller then runs it in the interpreter.  The caller must have checked that the CPU is not halted and that no EI is
+   pending.  Translated code can't fail, so this always returns true. */
+bool run_jit_cpu8080(motherboard8080 *motherboard, cpu8080 *cpu, uint64_t state_budget, uint64_t *num_states,
+                     uint64_t *num_instructions) {
+    jit8080 *jit = cpu->jit;
+    block_cache8080 *cache = cpu->block_cache;
+    cached_block *block;
+    jit_registers registers;
+
+    *num_states = 0;
+    *num_instructions = 0;
+
+    registers.af = (get_byte_from_flags(cpu) << 8) | cpu->a;
+    registers.bc = cpu->bc;
+    registers.de = cpu->de;
+    registers.hl = cpu->hl;
+    registers.sp = cpu->sp;
+    registers.pc = cpu->pc;
+    registers.memory = motherboard->memory;
+    registers.code_map = cache->code_map;
+    registers.write_direct = motherboard->memory_map->write_direct;
+
+    while (*num_states < state_budget) {
+        block = block_cache_lookup(cache, motherboard->memory_map, registers.pc);
+        if (block->native_code == NULL) {
+            // busy-wait candidates are left to run_cpu8080(), which can skip them
+            if (block->translation_failed || block->num_instructions == 0 || block->busy_wait_candidate) {
+                break;
+            }
+            block->executions++;
+            if (block->executions < JIT_HOT_THRESHOLD) {
+                break;
+            }
+            if (!translate_block(jit, cache, block)) {
+                block->translation_failed = true;
+                break;
+            }
+        }
+        if (block->native_max_states > state_budget - *num_states) {
+            // the interpreter can stop partway through the block
+            break;
+        }
+        if (!set_buffer_writable(jit, false)) {
+            break;
+        }
+        // capped so the states and instructions of all its passes fit in their 32-bit registers
+        registers.budget = state_budget - *num_states < (1u << 30) ? state_budget - *num_states : (1u << 30);
+        ((native_block) block->native_code)(&registers);
+        *num_states += registers.states;
+        *num_instructions += registers.instructions;
+        jit->native_blocks_run++;
+        if (registers.write_length == MAPPED_ACCESS) {
+            // the interpreter does the write
+            break;
+        }
+        if (registers.write_length > 0) {
+            block_cache_note_write(cache, (uint16_t)registers.write_address);
+            if (registers.write_length > 1) {
+                block_cache_note_write(cache, (uint16_t)(registers.write_address + 1));
+            }
+        }
+    }
+
+    if (*num_instructions > 0) {
+        cpu->a = registers.af & 0xFF;
+        set_flags_from_byte(cpu, registers.af >> 8);
+        cpu->bc = registers.bc;
+        cpu->de = registers.de;
+        cpu->hl = registers.hl;
+        cpu->sp = registers.sp;
+        cpu->pc = registers.pc;
+    }
+    return true;
+}
+
+#else
+
+jit8080 *init_jit8080() {
+    return NULL;
+}
+
+void destroy_jit8080(jit8080 **jit_ptr) {
+    *jit_ptr = NULL;
+}
+
+bool run_jit_cpu8080(motherboard8080 *motherboard, cpu8080 *cpu, uint64_t state_budget, uint64_t *num_states,
+                     uint64_t *num_instructions) {
+    *num_states = 0;
+    *num_instructions = 0;
+    return true;
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef JIT_8080_H
+#define JIT_8080_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "cpu8080.h"
+#include "motherboard.h"
+
+/* The JIT translates cached blocks that have been executed JIT_HOT_THRESHOLD times into x86-64 code.  It is only built on
+   x86-64 Unix; elsewhere init_jit8080() returns NULL and everything runs in the interpreter. */
+#if defined(__x86_64__) && defined(__unix__)
+#define CPU8080_HAS_JIT
+#endif
+
+#ifndef JIT_HOT_THRESHOLD
+#define JIT_HOT_THRESHOLD 16
+#endif
+
+// Size of the executable buffer.  When it fills up, every translation is thrown away and hot blocks are translated again.
+#define JIT_BUFFER_SIZE (4 * 1024 * 1024)
+
+typedef struct jit8080 {
+    /* mmap'd, and never writable and executable at the same time: translating a block makes it read/write, and running
+       a translation makes it read/execute again. */
+    uint8_t *buffer;
+    size_t buffer_used;
+    bool writable;
+
+    uint64_t blocks_translated;
+    uint64_t native_blocks_run;
+    uint64_t flushes;
+} jit8080;
+
+jit8080 *init_jit8080();
+void destroy_jit8080(jit8080 **jit_ptr);
+bool run_jit_cpu8080(motherboard8080 *motherboard, cpu8080 *cpu, uint64_t state_budget, uint64_t *num_states,
+                     uint64_t *num_instructions);
+
+#endif
@@ -1,8 +1,18 @@
+#define _GNU_SOURCE  // memfd_create()
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <string.h>
+#include <strings.h>
 #include "memory.h"
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Bytes past 0xFFFF that the operands of an instruction can be read from
+#define OPERAND_OVERRUN 2
 
 void handle_error(){
     perror("Fatal error");
@@ -22,30 +32,862 @@ void destroy_memory(uint8_t **memory_ptr) {
     free(*memory_ptr);
 }
 
-void load_rom(char *rom_name, int start_at, uint8_t *memory){
-    FILE *infile;
-    int i;
-    int byte;
-    bool done;
+/* An arena of size bytes, or NULL if there isn't the memory.  With huge_pages it is on huge pages if the system has
+   some reserved, and otherwise the kernel is asked for transparent huge pages. */
+memory_arena8080 *init_memory_arena(size_t size, bool huge_pages) {
+    memory_arena8080 *arena;
+    void *base = NULL;
 
-    infile = fopen(rom_name, "r");
-    if (infile == NULL) {
+    arena = (memory_arena8080 *) malloc(sizeof(memory_arena8080));
+    if (!arena) {
+        return NULL;
+    }
+    arena->used = 0;
+    arena->pages = ARENA_PAGES_NORMAL;
+#ifdef __linux__
+    if (huge_pages) {
+        size = (size + MEMORY_HUGE_PAGE_SIZE - 1) / MEMORY_HUGE_PAGE_SIZE * MEMORY_HUGE_PAGE_SIZE;
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (base == MAP_FAILED) {
+            base = NULL;
+        }
+        else {
+            arena->pages = ARENA_PAGES_HUGE;
+        }
+    }
+    if (base == NULL) {
+        // anonymous memory is zero until it is written, and takes up no memory until then either
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            free(arena);
+            return NULL;
+        }
+        if (huge_pages && madvise(base, size, MADV_HUGEPAGE) == 0) {
+            arena->pages = ARENA_PAGES_TRANSPARENT_HUGE;
+        }
+    }
+#else
+    size = (size + MEMORY_CACHE_LINE_SIZE - 1) / MEMORY_CACHE_LINE_SIZE * MEMORY_CACHE_LINE_SIZE;
+    base = aligned_alloc(MEMORY_CACHE_LINE_SIZE, size);
+    if (base == NULL) {
+        free(arena);
+        return NULL;
+    }
+    memset(base, 0, size);
+#endif
+    arena->base = (uint8_t *) base;
+    arena->size = size;
+    return arena;
+}
+
+// size bytes of zeroed memory from the arena, starting on a cache line, or NULL if the arena is full.  Not thread safe.
+void *memory_arena_alloc(memory_arena8080 *arena, size_t size) {
+    size_t start = (arena->used + MEMORY_CACHE_LINE_SIZE - 1) & ~((size_t) MEMORY_CACHE_LINE_SIZE - 1);
+
+    if (start > arena->size || size > arena->size - start) {
+        return NULL;
+    }
+    arena->used = start + size;
+    return &(arena->base[start]);
+}
+
+// Frees everything allocated from the arena.  Maps in it must have been destroyed first.
+void destroy_memory_arena(memory_arena8080 **arena_ptr) {
+    memory_arena8080 *arena = *arena_ptr;
+
+#ifdef __linux__
+    munmap(arena->base, arena->size);
+#else
+    free(arena->base);
+#endif
+    free(arena);
+    *arena_ptr = NULL;
+}
+
+#ifdef MEMORY_HAS_ALIASING
+static bool init_aliased_memory(memory_map8080 *map) {
+    long host_page_size = sysconf(_SC_PAGESIZE);
+    void *view, *backing;
+
+    if (host_page_size < MEMORY_PAGE_SIZE || (MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE) % host_page_size != 0) {
+        return false;
+    }
+    map->memfd = memfd_create("8080 memory", 0);
+    if (map->memfd < 0) {
+        return false;
+    }
+    if (ftruncate(map->memfd, MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE) != 0) {
+        close(map->memfd);
+        map->memfd = -1;
+        return false;
+    }
+    backing = mmap(NULL, MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, map->memfd, 0);
+    // Only reserves the address range; remap_host_pages() puts the memfd's pages in it.
+    view = mmap(NULL, MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE + host_page_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (backing == MAP_FAILED || view == MAP_FAILED) {
+        if (backing != MAP_FAILED) {
+            munmap(backing, MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE);
+        }
+        if (view != MAP_FAILED) {
+            munmap(view, MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE + host_page_size);
+        }
+        close(map->memfd);
+        map->memfd = -1;
+        return false;
+    }
+    map->backing = (uint8_t *) backing;
+    map->backing_size = MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE;
+    map->memory = (uint8_t *) view;
+    map->host_page_size = host_page_size;
+    return true;
+}
+
+static void map_host_pages(memory_map8080 *map, int fd, uint32_t address, uint32_t length, uint32_t offset,
+                           bool writable) {
+    int prot = PROT_READ | (writable ? PROT_WRITE : 0);
+    if (mmap(map->memory + address, length, prot, MAP_SHARED | MAP_FIXED, fd, offset) == MAP_FAILED) {
         handle_error();
     }
-    i = start_at;
-    done = false;
-    while (!done) {
-        byte = fgetc(infile);
-        if (byte == EOF) {
-            done = true;
+}
+#endif
+
+// Where in backing the memory page shows is.
+static uint32_t physical_offset(memory_map8080 *map, uint8_t page) {
+    uint32_t address;
+
+    if (map->aliased[page]) {
+        page = map->source_page[page];
+    }
+    address = page * MEMORY_PAGE_SIZE;
+    if (map->current_bank > 0 && map->bank_storage == NULL && address >= map->bank_start &&
+            address < map->bank_start + map->bank_length) {
+        return MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE + (map->current_bank - 1) * map->bank_length + address - map->bank_start;
+    }
+    return address;
+}
+
+// Whether page shows the shared ROM image rather than memory of the map's own.
+static bool shows_rom_image(memory_map8080 *map, uint8_t page) {
+    uint32_t address;
+
+    if (map->rom_image == NULL) {
+        return false;
+    }
+    if (map->aliased[page]) {
+        page = map->source_page[page];
+    }
+    address = page * MEMORY_PAGE_SIZE;
+    return address >= map->rom_image_start && address < map->rom_image_start + map->rom_image->length;
+}
+
+// Where the contents of page can be read, however the view is mapped.
+static uint8_t *page_contents(memory_map8080 *map, uint8_t page) {
+    if (shows_rom_image(map, page)) {
+        if (map->aliased[page]) {
+            page = map->source_page[page];
+        }
+        return &(map->rom_image->data[page * MEMORY_PAGE_SIZE - map->rom_image_start]);
+    }
+    return &(map->backing[physical_offset(map, page)]);
+}
+
+/* Points the host pages of the view from start to start + length at the physical memory they show.  A host page is
+   read-only if everything on it is ROM. */
+static void remap_host_pages(memory_map8080 *map, uint32_t start, uint32_t length) {
+#ifdef MEMORY_HAS_ALIASING
+    uint32_t host_page, end, first, page, offset, pages_per_host_page, run_address, run_length, run_offset;
+    int fd, run_fd;
+    bool writable, run_writable;
+
+    if (map->memfd < 0) {
+        return;
+    }
+    pages_per_host_page = map->host_page_size / MEMORY_PAGE_SIZE;
+    end = (start + length + map->host_page_size - 1) / map->host_page_size;
+    run_length = 0;
+    run_address = run_offset = 0;
+    run_fd = -1;
+    run_writable = false;
+    // Host pages that continue the previous one in the memfd with the same protection share one mmap() call, so that
+    // a bank switch costs one system call rather than one per host page.
+    for (host_page = start / map->host_page_size; host_page < end; host_page++) {
+        first = host_page * pages_per_host_page;
+        if (shows_rom_image(map, first)) {
+            fd = map->rom_image->memfd;
+            offset = page_contents(map, first) - map->rom_image->data;
         }
         else {
-            memory[i] = (uint8_t) byte;
-            i++;
+            fd = map->memfd;
+            offset = physical_offset(map, first);
         }
+        writable = false;
+        for (page = first; page < first + pages_per_host_page; page++) {
+            if (map->page_type[map->source_page[page]] != PAGE_ROM) {
+                writable = true;
+            }
+        }
+        if (host_page == 0) {
+            map_host_pages(map, fd, MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE, map->host_page_size, offset, writable);
+        }
+        if (run_length > 0 && fd == run_fd && writable == run_writable && offset == run_offset + run_length) {
+            run_length += map->host_page_size;
+            continue;
+        }
+        if (run_length > 0) {
+            map_host_pages(map, run_fd, run_address, run_length, run_offset, run_writable);
+        }
+        run_fd = fd;
+        run_address = first * MEMORY_PAGE_SIZE;
+        run_length = map->host_page_size;
+        run_offset = offset;
+        run_writable = writable;
+    }
+    if (run_length > 0) {
+        map_host_pages(map, run_fd, run_address, run_length, run_offset, run_writable);
     }
+#endif
+}
 
+// A map of 64K of RAM.
+memory_map8080 *init_memory_map() {
+    return init_memory_map_in_arena(NULL);
+}
+
+/* A map of 64K of RAM allocated from arena, or from the heap if arena is NULL.  Running out of either is fatal.  The
+   memfd memory that aliasing uses is never in the arena. */
+memory_map8080 *init_memory_map_in_arena(memory_arena8080 *arena) {
+    memory_map8080 *map;
+    int page;
+
+    if (arena != NULL) {
+        map = (memory_map8080 *) memory_arena_alloc(arena, sizeof(memory_map8080));
+    }
+    else {
+        map = (memory_map8080 *) malloc(sizeof(memory_map8080));
+    }
+    if (!map) {
+        errno = ENOMEM;
+        handle_error();
+    }
+    map->in_arena = (arena != NULL);
+    map->memfd = -1;
+    map->host_page_size = MEMORY_PAGE_SIZE;
+    map->bank_start = 0;
+    map->bank_length = 0;
+    map->num_banks = 1;
+    map->current_bank = 0;
+    map->bank_storage = NULL;
+    map->bank_switches = 0;
+    map->rom_image = NULL;
+    map->rom_image_start = 0;
+    map->dirty_start = 0;
+    map->dirty_length = 0;
+    memset(map->dirty_lines, 0, sizeof(map->dirty_lines));
+#ifdef MEMORY_HAS_ALIASING
+    init_aliased_memory(map);
+#endif
+    /* Without aliasing nothing shows 0x0000 after 0xFFFF, but the operands of an instruction at 0xFFFE or 0xFFFF are
+       still read from there, so the memory has OPERAND_OVERRUN zeroed bytes more. */
+    if (map->memfd < 0 && arena != NULL) {
+        map->memory = (uint8_t *) memory_arena_alloc(arena, MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE + OPERAND_OVERRUN);
+        if (map->memory == NULL) {
+            errno = ENOMEM;
+            handle_error();
+        }
+        map->backing = map->memory;
+        map->backing_size = MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE;
+    }
+    else if (map->memfd < 0) {
+        map->memory = init_memory(MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE + OPERAND_OVERRUN);
+        map->backing = map->memory;
+        map->backing_size = MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE;
+        memset(map->backing, 0, MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE + OPERAND_OVERRUN);
+    }
+    // A new memfd is already zero, and only the pages that are written take up memory.
+    for (page = 0; page < MEMORY_NUM_PAGES; page++) {
+        map->page_type[page] = PAGE_RAM;
+        map->source_page[page] = page;
+        map->next_view[page] = page;
+        map->aliased[page] = false;
+        map->write_direct[page] = true;
+        map->read_direct[page] = true;
+    }
+    remap_host_pages(map, 0, MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE);
+    return map;
+}
+
+void destroy_memory_map(memory_map8080 **map_ptr) {
+    memory_map8080 *map = *map_ptr;
+
+    free(map->bank_storage);
+    if (map->rom_image != NULL) {
+        release_rom_image(&(map->rom_image));
+    }
+#ifdef MEMORY_HAS_ALIASING
+    if (map->memfd >= 0) {
+        munmap(map->memory, MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE + map->host_page_size);
+        munmap(map->backing, map->backing_size);
+        close(map->memfd);
+    }
+#endif
+    // the arena frees its memory all at once
+    if (!(map->in_arena)) {
+        if (map->memfd < 0) {
+            destroy_memory(&(map->memory));
+        }
+        free(map);
+    }
+    *map_ptr = NULL;
+}
+
+static bool tracks_page(memory_map8080 *map, uint8_t page) {
+    return (uint16_t)(page * MEMORY_PAGE_SIZE - map->dirty_start) < map->dirty_length;
+}
+
+/* A write to the source page is a single store if it is RAM and every other view of it is aliased.  Other views of a
+   page whose writes are tracked are never direct, since only the source page's address is in the tracked range.  A read
+   is a load unless it is I/O. */
+static void update_direct_flags(memory_map8080 *map, uint8_t source) {
+    uint8_t page = source;
+    bool direct = (map->page_type[source] == PAGE_RAM);
+    bool tracked = tracks_page(map, source);
+
+    do {
+        if (page != source && !(map->aliased[page])) {
+            direct = false;
+        }
+        page = map->next_view[page];
+    } while (page != source);
+    do {
+        map->write_direct[page] = direct && (page == source || !tracked);
+        map->read_direct[page] = (map->page_type[source] != PAGE_IO);
+        page = map->next_view[page];
+    } while (page != source);
+}
+
+/* Turns the aliased pages on the host page holding page into copies, since a host page is aliased all or nothing.  The
+   view still shows the old mapping until remap_host_pages(). */
+static void unalias_host_page(memory_map8080 *map, uint8_t page) {
+    uint32_t pages_per_host_page = map->host_page_size / MEMORY_PAGE_SIZE;
+    uint32_t first = page - page % pages_per_host_page, i;
+
+    for (i = first; i < first + pages_per_host_page; i++) {
+        if (map->aliased[i]) {
+            memcpy(&(map->backing[i * MEMORY_PAGE_SIZE]), page_contents(map, i), MEMORY_PAGE_SIZE);
+            map->aliased[i] = false;
+            update_direct_flags(map, map->source_page[i]);
+        }
+    }
+}
+
+static void unmap_page(memory_map8080 *map, uint8_t page) {
+    if (map->aliased[page]) {
+        unalias_host_page(map, page);
+    }
+    map->page_type[page] = PAGE_UNMAPPED;
+    map->source_page[page] = page;
+    map->next_view[page] = page;
+    map->write_direct[page] = false;
+    map->read_direct[page] = true;
+    memset(&(map->backing[page * MEMORY_PAGE_SIZE]), 0xFF, MEMORY_PAGE_SIZE);
+}
+
+/* Takes page out of the list of pages showing its source page.  If it is the source page, the mirrors of it have nothing
+   left to show and become unmapped. */
+static void detach_page(memory_map8080 *map, uint8_t page) {
+    uint8_t source, view, next;
+
+    if (map->aliased[page]) {
+        unalias_host_page(map, page);
+    }
+    source = map->source_page[page];
+    if (source != page) {
+        view = source;
+        while (map->next_view[view] != page) {
+            view = map->next_view[view];
+        }
+        map->next_view[view] = map->next_view[page];
+        map->source_page[page] = page;
+        map->next_view[page] = page;
+        update_direct_flags(map, source);
+    }
+    else {
+        view = map->next_view[page];
+        while (view != page) {
+            next = map->next_view[view];
+            unmap_page(map, view);
+            view = next;
+        }
+        map->next_view[page] = page;
+    }
+}
+
+// Gives the map its own copy of the ROM image it shares, before something changes one of the image's pages.
+static void unshare_rom_image(memory_map8080 *map) {
+    if (map->rom_image == NULL) {
+        return;
+    }
+    memcpy(&(map->backing[map->rom_image_start]), map->rom_image->data, map->rom_image->length);
+    release_rom_image(&(map->rom_image));
+    remap_host_pages(map, 0, MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE);
+}
+
+static bool overlaps_rom_image(memory_map8080 *map, uint16_t start, uint32_t length) {
+    return map->rom_image != NULL && start < map->rom_image_start + map->rom_image->length &&
+           map->rom_image_start < start + length;
+}
+
+/* Makes the pages from start to start + length RAM, ROM, I/O or unmapped.  RAM and ROM pages keep what is in memory; ROM
+   may be read-only afterwards, so load ROM images first.  Unmapped pages read 0xFF.  start and length are multiples of
+   MEMORY_PAGE_SIZE. */
+void map_memory_pages(memory_map8080 *map, uint16_t start, uint32_t length, memory_page_type type) {
+    uint32_t page;
+
+    if (overlaps_rom_image(map, start, length)) {
+        unshare_rom_image(map);
+    }
+    for (page = start / MEMORY_PAGE_SIZE; page < (start + length) / MEMORY_PAGE_SIZE; page++) {
+        detach_page(map, page);
+        if (type == PAGE_UNMAPPED || type == PAGE_MIRROR) {
+            unmap_page(map, page);
+        }
+        else {
+            map->page_type[page] = type;
+            map->write_direct[page] = (type == PAGE_RAM);
+            map->read_direct[page] = (type != PAGE_IO);
+        }
+    }
+    remap_host_pages(map, 0, MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE);
+}
+
+/* Makes the pages from start to start + length show the source_length bytes from source, repeated as often as it takes.
+   The source pages must already be mapped and loaded, since a mirror that can't be aliased gets a copy of them. */
+void mirror_memory_pages(memory_map8080 *map, uint16_t start, uint32_t length, uint16_t source,
+                         uint32_t source_length) {
+    uint32_t page, first, i, num_source_pages = source_length / MEMORY_PAGE_SIZE;
+    uint32_t pages_per_host_page = map->host_page_size / MEMORY_PAGE_SIZE;
+    uint8_t source_page;
+    bool alias;
+
+    if (overlaps_rom_image(map, start, length)) {
+        unshare_rom_image(map);
+    }
+    for (page = start / MEMORY_PAGE_SIZE, i = 0; page < (start + length) / MEMORY_PAGE_SIZE; page++, i++) {
+        detach_page(map, page);
+        source_page = map->source_page[source / MEMORY_PAGE_SIZE + i % num_source_pages];
+        map->page_type[page] = PAGE_MIRROR;
+        map->source_page[page] = source_page;
+        map->next_view[page] = map->next_view[source_page];
+        map->next_view[source_page] = page;
+        memcpy(&(map->backing[page * MEMORY_PAGE_SIZE]), page_contents(map, source_page), MEMORY_PAGE_SIZE);
+    }
+
+    // Alias every host page that lies inside the mirror and shows one whole host page of source.
+    if (map->memfd >= 0) {
+        for (first = start / MEMORY_PAGE_SIZE; first + pages_per_host_page <= (start + length) / MEMORY_PAGE_SIZE;
+             first++) {
+            if (first % pages_per_host_page != 0 || map->source_page[first] % pages_per_host_page != 0) {
+                continue;
+            }
+            alias = true;
+            for (i = 1; i < pages_per_host_page; i++) {
+                if (map->source_page[first + i] != map->source_page[first] + i) {
+                    alias = false;
+                }
+            }
+            for (i = 0; alias && i < pages_per_host_page; i++) {
+                map->aliased[first + i] = true;
+            }
+        }
+    }
+    for (page = start / MEMORY_PAGE_SIZE; page < (start + length) / MEMORY_PAGE_SIZE; page++) {
+        update_direct_flags(map, map->source_page[page]);
+    }
+    remap_host_pages(map, 0, MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE);
+}
+
+/* Tracks writes to the length bytes from start, which are multiples of MEMORY_PAGE_SIZE, in place of any range tracked
+   before.  Every line starts out dirty.  Mirrors of the range made later are not direct pages either. */
+void track_memory_writes(memory_map8080 *map, uint16_t start, uint32_t length) {
+    int page;
+
+    map->dirty_start = start;
+    map->dirty_length = length;
+    memset(map->dirty_lines, 0xFF, sizeof(map->dirty_lines));
+    for (page = 0; page < MEMORY_NUM_PAGES; page++) {
+        if (map->source_page[page] == page) {
+            update_direct_flags(map, page);
+        }
+    }
+}
+
+void clear_dirty_lines(memory_map8080 *map) {
+    memset(map->dirty_lines, 0, ((map->dirty_length + MEMORY_DIRTY_LINE_SIZE * 8 - 1) / (MEMORY_DIRTY_LINE_SIZE * 8)));
+}
+
+/* Makes the length bytes from start into num_banks banks of RAM, all zeroed except bank 0, which is what is there now.
+   Bank 0 is selected.  The pages must be plain RAM that isn't mirrored, and must stay that way.  Returns false if they
+   aren't, if there already are banks, or if there is no memory for them. */
+bool init_memory_banks(memory_map8080 *map, uint16_t start, uint32_t length, int num_banks) {
+    uint32_t page;
+#ifdef MEMORY_HAS_ALIASING
+    size_t backing_size;
+    void *backing;
+#endif
+
+    if (map->num_banks > 1 || num_banks < 1 || length == 0 || start % MEMORY_PAGE_SIZE != 0 ||
+            length % MEMORY_PAGE_SIZE != 0 || start + length > MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE) {
+        printf("Invalid memory banks: %d banks of 0x%X bytes at 0x%04X\n", num_banks, length, start);
+        return false;
+    }
+    for (page = start / MEMORY_PAGE_SIZE; page < (start + length) / MEMORY_PAGE_SIZE; page++) {
+        if (map->page_type[page] != PAGE_RAM || map->next_view[page] != page) {
+            printf("Memory banks at 0x%04X must be plain RAM\n", start);
+            return false;
+        }
+    }
+
+#ifdef MEMORY_HAS_ALIASING
+    if (map->memfd >= 0 && start % map->host_page_size == 0 && length % map->host_page_size == 0) {
+        // the other banks go after the 64K in the memfd
+        backing_size = MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE + (size_t)(num_banks - 1) * length;
+        if (ftruncate(map->memfd, backing_size) != 0) {
+            perror("Unable to allocate memory banks");
+            return false;
+        }
+        backing = mmap(NULL, backing_size, PROT_READ | PROT_WRITE, MAP_SHARED, map->memfd, 0);
+        if (backing == MAP_FAILED) {
+            perror("Unable to allocate memory banks");
+            return false;
+        }
+        munmap(map->backing, map->backing_size);
+        map->backing = (uint8_t *) backing;
+        map->backing_size = backing_size;
+    }
+    else
+#endif
+    {
+        map->bank_storage = (uint8_t *) calloc(num_banks, length);
+        if (map->bank_storage == NULL) {
+            perror("Unable to allocate memory banks");
+            return false;
+        }
+    }
+    map->bank_start = start;
+    map->bank_length = length;
+    map->num_banks = num_banks;
+    map->current_bank = 0;
+    return true;
+}
+
+// Switches the banked range to bank.  Returns false if there is no such bank.
+bool select_memory_bank(memory_map8080 *map, int bank) {
+    if (bank < 0 || bank >= map->num_banks) {
+        return false;
+    }
+    if (bank == map->current_bank) {
+        return true;
+    }
+    if (map->bank_storage != NULL) {
+        memcpy(&(map->bank_storage[map->current_bank * map->bank_length]), &(map->backing[map->bank_start]),
+               map->bank_length);
+        memcpy(&(map->backing[map->bank_start]), &(map->bank_storage[bank * map->bank_length]), map->bank_length);
+        map->current_bank = bank;
+    }
+    else {
+        map->current_bank = bank;
+        remap_host_pages(map, map->bank_start, map->bank_length);
+    }
+    if (map->dirty_length > 0 && map->dirty_start < map->bank_start + map->bank_length &&
+            map->bank_start < map->dirty_start + map->dirty_length) {
+        memset(map->dirty_lines, 0xFF, sizeof(map->dirty_lines));
+    }
+    map->bank_switches++;
+    return true;
+}
+
+/* Writes value at address whatever the page is, for the debugger: ROM takes it too, and every view of the page shows it.
+   The caller tells the block cache. */
+void poke_memory(memory_map8080 *map, uint16_t address, uint8_t value) {
+    uint8_t source = map->source_page[address >> 8];
+    uint8_t page = source;
+
+    if (shows_rom_image(map, source)) {
+        unshare_rom_image(map);
+    }
+    note_memory_write(map, (source << 8) | (address & 0xFF));
+    do {
+        if (!(map->aliased[page])) {
+            map->backing[physical_offset(map, page) + (address & 0xFF)] = value;
+        }
+        page = map->next_view[page];
+    } while (page != source);
+}
+
+/* A zeroed ROM image of length bytes, to load with load_rom() into its data and then seal_rom_image().  The caller holds
+   the first reference to it. */
+rom_image8080 *init_rom_image(uint32_t length) {
+    rom_image8080 *image;
+#ifdef MEMORY_HAS_ALIASING
+    long host_page_size = sysconf(_SC_PAGESIZE);
+    void *data;
+#endif
+
+    image = (rom_image8080 *) malloc(sizeof(rom_image8080));
+    if (!image) {
+        handle_error();
+    }
+    image->length = length;
+    image->size = length;
+    image->memfd = -1;
+    atomic_init(&(image->references), 1);
+#ifdef MEMORY_HAS_ALIASING
+    image->size = (length + host_page_size - 1) / host_page_size * host_page_size;
+    image->memfd = memfd_create("8080 ROM", 0);
+    if (image->memfd >= 0 && ftruncate(image->memfd, image->size) == 0) {
+        data = mmap(NULL, image->size, PROT_READ | PROT_WRITE, MAP_SHARED, image->memfd, 0);
+        if (data != MAP_FAILED) {
+            image->data = (uint8_t *) data;
+            return image;
+        }
+    }
+    if (image->memfd >= 0) {
+        close(image->memfd);
+        image->memfd = -1;
+    }
+    image->size = length;
+#endif
+    image->data = (uint8_t *) calloc(1, length);
+    if (!image->data) {
+        handle_error();
+    }
+    return image;
+}
+
+// Makes the image read-only, once it is loaded.
+void seal_rom_image(rom_image8080 *image) {
+#ifdef MEMORY_HAS_ALIASING
+    if (image->memfd >= 0) {
+        mprotect(image->data, image->size, PROT_READ);
+    }
+#endif
+}
+
+// Drops a reference to the image, freeing it with the last one.  The maps it is mapped into hold a reference each.
+void release_rom_image(rom_image8080 **image_ptr) {
+    rom_image8080 *image = *image_ptr;
+
+    *image_ptr = NULL;
+    if (atomic_fetch_sub(&(image->references), 1) != 1) {
+        return;
+    }
+#ifdef MEMORY_HAS_ALIASING
+    if (image->memfd >= 0) {
+        munmap(image->data, image->size);
+        close(image->memfd);
+        free(image);
+        return;
+    }
+#endif
+    free(image->data);
+    free(image);
+}
+
+/* Makes the pages from start to start + image->length ROM showing the image, which should be sealed.  The map shares the
+   image if it can, and otherwise copies it.  A map shares one image at most; mapping another copies the first. */
+void map_rom_image(memory_map8080 *map, uint16_t start, rom_image8080 *image) {
+    unshare_rom_image(map);
+    map_memory_pages(map, start, image->length, PAGE_ROM);
+    if (map->memfd >= 0 && image->memfd >= 0 && start % map->host_page_size == 0 &&
+            image->length % map->host_page_size == 0) {
+        atomic_fetch_add(&(image->references), 1);
+        map->rom_image = image;
+        map->rom_image_start = start;
+        remap_host_pages(map, start, image->length);
+    }
+    else {
+        memcpy(&(map->backing[start]), image->data, image->length);
+    }
+}
+
+#define ROTATE_LEFT(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static uint32_t rom_crc32(const uint8_t *data, size_t length) {
+    uint32_t crc = 0xFFFFFFFF;
+    size_t i;
+    int bit;
+
+    for (i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static void sha1_block(uint32_t hash[5], const uint8_t *block) {
+    uint32_t w[80], a, b, c, d, e, f, k, temp;
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) | ((uint32_t)block[i * 4 + 2] << 8) |
+               block[i * 4 + 3];
+    }
+    for (i = 16; i < 80; i++) {
+        w[i] = ROTATE_LEFT(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    a = hash[0];
+    b = hash[1];
+    c = hash[2];
+    d = hash[3];
+    e = hash[4];
+    for (i = 0; i < 80; i++) {
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        }
+        else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        }
+        else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        }
+        else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        temp = ROTATE_LEFT(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = ROTATE_LEFT(b, 30);
+        b = a;
+        a = temp;
+    }
+    hash[0] += a;
+    hash[1] += b;
+    hash[2] += c;
+    hash[3] += d;
+    hash[4] += e;
+}
+
+// The SHA1 of data as 40 lower case hex digits.
+static void rom_sha1(const uint8_t *data, size_t length, char *text) {
+    uint32_t hash[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    uint64_t bits = (uint64_t)length * 8;
+    uint8_t block[64];
+    size_t i, rest;
+    int j;
+
+    for (i = 0; i + 64 <= length; i += 64) {
+        sha1_block(hash, &(data[i]));
+    }
+    // the padding: a 1 bit, zeros, and the length in bits, taking a block more if the length doesn't fit
+    rest = length - i;
+    memset(block, 0, sizeof(block));
+    memcpy(block, &(data[i]), rest);
+    block[rest] = 0x80;
+    if (rest >= 56) {
+        sha1_block(hash, block);
+        memset(block, 0, sizeof(block));
+    }
+    for (j = 0; j < 8; j++) {
+        block[63 - j] = (uint8_t)(bits >> (8 * j));
+    }
+    sha1_block(hash, block);
+    for (j = 0; j < 20; j++) {
+        sprintf(&(text[j * 2]), "%02x", (hash[j / 4] >> (24 - 8 * (j % 4))) & 0xFF);
+    }
+}
+
+/*
+Checks the length bytes loaded from rom_name against its line in the ROM set manifest.  Each line of a manifest is a
+file name, its size in bytes, its CRC32 in hex and optionally its SHA1 in hex, separated by spaces, e.g.
+
+    game.rom 2048 1c291ca3 4a3e6f5bd2b0e3f1e9c5e0d3a7c8b4f6e2d1a9c0
+
+Lines starting with # are comments.  A ROM that isn't listed, or a manifest that doesn't exist, passes.
+*/
+static bool verify_rom(char *manifest_name, char *rom_name, uint8_t *data, size_t length) {
+    FILE *manifest;
+    char line[256], name[128], expected_sha1[41], actual_sha1[41];
+    char *base_name;
+    unsigned long size;
+    unsigned int crc;
+    int fields;
+
+    manifest = fopen(manifest_name, "r");
+    if (manifest == NULL) {
+        return true;
+    }
+    base_name = strrchr(rom_name, '/');
+    base_name = (base_name == NULL) ? rom_name : base_name + 1;
+    while (fgets(line, sizeof(line), manifest) != NULL) {
+        if (line[0] == '#') {
+            continue;
+        }
+        fields = sscanf(line, "%127s %lu %x %40s", name, &size, &crc, expected_sha1);
+        if (fields < 3 || strcmp(name, base_name) != 0) {
+            continue;
+        }
+        fclose(manifest);
+        if (size != length) {
+            printf("%s is %zu bytes, but %s says %lu\n", rom_name, length, manifest_name, size);
+            return false;
+        }
+        if (rom_crc32(data, length) != crc) {
+            printf("%s has CRC32 %08x, but %s says %08x\n", rom_name, rom_crc32(data, length), manifest_name, crc);
+            return false;
+        }
+        if (fields == 4) {
+            rom_sha1(data, length, actual_sha1);
+            if (strcasecmp(actual_sha1, expected_sha1) != 0) {
+                printf("%s has SHA1 %s, but %s says %s\n", rom_name, actual_sha1, manifest_name, expected_sha1);
+                return false;
+            }
+        }
+        return true;
+    }
+    fclose(manifest);
+    return true;
+}
+
+/* Loads the file rom_name into memory at start_at, in one read.  memory_size is the size of memory, and the file has to
+   fit in it.  If manifest_name isn't NULL, the file is checked against that ROM set manifest (see verify_rom()).
+   Returns false, having said why, if the file can't be read, doesn't fit, or doesn't match; in the last case it has
+   already been copied into memory. */
+bool load_rom(char *rom_name, uint32_t start_at, uint8_t *memory, size_t memory_size, char *manifest_name) {
+    FILE *infile;
+    long length;
+
+    infile = fopen(rom_name, "rb");
+    if (infile == NULL) {
+        perror(rom_name);
+        return false;
+    }
+    if (fseek(infile, 0, SEEK_END) != 0 || (length = ftell(infile)) < 0 || fseek(infile, 0, SEEK_SET) != 0) {
+        perror(rom_name);
+        fclose(infile);
+        return false;
+    }
+    if (start_at > memory_size || (size_t)length > memory_size - start_at) {
+        printf("%s is %ld bytes, which doesn't fit in the 0x%zX bytes from 0x%04X\n", rom_name, length,
+               (start_at > memory_size) ? 0 : memory_size - start_at, start_at);
+        fclose(infile);
+        return false;
+    }
+    if (fread(&(memory[start_at]), 1, length, infile) != (size_t)length) {
+        printf("Unable to read %s\n", rom_name);
+        fclose(infile);
+        return false;
+    }
     fclose(infile);
+    if (manifest_name != NULL) {
+        return verify_rom(manifest_name, rom_name, &(memory[start_at]), length);
+    }
+    return true;
 }
 
 void load_cpm_shim(uint8_t *memory) {
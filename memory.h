@@ -2,10 +2,159 @@
 #define MEMORY_8080_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/*
+The 64K address space is split into 256-byte pages, each of which is RAM, ROM, a mirror of another page, I/O or
+unmapped.  Every page has a slot in one contiguous 64K view, and only reads and writes that land on a page where
+read_direct or write_direct is false need the map.  An unmapped page holds 0xFF.  Reads and writes of an I/O page go to
+handlers on the motherboard (see map_memory_io()); code can't be run from one.
+
+Where the OS allows it (MEMORY_HAS_ALIASING), the view is built out of a memfd: a mirror is the same physical memory
+mapped again, so a write shows up in every view at no cost, and ROM is mapped read-only.  This works a host page at a
+time, so a mirror that is not aligned to host pages, and every mirror without MEMORY_HAS_ALIASING, holds a copy of the
+page it shows instead, and writes to that page go through the map to keep the copy in step.
+
+One range of RAM pages can be banked (see init_memory_banks()), for machines with more than 64K.  Switching banks remaps
+the range's host pages to another part of the memfd, or without aliasing copies the range out and the new bank in.
+
+A ROM image (see init_rom_image()) is loaded once and can then be mapped into any number of machines with
+map_rom_image().  With aliasing, every machine maps the image's own memfd read-only, so the ROM is in host memory once
+and a machine's memfd only ever holds what it writes; without aliasing, or at an address that is not host page aligned,
+each machine gets a copy.  Anything that changes a shared ROM page, like the debugger, gives the machine its own copy
+of the image first.
+
+One range can have its writes tracked (see track_memory_writes()), for video memory: a bitmap records which
+MEMORY_DIRTY_LINE_SIZE byte lines of it were written since the bitmap was last cleared.  Every write to a direct page
+checks the range, which is a subtraction and a compare; the other views of tracked pages are not direct, so that a
+write through a mirror is seen too.
+
+A memory arena (see init_memory_arena()) holds the state of many machines in one allocation, optionally on huge pages,
+and is freed all at once.  Maps, block caches and whatever else a host allocates from it are cache line aligned, and a
+host that allocates one machine at a time gets each machine's state next to each other.
+*/
+#define MEMORY_PAGE_SIZE 0x100
+#define MEMORY_NUM_PAGES 0x100
+#define MEMORY_CACHE_LINE_SIZE 64
+#define MEMORY_DIRTY_LINE_SIZE 32
+#define MEMORY_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+#if defined(__linux__) && !defined(MEMORY_USE_MALLOC)
+#define MEMORY_HAS_ALIASING
+#endif
+
+typedef enum memory_page_type {
+    PAGE_RAM,
+    PAGE_ROM,
+    PAGE_MIRROR,
+    PAGE_IO,
+    PAGE_UNMAPPED
+} memory_page_type;
+
+typedef enum memory_arena_pages {
+    ARENA_PAGES_NORMAL,
+    ARENA_PAGES_TRANSPARENT_HUGE,  // normal pages that the kernel has been asked to back with huge pages
+    ARENA_PAGES_HUGE
+} memory_arena_pages;
+
+typedef struct memory_arena8080 {
+    uint8_t *base;  // zeroed, and never handed out twice, so allocations start out zero
+    size_t size;
+    size_t used;
+    memory_arena_pages pages;
+} memory_arena8080;
+
+typedef struct rom_image8080 {
+    uint8_t *data;     // writable until seal_rom_image()
+    uint32_t length;
+    size_t size;       // length rounded up to a whole host page
+    int memfd;         // -1 without aliasing
+    atomic_int references;
+} rom_image8080;
+
+typedef struct memory_map8080 {
+    /* The 64K view.  With aliasing its first host page is mapped again after it, so an instruction's operands can be read
+       past 0xFFFF. */
+    uint8_t *memory;
+    uint8_t *backing;  // the physical memory, always writable; the same as memory without aliasing
+    size_t backing_size;
+    int memfd;         // -1 without aliasing
+    size_t host_page_size;
+    bool in_arena;     // the map, and without aliasing memory, belong to a memory arena
+
+    // The banked range; num_banks is 1 if there isn't one
+    uint16_t bank_start;
+    uint32_t bank_length;
+    int num_banks;
+    int current_bank;
+    uint8_t *bank_storage;  // every bank's contents, when banks are switched by copying; NULL when they are remapped
+    uint64_t bank_switches;
+
+    // The ROM image shared with other machines, if any, mapped from rom_image_start; NULL if the map has none
+    rom_image8080 *rom_image;
+    uint16_t rom_image_start;
+
+    uint8_t page_type[MEMORY_NUM_PAGES];
+    // The page whose contents a page shows: itself, except for mirror pages.
+    uint8_t source_page[MEMORY_NUM_PAGES];
+    // Circular list of the pages that show the same source page, starting from the source page.
+    uint8_t next_view[MEMORY_NUM_PAGES];
+    // Mirror pages that are the source page's memory mapped again rather than a copy of it.
+    bool aliased[MEMORY_NUM_PAGES];
+    // Pages where a write is a single store into memory: RAM, or a view of RAM, with no copies to keep in step.
+    bool write_direct[MEMORY_NUM_PAGES];
+    // Pages where a read is a load from memory: everything but I/O.  The JIT relies on this following write_direct.
+    bool read_direct[MEMORY_NUM_PAGES];
+
+    // The range whose writes are tracked, and a bit per line of it that is set when the line is written.  dirty_length
+    // is 0 if nothing is tracked.  The JIT finds these from write_direct too.
+    uint32_t dirty_start;
+    uint32_t dirty_length;
+    uint8_t dirty_lines[MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE / MEMORY_DIRTY_LINE_SIZE / 8];
+} memory_map8080;
 
 uint8_t *init_memory(int memsize);
 void destroy_memory(uint8_t **memory_ptr);
-void load_rom(char *rom_name, int start_at, uint8_t *memory);
+memory_arena8080 *init_memory_arena(size_t size, bool huge_pages);
+void *memory_arena_alloc(memory_arena8080 *arena, size_t size);
+void destroy_memory_arena(memory_arena8080 **arena_ptr);
+memory_map8080 *init_memory_map();
+memory_map8080 *init_memory_map_in_arena(memory_arena8080 *arena);
+void destroy_memory_map(memory_map8080 **map_ptr);
+void map_memory_pages(memory_map8080 *map, uint16_t start, uint32_t length, memory_page_type type);
+void mirror_memory_pages(memory_map8080 *map, uint16_t start, uint32_t length, uint16_t source,
+                         uint32_t source_length);
+bool init_memory_banks(memory_map8080 *map, uint16_t start, uint32_t length, int num_banks);
+bool select_memory_bank(memory_map8080 *map, int bank);
+void poke_memory(memory_map8080 *map, uint16_t address, uint8_t value);
+void track_memory_writes(memory_map8080 *map, uint16_t start, uint32_t length);
+void clear_dirty_lines(memory_map8080 *map);
+rom_image8080 *init_rom_image(uint32_t length);
+void seal_rom_image(rom_image8080 *image);
+void release_rom_image(rom_image8080 **image_ptr);
+void map_rom_image(memory_map8080 *map, uint16_t start, rom_image8080 *image);
+// Called on every write to a direct page, with the address of the page the write lands in.
+static inline void note_memory_write(memory_map8080 *map, uint16_t address) {
+    uint32_t offset = (uint16_t)(address - map->dirty_start);
+
+    if (offset < map->dirty_length) {
+        offset /= MEMORY_DIRTY_LINE_SIZE;
+        map->dirty_lines[offset >> 3] |= (1 << (offset & 0x7));
+    }
+}
+
+// Whether the line'th line of the tracked range was written since clear_dirty_lines() or clear_dirty_line().
+static inline bool memory_line_dirty(memory_map8080 *map, uint32_t line) {
+    return (map->dirty_lines[line >> 3] >> (line & 0x7)) & 1;
+}
+
+static inline void clear_dirty_line(memory_map8080 *map, uint32_t line) {
+    map->dirty_lines[line >> 3] &= ~(1 << (line & 0x7));
+}
+
+bool load_rom(char *rom_name, uint32_t start_at, uint8_t *memory, size_t memory_size, char *manifest_name);
 void load_cpm_shim(uint8_t *memory);
 
-#endif
\ No newline at end of file
+#endif
@@ -1,7 +1,11 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include "motherboard.h"
 #include "memory.h"
+#include "cpu8080.h"
+#include "scheduler.h"
 
 
 bool handle_test_output(motherboard8080 *motherboard, uint8_t port, uint8_t out) {
@@ -9,6 +13,14 @@ bool handle_test_output(motherboard8080 *motherboard, uint8_t port, uint8_t out)
         printf("%c", (char) out);
         return(true);
     }
+    else if (port == TEST_BANK_SELECT_PORT && motherboard->memory_map->num_banks > 1) {
+        // CP/M 3 style banked memory, if the test program was given banks with init_memory_banks()
+        if (!select_memory_bank(motherboard->memory_map, out)) {
+            printf("Memory bank %d does not exist.", out);
+            return(false);
+        }
+        return(true);
+    }
     else {
         printf("Output port %02X not handled.", port);
         return(false);
@@ -21,11 +33,27 @@ bool handle_test_input(motherboard8080 *motherboard, uint8_t port, uint8_t *in)
     return(false);
 }
 
-void init_test_motherboard(motherboard8080 *motherboard) {
-    // motherboard for the 8080 test programs
-    motherboard->memory = init_memory(0x10000);
+void init_test_motherboard(motherboard8080 *motherboard, memory_arena8080 *arena) {
+    // motherboard for the 8080 test programs; its memory comes from arena unless that is NULL
+    motherboard->memory_map = init_memory_map_in_arena(arena);
+    motherboard->memory = motherboard->memory_map->memory;
     motherboard->input_handler = &handle_test_input;
     motherboard->output_handler = &handle_test_output;
+    motherboard->memory_io_accesses = 0;
+}
+
+/* Sends the CPU's reads and writes of the pages from start to start + length to read_handler and write_handler, which get
+   the address as the CPU gave it.  start and length are multiples of MEMORY_PAGE_SIZE. */
+void map_memory_io(motherboard8080 *motherboard, uint16_t start, uint32_t length,
+                   uint8_t (*read_handler)(motherboard8080 *motherboard, uint16_t address),
+                   void (*write_handler)(motherboard8080 *motherboard, uint16_t address, uint8_t value)) {
+    uint32_t page;
+
+    map_memory_pages(motherboard->memory_map, start, length, PAGE_IO);
+    for (page = start / MEMORY_PAGE_SIZE; page < (start + length) / MEMORY_PAGE_SIZE; page++) {
+        motherboard->memory_read_handler[page] = read_handler;
+        motherboard->memory_write_handler[page] = write_handler;
+    }
 }
 
 bool handle_space_invaders_output(motherboard8080 *motherboard, uint8_t port, uint8_t out) {
@@ -53,29 +81,31 @@ bool handle_space_invaders_output(motherboard8080 *motherboard, uint8_t port, ui
                 Only bit will be set.  Bit 5 is a no-op as it had a function with the analog
                 sound in the original machine.
             */
-            switch(out) {
-                case 0x1:
-                    channel = Mix_PlayChannel(-1, real_motherboard->sound_ufo, 0);
-                    break;
-                case 0x2:
-                    channel = Mix_PlayChannel(-1, real_motherboard->sound_shot, 0);
-                    break;
-                case 0x4:
-                    channel = Mix_PlayChannel(-1, real_motherboard->sound_flash_player_die, 0);
-                    break;
-                case 0x8:
-                    channel = Mix_PlayChannel(-1, real_motherboard->sound_invader_die, 0);
-                    break;
-                case 0x10:
-                    channel = Mix_PlayChannel(-1, real_motherboard->sound_extended_play, 0);
-                    break;
-                case 0x20:
-                    // no-op, but set channel so that we can do the test properly below
-                    channel = 0;
-                    break;
-            }
-            if (channel == -1) {
-                printf("Unable to play WAV file: %s\n", Mix_GetError());
+            if (!real_motherboard->headless) {
+                switch(out) {
+                    case 0x1:
+                        channel = Mix_PlayChannel(-1, real_motherboard->sound_ufo, 0);
+                        break;
+                    case 0x2:
+                        channel = Mix_PlayChannel(-1, real_motherboard->sound_shot, 0);
+                        break;
+                    case 0x4:
+                        channel = Mix_PlayChannel(-1, real_motherboard->sound_flash_player_die, 0);
+                        break;
+                    case 0x8:
+                        channel = Mix_PlayChannel(-1, real_motherboard->sound_invader_die, 0);
+                        break;
+                    case 0x10:
+                        channel = Mix_PlayChannel(-1, real_motherboard->sound_extended_play, 0);
+                        break;
+                    case 0x20:
+                        // no-op, but set channel so that we can do the test properly below
+                        channel = 0;
+                        break;
+                }
+                if (channel == -1) {
+                    printf("Unable to play WAV file: %s\n", Mix_GetError());
+                }
             }
             // while(Mix_Playing(channel) != 0);  <--- used to test sounds
         case 0x4:
@@ -92,25 +122,27 @@ bool handle_space_invaders_output(motherboard8080 *motherboard, uint8_t port, ui
                 bit 5 = flip screen in Cocktail mode - not implemented in this version
                 bits 6, 7 = NC (not wired)
             */
-            switch(out) {
-                case 0x1:
-                    channel = Mix_PlayChannel(-1, real_motherboard->sound_fleet_movement_1, 0);
-                    break;
-                case 0x2:
-                    channel = Mix_PlayChannel(-1, real_motherboard->sound_fleet_movement_2, 0);
-                    break;
-                case 0x4:
-                    channel = Mix_PlayChannel(-1, real_motherboard->sound_fleet_movement_3, 0);
-                    break;
-                case 0x8:
-                    channel = Mix_PlayChannel(-1, real_motherboard->sound_fleet_movement_4, 0);
-                    break;
-                case 0x10:
-                    channel = Mix_PlayChannel(-1, real_motherboard->sound_ufo_hit, 0);
-                    break;
-            }
-            if (channel == -1) {
-                printf("Unable to play WAV file: %s\n", Mix_GetError());
+            if (!real_motherboard->headless) {
+                switch(out) {
+                    case 0x1:
+                        channel = Mix_PlayChannel(-1, real_motherboard->sound_fleet_movement_1, 0);
+                        break;
+                    case 0x2:
+                        channel = Mix_PlayChannel(-1, real_motherboard->sound_fleet_movement_2, 0);
+                        break;
+                    case 0x4:
+                        channel = Mix_PlayChannel(-1, real_motherboard->sound_fleet_movement_3, 0);
+                        break;
+                    case 0x8:
+                        channel = Mix_PlayChannel(-1, real_motherboard->sound_fleet_movement_4, 0);
+                        break;
+                    case 0x10:
+                        channel = Mix_PlayChannel(-1, real_motherboard->sound_ufo_hit, 0);
+                        break;
+                }
+                if (channel == -1) {
+                    printf("Unable to play WAV file: %s\n", Mix_GetError());
+                }
             }
         case 0x6:
             /*
@@ -199,13 +231,96 @@ bool handle_space_invaders_input(motherboard8080 *motherboard, uint8_t port, uin
     return(true);
 }
 
-void init_space_invaders_motherboard(spaceinvaders_motherboard8080 *motherboard) {
-    motherboard->base.memory = init_memory(0x4000);
+/* The 8K Space Invaders ROM, for any number of motherboards to share, or NULL if it can't be loaded.  The caller releases
+   it with release_rom_image() once the motherboards are set up. */
+rom_image8080 *load_space_invaders_rom() {
+    rom_image8080 *rom = init_rom_image(0x2000);
+    char *rom_names[4] = {"invaders.h", "invaders.g", "invaders.f", "invaders.e"};
+    int i;
+
+    // each file is 2K, and has to stay inside its 2K
+    for (i = 0; i < 4; i++) {
+        if (!load_rom(rom_names[i], 0, &(rom->data[i * 0x800]), 0x800, SPACE_INVADERS_MANIFEST)) {
+            release_rom_image(&rom);
+            return NULL;
+        }
+    }
+    seal_rom_image(rom);
+    return rom;
+}
+
+/* Space Invaders without a window or sound, for running many machines at once.  The screen functions must not be called
+   on a headless motherboard.  rom comes from load_space_invaders_rom(), and the memory comes from arena unless that is
+   NULL. */
+void init_headless_space_invaders_motherboard(spaceinvaders_motherboard8080 *motherboard, rom_image8080 *rom,
+                                              memory_arena8080 *arena) {
+    // 8K of ROM and 8K of RAM, which shows up again every 8K above 0x4000
+    motherboard->base.memory_map = init_memory_map_in_arena(arena);
+    motherboard->base.memory = motherboard->base.memory_map->memory;
+
+    map_rom_image(motherboard->base.memory_map, 0x0000, rom);
+    mirror_memory_pages(motherboard->base.memory_map, 0x4000, 0xC000, 0x2000, 0x2000);
+    // the video code redraws the columns written since the last frame
+    track_memory_writes(motherboard->base.memory_map, SPACE_INVADERS_VRAM_START, SPACE_INVADERS_VRAM_SIZE);
+    motherboard->vram_frames = 0;
+    motherboard->vram_dirty_columns = 0;
+    motherboard->render_frames = 0;
+    motherboard->render_ticks = 0;
+    motherboard->render_bytes = 0;
+    motherboard->render_uploads = 0;
+
+    motherboard->headless = true;
+    motherboard->texture = NULL;
+    motherboard->pixels = NULL;
+    motherboard->scaled_pixels = NULL;
+    motherboard->scale = 1;
+    motherboard->scanlines = false;
+    motherboard->frame_vram[0] = NULL;
+    motherboard->video_kernel = best_video_kernel();
+    motherboard->sound_ufo = NULL;
+    motherboard->sound_shot = NULL;
+    motherboard->sound_flash_player_die = NULL;
+    motherboard->sound_invader_die = NULL;
+    motherboard->sound_extended_play = NULL;
+    motherboard->sound_fleet_movement_1 = NULL;
+    motherboard->sound_fleet_movement_2 = NULL;
+    motherboard->sound_fleet_movement_3 = NULL;
+    motherboard->sound_fleet_movement_4 = NULL;
+    motherboard->sound_ufo_hit = NULL;
+    motherboard->renderer = NULL;
+    motherboard->window = NULL;
+    
+    motherboard->base.input_handler = &handle_space_invaders_input;
+    motherboard->base.output_handler = &handle_space_invaders_output;
+    motherboard->base.memory_io_accesses = 0;
+
+    motherboard->credit_pressed = false;
+    motherboard->one_player_start_pressed = false;
+    motherboard->two_player_start_pressed = false;
+    motherboard->player_one_left_pressed = false;
+    motherboard->player_one_fire_pressed = false;
+    motherboard->player_one_right_pressed = false;
+    motherboard->player_two_left_pressed = false;
+    motherboard->player_two_fire_pressed = false;
+    motherboard->player_two_right_pressed = false;
+
+    motherboard->dip3 = true;
+    motherboard->dip5 = false;
+    motherboard->dip6 = true;
+    motherboard->dip7 = false;
+
+    motherboard->shift_register = 0x0000;
+    motherboard->shift_register_offset = 0x0; 
+}
 
-    load_rom("invaders.h", 0x0000, motherboard->base.memory);
-    load_rom("invaders.g", 0x0800, motherboard->base.memory);
-    load_rom("invaders.f", 0x1000, motherboard->base.memory);
-    load_rom("invaders.e", 0x1800, motherboard->base.memory);
+/* The window is scale (1 to VIDEO_MAX_SCALE) times the size of the screen, and the screen is scaled up to it by
+   scale_video_pixels() rather than by the renderer, which would blur it; see spaceinvaders_screen_present(). */
+void init_space_invaders_motherboard(spaceinvaders_motherboard8080 *motherboard, rom_image8080 *rom, int scale,
+                                     bool scanlines) {
+    init_headless_space_invaders_motherboard(motherboard, rom, NULL);
+    motherboard->headless = false;
+    motherboard->scale = scale;
+    motherboard->scanlines = scanlines;
 
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) != 0){
         printf("Unable to initialize SDL: %s\n", SDL_GetError());
@@ -254,36 +369,41 @@ void init_space_invaders_motherboard(spaceinvaders_motherboard8080 *motherboard)
         printf("Unable to load WAV file: %s\n", Mix_GetError());
     }
 
-    SDL_CreateWindowAndRenderer(224, 256, 0, &(motherboard->window), &(motherboard->renderer));
+    SDL_CreateWindowAndRenderer(SPACE_INVADERS_SCREEN_WIDTH * scale, SPACE_INVADERS_SCREEN_HEIGHT * scale, 0,
+                                &(motherboard->window), &(motherboard->renderer));
+    motherboard->texture = SDL_CreateTexture(motherboard->renderer, SDL_PIXELFORMAT_ARGB8888,
+                                             SDL_TEXTUREACCESS_STREAMING,
+                                             SPACE_INVADERS_SCREEN_WIDTH * scale, SPACE_INVADERS_SCREEN_HEIGHT * scale);
+    if (motherboard->texture == NULL) {
+        printf("Unable to create screen texture: %s\n", SDL_GetError());
+    }
+    motherboard->pixels = (uint32_t *) init_memory(SPACE_INVADERS_SCREEN_WIDTH * SPACE_INVADERS_SCREEN_HEIGHT *
+                                                   sizeof(uint32_t));
+    if (scale > 1) {
+        motherboard->scaled_pixels = (uint32_t *) init_memory(SPACE_INVADERS_SCREEN_WIDTH * scale *
+                                                              SPACE_INVADERS_SCREEN_HEIGHT * scale * sizeof(uint32_t));
+    }
+    // the three frames of the triple buffer, in one allocation
+    motherboard->frame_vram[0] = init_memory(3 * SPACE_INVADERS_VRAM_SIZE);
+    motherboard->frame_vram[1] = motherboard->frame_vram[0] + SPACE_INVADERS_VRAM_SIZE;
+    motherboard->frame_vram[2] = motherboard->frame_vram[1] + SPACE_INVADERS_VRAM_SIZE;
+    memset(motherboard->frame_dirty_columns, 0, sizeof(motherboard->frame_dirty_columns));
+    memset(motherboard->dirty_columns, 0, sizeof(motherboard->dirty_columns));
+    memset(motherboard->dropped_dirty_columns, 0, sizeof(motherboard->dropped_dirty_columns));
+    init_video_triple_buffer(&(motherboard->frames));
     spaceinvaders_screen_clear(motherboard);
-    
-    motherboard->base.input_handler = &handle_space_invaders_input;
-    motherboard->base.output_handler = &handle_space_invaders_output;
-
-    motherboard->credit_pressed = false;
-    motherboard->one_player_start_pressed = false;
-    motherboard->two_player_start_pressed = false;
-    motherboard->player_one_left_pressed = false;
-    motherboard->player_one_fire_pressed = false;
-    motherboard->player_one_right_pressed = false;
-    motherboard->player_two_left_pressed = false;
-    motherboard->player_two_fire_pressed = false;
-    motherboard->player_two_right_pressed = false;
-
-    motherboard->dip3 = true;
-    motherboard->dip5 = false;
-    motherboard->dip6 = true;
-    motherboard->dip7 = false;
-
-    motherboard->shift_register = 0x0000;
-    motherboard->shift_register_offset = 0x0; 
 }
 
 void destroy_motherboard(motherboard8080 *motherboard) {
-    destroy_memory(&(motherboard->memory));
+    destroy_memory_map(&(motherboard->memory_map));
+    motherboard->memory = NULL;
 }
 
 void destroy_spaceinvaders_motherboard(spaceinvaders_motherboard8080 *motherboard) {
+    if (motherboard->headless) {
+        destroy_motherboard(&(motherboard->base));
+        return;
+    }
     Mix_FreeChunk(motherboard->sound_ufo);
     Mix_FreeChunk(motherboard->sound_shot);
     Mix_FreeChunk(motherboard->sound_flash_player_die);
@@ -295,6 +415,13 @@ void destroy_spaceinvaders_motherboard(spaceinvaders_motherboard8080 *motherboar
     Mix_FreeChunk(motherboard->sound_fleet_movement_4);
     Mix_FreeChunk(motherboard->sound_ufo_hit);
 
+    free(motherboard->pixels);
+    motherboard->pixels = NULL;
+    free(motherboard->scaled_pixels);
+    motherboard->scaled_pixels = NULL;
+    free(motherboard->frame_vram[0]);
+    motherboard->frame_vram[0] = NULL;
+    SDL_DestroyTexture(motherboard->texture);
     SDL_DestroyRenderer(motherboard->renderer);
     SDL_DestroyWindow(motherboard->window);
     destroy_motherboard(&(motherboard->base));
@@ -305,36 +432,165 @@ void spaceinvaders_screen_clear(spaceinvaders_motherboard8080 *motherboard) {
     SDL_RenderClear(motherboard->renderer);
 }
 
-void spaceinvaders_screen_draw(spaceinvaders_motherboard8080 *motherboard) {
-    /* see http://computerarcheology.com/Arcade/SpaceInvaders/Hardware.html or
-       https://www.walkofmind.com/programming/side/hardware.htm for some descriptions of the screen geometry
-    */
-    uint8_t x = 0;
-    uint8_t y = 255;
-    uint16_t mem_pos = 0x2400; // start of VRAM
-    uint8_t byte;
-    
-    byte = motherboard->base.memory[mem_pos];
-    
-    while (mem_pos <= 0x3FFF) {
-        if ((byte >> (7 - (y % 8))) & 0x01) {
-            SDL_SetRenderDrawColor(motherboard->renderer, 255, 255, 255, 255);
+/* On the emulation thread: copies columns first to end - 1 of VRAM to the frame being made, and notes the ones written
+   since they were last scanned.  Call it for the columns the beam has just drawn, so each half of the screen shows VRAM
+   as it was when the beam passed. */
+void spaceinvaders_screen_scan(spaceinvaders_motherboard8080 *motherboard, int first, int end) {
+    memory_map8080 *map = motherboard->base.memory_map;
+    int x;
+
+    memcpy(motherboard->frame_vram[motherboard->frames.back] + first * MEMORY_DIRTY_LINE_SIZE,
+           &(motherboard->base.memory[SPACE_INVADERS_VRAM_START + first * MEMORY_DIRTY_LINE_SIZE]),
+           (end - first) * MEMORY_DIRTY_LINE_SIZE);
+    for (x = first; x < end; x++) {
+        if (memory_line_dirty(map, x)) {
+            clear_dirty_line(map, x);
+            motherboard->dirty_columns[x >> 3] |= (1 << (x & 0x7));
+            motherboard->vram_dirty_columns++;
         }
-        else {
-            SDL_SetRenderDrawColor(motherboard->renderer, 0, 0, 0, 255);
+    }
+}
+
+/* On the emulation thread: hands the frame to the render thread at vblank, once both halves have been scanned.
+
+   The render thread uploads only the columns in the dirty mask of the frame it takes.  By then the texture shows the
+   frame published before it, or an earlier one if that was dropped.  So the mask is this frame's columns OR'd with
+   those of every frame since the last one known to have been taken.  Publishing tells whether the frame before this
+   one was taken, and so what the next frame's mask has to carry. */
+void spaceinvaders_screen_publish(spaceinvaders_motherboard8080 *motherboard) {
+    uint8_t *frame_dirty_columns = motherboard->frame_dirty_columns[motherboard->frames.back];
+    int i;
+
+    for (i = 0; i < SPACE_INVADERS_SCREEN_WIDTH / 8; i++) {
+        frame_dirty_columns[i] = motherboard->dropped_dirty_columns[i] | motherboard->dirty_columns[i];
+    }
+    if (publish_video_frame(&(motherboard->frames))) {
+        // the texture shows the frame before this one at least, so the next frame has to carry only this one
+        memcpy(motherboard->dropped_dirty_columns, motherboard->dirty_columns, sizeof(motherboard->dirty_columns));
+    }
+    else {
+        memcpy(motherboard->dropped_dirty_columns, frame_dirty_columns, sizeof(motherboard->dirty_columns));
+    }
+    memset(motherboard->dirty_columns, 0, sizeof(motherboard->dirty_columns));
+    motherboard->vram_frames++;
+}
+
+// Whether the texture may not show column x of the front frame.  Before the first frame, it shows none.
+static bool column_dirty(spaceinvaders_motherboard8080 *motherboard, const uint8_t *frame_dirty_columns, int x) {
+    return motherboard->render_frames == 0 || ((frame_dirty_columns[x >> 3] >> (x & 0x7)) & 1);
+}
+
+/* On the render thread: if a frame was published since the last call, converts the columns in its dirty mask, uploads
+   each run of them as one strip, and presents the texture.  Returns false if there was no new frame. */
+bool spaceinvaders_screen_present(spaceinvaders_motherboard8080 *motherboard) {
+    uint64_t start = SDL_GetPerformanceCounter();
+    uint8_t *vram;
+    const uint8_t *frame_dirty_columns;
+    SDL_Rect strip, scaled_strip;
+    int x = 0;
+
+    if (!take_video_frame(&(motherboard->frames))) {
+        return false;
+    }
+    vram = motherboard->frame_vram[motherboard->frames.front];
+    frame_dirty_columns = motherboard->frame_dirty_columns[motherboard->frames.front];
+    strip.y = 0;
+    strip.h = SPACE_INVADERS_SCREEN_HEIGHT;
+    while (x < SPACE_INVADERS_SCREEN_WIDTH) {
+        if (!column_dirty(motherboard, frame_dirty_columns, x)) {
+            x++;
+            continue;
+        }
+        strip.x = x;
+        while (x < SPACE_INVADERS_SCREEN_WIDTH && column_dirty(motherboard, frame_dirty_columns, x)) {
+            x++;
         }
-        SDL_RenderDrawPoint(motherboard->renderer, x, y);
-        y -= 1;
-        if (y == 255) {
-            // it underflowed
-            x += 1;
+        strip.w = x - strip.x;
+        /* see http://computerarcheology.com/Arcade/SpaceInvaders/Hardware.html or
+           https://www.walkofmind.com/programming/side/hardware.htm for some descriptions of the screen geometry
+        */
+        expand_video_columns(motherboard->video_kernel, vram, motherboard->pixels,
+                             SPACE_INVADERS_SCREEN_WIDTH, strip.x, strip.w,
+                             SPACE_INVADERS_PIXEL_ON, SPACE_INVADERS_PIXEL_OFF);
+        if (motherboard->scale > 1) {
+            scale_video_pixels(motherboard->video_kernel, motherboard->pixels, SPACE_INVADERS_SCREEN_WIDTH,
+                               SPACE_INVADERS_SCREEN_HEIGHT, strip.x, strip.w, motherboard->scaled_pixels,
+                               SPACE_INVADERS_SCREEN_WIDTH * motherboard->scale, motherboard->scale,
+                               motherboard->scanlines);
+            scaled_strip.x = strip.x * motherboard->scale;
+            scaled_strip.y = 0;
+            scaled_strip.w = strip.w * motherboard->scale;
+            scaled_strip.h = SPACE_INVADERS_SCREEN_HEIGHT * motherboard->scale;
+            SDL_UpdateTexture(motherboard->texture, &scaled_strip, motherboard->scaled_pixels + scaled_strip.x,
+                              SPACE_INVADERS_SCREEN_WIDTH * motherboard->scale * sizeof(uint32_t));
         }
-        if (y % 8 == 0) {
-            mem_pos ++;
-            byte = motherboard->base.memory[mem_pos];
+        else {
+            SDL_UpdateTexture(motherboard->texture, &strip, motherboard->pixels + strip.x,
+                              SPACE_INVADERS_SCREEN_WIDTH * sizeof(uint32_t));
         }
+        motherboard->render_bytes += strip.w * MEMORY_DIRTY_LINE_SIZE;
+        motherboard->render_uploads++;
     }
-    
+    SDL_RenderCopy(motherboard->renderer, motherboard->texture, NULL, NULL);
     SDL_RenderPresent(motherboard->renderer);
+    motherboard->render_ticks += SDL_GetPerformanceCounter() - start;
+    motherboard->render_frames++;
+    return true;
+}
+
+/* Ends a frame for the VRAM write tracking of a machine without a screen: adds the columns written since the last frame
+   to the totals, and starts over.  Column x is line x.  With a screen, spaceinvaders_screen_scan() and
+   spaceinvaders_screen_publish() keep the totals. */
+void spaceinvaders_vram_frame_done(spaceinvaders_motherboard8080 *motherboard) {
+    memory_map8080 *map = motherboard->base.memory_map;
+    int x;
+
+    for (x = 0; x < SPACE_INVADERS_SCREEN_WIDTH; x++) {
+        if (memory_line_dirty(map, x)) {
+            motherboard->vram_dirty_columns++;
+        }
+    }
+    motherboard->vram_frames++;
+    clear_dirty_lines(map);
+}
+    
+// The mid-screen interrupt (RST 1), when the beam has drawn the first half of VRAM
+static void space_invaders_mid_screen(scheduler8080 *scheduler, motherboard8080 *motherboard, cpu8080 *cpu) {
+    spaceinvaders_motherboard8080 *real_motherboard = (spaceinvaders_motherboard8080 *) motherboard;
+    uint16_t ignore;
+
+    if (!real_motherboard->headless) {
+        spaceinvaders_screen_scan(real_motherboard, 0, SPACE_INVADERS_MID_SCREEN_COLUMN);
+    }
+    do_interrupt(motherboard, cpu, 1, &ignore);
+}
+
+// The vblank interrupt (RST 2), which ends the frame
+static void space_invaders_vblank(scheduler8080 *scheduler, motherboard8080 *motherboard, cpu8080 *cpu) {
+    spaceinvaders_motherboard8080 *real_motherboard = (spaceinvaders_motherboard8080 *) motherboard;
+    uint16_t ignore;
+
+    if (real_motherboard->headless) {
+        // there is no screen, but counting the VRAM columns written shows what a frame would redraw
+        spaceinvaders_vram_frame_done(real_motherboard);
+        do_interrupt(motherboard, cpu, 2, &ignore);
+    }
+    else {
+        spaceinvaders_screen_scan(real_motherboard, SPACE_INVADERS_MID_SCREEN_COLUMN, SPACE_INVADERS_SCREEN_WIDTH);
+        do_interrupt(motherboard, cpu, 2, &ignore);
+        spaceinvaders_screen_publish(real_motherboard);
+    }
+    scheduler->yield = true;
+}
+
+static const scheduler8080_timing space_invaders_timing[] = {
+    {"mid-screen interrupt", SPACE_INVADERS_MID_SCREEN_STATES, SPACE_INVADERS_STATES_PER_FRAME,
+     &space_invaders_mid_screen},
+    {"vblank interrupt", SPACE_INVADERS_STATES_PER_FRAME, SPACE_INVADERS_STATES_PER_FRAME, &space_invaders_vblank}
+};
+
+// Schedules the Space Invaders video interrupts.  run_scheduler8080() then runs one frame per call.
+bool schedule_space_invaders_events(scheduler8080 *scheduler) {
+    return schedule_timing8080(scheduler, space_invaders_timing,
+                               sizeof(space_invaders_timing) / sizeof(space_invaders_timing[0]));
 }
-    
\ No newline at end of file
@@ -4,11 +4,36 @@
 #include <stdint.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_mixer.h>
+#include "memory.h"
+#include "video.h"
+
+/* Space Invaders video memory: 224 columns of 32 bytes, one per MEMORY_DIRTY_LINE_SIZE line, laid out the way
+   expand_video_columns() reads them */
+#define SPACE_INVADERS_VRAM_START 0x2400
+#define SPACE_INVADERS_VRAM_SIZE 0x1C00
+#define SPACE_INVADERS_SCREEN_WIDTH 224
+#define SPACE_INVADERS_SCREEN_HEIGHT 256
+/* The beam draws VRAM in address order, one column of the rotated screen at a time.  By the mid-screen interrupt
+   (RST 1), halfway through the frame, it has drawn the columns before this one; by vblank (RST 2), the rest. */
+#define SPACE_INVADERS_MID_SCREEN_COLUMN 112
+// The 8080 runs at 2 MHz and the screen at 60 Hz
+#define SPACE_INVADERS_FRAMES_PER_SECOND 60
+#define SPACE_INVADERS_STATES_PER_FRAME 33333
+#define SPACE_INVADERS_MID_SCREEN_STATES 16667
+// Colors of the screen texture, which is ARGB8888
+#define SPACE_INVADERS_PIXEL_ON 0xFFFFFFFF
+#define SPACE_INVADERS_PIXEL_OFF 0xFF000000
 
 typedef struct motherboard8080 {
-    uint8_t *memory;
+    uint8_t *memory;  // memory_map->memory
+    memory_map8080 *memory_map;
     bool (*input_handler)(struct motherboard8080 *motherboard, uint8_t port, uint8_t *in);
     bool (*output_handler)(struct motherboard8080 *motherboard, uint8_t port, uint8_t out);
+
+    // Memory-mapped devices, for the pages mapped PAGE_IO by map_memory_io(); not set for other pages
+    uint8_t (*memory_read_handler[MEMORY_NUM_PAGES])(struct motherboard8080 *motherboard, uint16_t address);
+    void (*memory_write_handler[MEMORY_NUM_PAGES])(struct motherboard8080 *motherboard, uint16_t address, uint8_t value);
+    uint64_t memory_io_accesses;
 } motherboard8080;
 
 typedef struct spaceinvaders_motherboard8080 {
@@ -25,15 +50,16 @@ typedef struct spaceinvaders_motherboard8080 {
     Mix_Chunk *sound_fleet_movement_4;
     Mix_Chunk *sound_ufo_hit;
 
-    bool credit_pressed;
-    bool one_player_start_pressed;
-    bool two_player_start_pressed;
-    bool player_one_left_pressed;
-    bool player_one_fire_pressed;
-    bool player_one_right_pressed;
-    bool player_two_left_pressed;
-    bool player_two_fire_pressed;
-    bool player_two_right_pressed;
+    // Set by the render thread, which handles the window's events, and read by the emulation thread
+    atomic_bool credit_pressed;
+    atomic_bool one_player_start_pressed;
+    atomic_bool two_player_start_pressed;
+    atomic_bool player_one_left_pressed;
+    atomic_bool player_one_fire_pressed;
+    atomic_bool player_one_right_pressed;
+    atomic_bool player_two_left_pressed;
+    atomic_bool player_two_fire_pressed;
+    atomic_bool player_two_right_pressed;
 
     // DIPs 3 and 5 are read as two bits - 00 is 3 ships, 01 is 4, 10 is 5, 11 is 6
     bool dip3;
@@ -48,15 +74,64 @@ typedef struct spaceinvaders_motherboard8080 {
     uint16_t shift_register;
     uint8_t shift_register_offset;
 
+    /* Frames finished by spaceinvaders_screen_present() or spaceinvaders_vram_frame_done(), and the VRAM columns
+       written in them */
+    uint64_t vram_frames;
+    uint64_t vram_dirty_columns;
+
+    /* Frames shown by spaceinvaders_screen_present(), the time converting and presenting them took in
+       SDL_GetPerformanceCounter() ticks, and the VRAM bytes converted and texture uploads made for them */
+    uint64_t render_frames;
+    uint64_t render_ticks;
+    uint64_t render_bytes;
+    uint64_t render_uploads;
+
+    // No window or sound; see init_headless_space_invaders_motherboard()
+    bool headless;
     SDL_Renderer *renderer;
     SDL_Window *window; 
+    SDL_Texture *texture;
+    uint32_t *pixels;  // SPACE_INVADERS_SCREEN_WIDTH * SPACE_INVADERS_SCREEN_HEIGHT, uploaded to texture each frame
+    // With scale above 1, pixels is scaled up into scaled_pixels, which is uploaded instead
+    int scale;
+    bool scanlines;
+    uint32_t *scaled_pixels;
+    // Frames of VRAM made by the emulation thread for the render thread
+    video_triple_buffer frames;
+    uint8_t *frame_vram[3];
+    /* A bit per column of each frame, set for the columns that may differ from the frame the texture shows when the
+       render thread takes it; see spaceinvaders_screen_publish() */
+    uint8_t frame_dirty_columns[3][SPACE_INVADERS_SCREEN_WIDTH / 8];
+    // On the emulation thread: the columns written in the frame being made, and in the dropped frames before it
+    uint8_t dirty_columns[SPACE_INVADERS_SCREEN_WIDTH / 8];
+    uint8_t dropped_dirty_columns[SPACE_INVADERS_SCREEN_WIDTH / 8];
+    video_kernel video_kernel;  // converts VRAM to pixels; best_video_kernel() unless changed
 } spaceinvaders_motherboard8080;
 
-void init_test_motherboard(motherboard8080 *motherboard);
-void init_space_invaders_motherboard(spaceinvaders_motherboard8080 *motherboard);
+// ROM set manifest that the Space Invaders ROMs are checked against, if it exists; see load_rom()
+#define SPACE_INVADERS_MANIFEST "invaders.manifest"
+
+// OUT port that selects the memory bank on the test motherboard
+#define TEST_BANK_SELECT_PORT 0x01
+
+struct scheduler8080;
+
+void init_test_motherboard(motherboard8080 *motherboard, memory_arena8080 *arena);
+void map_memory_io(motherboard8080 *motherboard, uint16_t start, uint32_t length,
+                   uint8_t (*read_handler)(motherboard8080 *motherboard, uint16_t address),
+                   void (*write_handler)(motherboard8080 *motherboard, uint16_t address, uint8_t value));
+rom_image8080 *load_space_invaders_rom();
+void init_space_invaders_motherboard(spaceinvaders_motherboard8080 *motherboard, rom_image8080 *rom, int scale,
+                                     bool scanlines);
+void init_headless_space_invaders_motherboard(spaceinvaders_motherboard8080 *motherboard, rom_image8080 *rom,
+                                              memory_arena8080 *arena);
 void destroy_motherboard(motherboard8080 *motherboard);
 void destroy_spaceinvaders_motherboard(spaceinvaders_motherboard8080 *motherboard);
 void spaceinvaders_screen_clear(spaceinvaders_motherboard8080 *motherboard);
-void spaceinvaders_screen_draw(spaceinvaders_motherboard8080 *motherboard);
+void spaceinvaders_screen_scan(spaceinvaders_motherboard8080 *motherboard, int first, int end);
+void spaceinvaders_screen_publish(spaceinvaders_motherboard8080 *motherboard);
+bool spaceinvaders_screen_present(spaceinvaders_motherboard8080 *motherboard);
+void spaceinvaders_vram_frame_done(spaceinvaders_motherboard8080 *motherboard);
+bool schedule_space_invaders_events(struct scheduler8080 *scheduler);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,486 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include "memory.h"
+#include "cpu8080.h"
+#include "motherboard.h"
+#include "blockcache.h"
+#include "jit8080.h"
+#include "scheduler.h"
+
+/*
+Headless runner: hosts many independent Space Invaders and CP/M test machines in one process, and runs them on a pool of
+worker threads.  Each worker keeps a queue of machines; it runs a slice of the machine at the bottom of its own queue and
+puts it back there, and when its queue is empty it steals the machine at the top of another worker's queue.  Machines
+never share memory, so a slice needs no locking beyond taking the machine off a queue.
+
+With -arena, each machine's state, memory map and block cache are allocated one after another from a single memory
+arena rather than from the heap, so a slice touches one contiguous stretch of memory; -hugepages puts the arena on huge
+pages, which cuts the TLB misses of going from one machine to the next.
+*/
+
+// Space Invaders machines run this many frames per slice; CP/M machines run this many states.
+#define INVADERS_FRAMES_PER_SLICE 16
+#define CPM_STATES_PER_SLICE 2000000
+
+#define MAX_THREADS 256
+
+// Room in the arena for one machine: the instance, its map, its RAM if the map can't use a memfd, and its block cache,
+// each rounded up to a cache line
+#define ARENA_BYTES_PER_MACHINE (sizeof(runner_instance) + sizeof(memory_map8080) + sizeof(block_cache8080) + \
+                                 MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE + 4 * MEMORY_CACHE_LINE_SIZE)
+
+typedef enum {
+    INSTANCE_INVADERS,
+    INSTANCE_CPM
+} instance_type;
+
+typedef struct {
+    spaceinvaders_motherboard8080 motherboard;  // CP/M machines only use motherboard.base
+    cpu8080 cpu;
+    instance_type type;
+    char *rom_name;
+
+    uint64_t frames_left;    // Space Invaders only
+    scheduler8080 scheduler; // Space Invaders only
+    uint64_t output_bytes;   // CP/M console output, which is counted rather than printed
+    bool finished;
+    bool failed;
+
+    uint64_t total_states;
+    double run_seconds;      // time spent in slices, on whichever thread ran them
+} runner_instance;
+
+// A double-ended queue of instance numbers.  Its owner pushes and pops at the tail; thieves take from the head.
+typedef struct {
+    pthread_mutex_t lock;
+    int *items;  // ring buffer with room for every instance
+    int capacity;
+    int head;
+    int count;
+} work_queue;
+
+typedef struct runner runner;
+
+typedef struct {
+    runner *owner;
+    int number;
+    pthread_t thread;
+    work_queue queue;
+    uint64_t slices;
+    uint64_t steals;
+} runner_worker;
+
+struct runner {
+    runner_instance **instances;
+    runner_instance *instance_storage;  // the instances when there is no arena
+    memory_arena8080 *arena;            // NULL without -arena
+    int num_instances;
+    runner_worker *workers;
+    int num_workers;
+    atomic_int instances_left;
+};
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1000000000.0);
+}
+
+static bool handle_runner_cpm_output(motherboard8080 *motherboard, uint8_t port, uint8_t out) {
+    // motherboard is the first member of the instance
+    runner_instance *instance = (runner_instance *) motherboard;
+    if (port == 0x0) {
+        instance->output_bytes++;
+        return(true);
+    }
+    printf("Output port %02X not handled.", port);
+    return(false);
+}
+
+static bool init_queue(work_queue *queue, int capacity) {
+    queue->items = (int *) malloc(capacity * sizeof(int));
+    if (queue->items == NULL) {
+        return false;
+    }
+    pthread_mutex_init(&(queue->lock), NULL);
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->count = 0;
+    return true;
+}
+
+static void destroy_queue(work_queue *queue) {
+    pthread_mutex_destroy(&(queue->lock));
+    free(queue->items);
+    queue->items = NULL;
+}
+
+static void push_tail(work_queue *queue, int item) {
+    pthread_mutex_lock(&(queue->lock));
+    queue->items[(queue->head + queue->count) % queue->capacity] = item;
+    queue->count++;
+    pthread_mutex_unlock(&(queue->lock));
+}
+
+static bool pop_tail(work_queue *queue, int *item) {
+    bool found = false;
+    pthread_mutex_lock(&(queue->lock));
+    if (queue->count > 0) {
+        queue->count--;
+        *item = queue->items[(queue->head + queue->count) % queue->capacity];
+        found = true;
+    }
+    pthread_mutex_unlock(&(queue->lock));
+    return found;
+}
+
+static bool pop_head(work_queue *queue, int *item) {
+    bool found = false;
+    pthread_mutex_lock(&(queue->lock));
+    if (queue->count > 0) {
+        *item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+        found = true;
+    }
+    pthread_mutex_unlock(&(queue->lock));
+    return found;
+}
+
+static bool steal(runner_worker *worker, int *item) {
+    runner *r = worker->owner;
+    int i, victim;
+
+    // start with the next worker so thieves spread out instead of all raiding worker 0
+    for (i = 1; i < r->num_workers; i++) {
+        victim = (worker->number + i) % r->num_workers;
+        if (pop_head(&(r->workers[victim].queue), item)) {
+            worker->steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Runs one slice of instance.  Sets finished when it has nothing left to run.
+static void run_slice(runner_instance *instance) {
+    motherboard8080 *motherboard = &(instance->motherboard.base);
+    cpu8080 *cpu = &(instance->cpu);
+    cpu8080_stop_reason stop_reason;
+    uint64_t frame_start;
+    bool run;
+    int frame;
+    double start = now_seconds();
+
+    if (instance->type == INSTANCE_INVADERS) {
+        // the board's events interrupt and count the VRAM columns written; each call runs to vblank
+        for (frame = 0; frame < INVADERS_FRAMES_PER_SLICE && instance->frames_left > 0 && !instance->finished; frame++) {
+            frame_start = instance->scheduler.states;
+            run = run_scheduler8080(&(instance->scheduler), motherboard, cpu);
+            instance->total_states += instance->scheduler.states - frame_start;
+            if (!run) {
+                instance->failed = true;
+                instance->finished = true;
+                break;
+            }
+            instance->frames_left--;
+            // a CPU halted with interrupts disabled can never run again
+            if (instance->frames_left == 0 || (cpu->halted && !(cpu->interrupts_enabled))) {
+                instance->finished = true;
+            }
+        }
+    }
+    else {
+        instance->total_states += run_cpu8080(motherboard, cpu, CPM_STATES_PER_SLICE, &stop_reason);
+        if (stop_reason == STOP_ERROR) {
+            instance->failed = true;
+        }
+        if (stop_reason == STOP_ERROR || stop_reason == STOP_HALTED) {
+            instance->finished = true;
+        }
+    }
+    instance->run_seconds += now_seconds() - start;
+}
+
+static void *worker_main(void *arg) {
+    runner_worker *worker = (runner_worker *) arg;
+    runner *r = worker->owner;
+    runner_instance *instance;
+    int item;
+
+    while (atomic_load(&(r->instances_left)) > 0) {
+        if (!pop_tail(&(worker->queue), &item) && !steal(worker, &item)) {
+            // every unfinished machine is being run by another worker
+            sched_yield();
+            continue;
+        }
+        instance = r->instances[item];
+        run_slice(instance);
+        worker->slices++;
+        if (instance->finished) {
+            atomic_fetch_sub(&(r->instances_left), 1);
+        }
+        else {
+            push_tail(&(worker->queue), item);
+        }
+    }
+    return NULL;
+}
+
+static bool init_instance(runner_instance *instance, instance_type type, char *rom_name, rom_image8080 *invaders_rom,
+                          memory_arena8080 *arena, uint64_t frames, bool use_block_cache, bool use_jit) {
+    memset(instance, 0, sizeof(runner_instance));
+    instance->type = type;
+    instance->rom_name = rom_name;
+    instance->frames_left = frames;
+
+    if (type == INSTANCE_INVADERS) {
+        init_cpu8080(&(instance->cpu));
+        init_headless_space_invaders_motherboard(&(instance->motherboard), invaders_rom, arena);
+        init_scheduler8080(&(instance->scheduler));
+        if (!schedule_space_invaders_events(&(instance->scheduler))) {
+            return false;
+        }
+    }
+    else {
+        init_test_cpu8080(&(instance->cpu));
+        init_test_motherboard(&(instance->motherboard.base), arena);
+        instance->motherboard.base.output_handler = &handle_runner_cpm_output;
+        load_cpm_shim(instance->motherboard.base.memory);
+        if (!load_rom(rom_name, 0x100, instance->motherboard.base.memory, MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE, NULL)) {
+            return false;
+        }
+    }
+
+    if (!use_block_cache) {
+        return true;
+    }
+    instance->cpu.block_cache = (arena != NULL) ? init_block_cache8080_in_arena(arena) : init_block_cache8080();
+    if (instance->cpu.block_cache == NULL) {
+        printf("Unable to allocate block cache.\n");
+        return false;
+    }
+    if (use_jit) {
+        instance->cpu.jit = init_jit8080();
+        if (instance->cpu.jit == NULL) {
+            printf("JIT is not available; running in the interpreter.\n");
+        }
+    }
+    return true;
+}
+
+static void destroy_instance(runner_instance *instance) {
+    if (instance->cpu.jit != NULL) {
+        destroy_jit8080(&(instance->cpu.jit));
+    }
+    if (instance->cpu.block_cache != NULL) {
+        destroy_block_cache8080(&(instance->cpu.block_cache));
+    }
+    if (instance->type == INSTANCE_INVADERS) {
+        destroy_spaceinvaders_motherboard(&(instance->motherboard));
+    }
+    else {
+        destroy_motherboard(&(instance->motherboard.base));
+    }
+}
+
+static void print_report(runner *r, double wall_seconds) {
+    runner_instance *instance;
+    uint64_t total_states = 0, vram_frames = 0, vram_dirty_columns = 0;
+    int i;
+
+    printf("\n%-4s %-12s %16s %10s %20s\n", "#", "Machine", "States", "Seconds", "States per second");
+    for (i = 0; i < r->num_instances; i++) {
+        instance = r->instances[i];
+        printf("%-4d %-12s %16lu %10.3f %20.0f%s\n", i, (instance->type == INSTANCE_INVADERS) ? "invaders" : instance->rom_name,
+               instance->total_states, instance->run_seconds,
+               (instance->run_seconds > 0) ? ((double)instance->total_states) / instance->run_seconds : 0.0,
+               instance->failed ? "  FAILED" : "");
+        total_states += instance->total_states;
+        if (instance->type == INSTANCE_INVADERS) {
+            vram_frames += instance->motherboard.vram_frames;
+            vram_dirty_columns += instance->motherboard.vram_dirty_columns;
+        }
+    }
+
+    printf("\n%-8s %12s %12s\n", "Worker", "Slices", "Steals");
+    for (i = 0; i < r->num_workers; i++) {
+        printf("%-8d %12lu %12lu\n", i, r->workers[i].slices, r->workers[i].steals);
+    }
+
+    printf("\nThreads: %d  Machines: %d\n", r->num_workers, r->num_instances);
+    printf("Duration in clock time: %f sec\n", wall_seconds);
+    printf("Total states: %lu\n", total_states);
+    if (vram_frames > 0) {
+        printf("VRAM: %.1f of %d columns written per frame\n", ((double)vram_dirty_columns) / vram_frames,
+               SPACE_INVADERS_SCREEN_WIDTH);
+    }
+    if (wall_seconds > 0) {
+        printf("Performance: %f states per clock second\n", ((double)total_states) / wall_seconds);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    runner r;
+    int num_invaders = 0, num_cpm = 0, num_threads = 0;
+    uint64_t frames = 600;
+    char *cpm_rom = "8080EXM.COM";
+    bool use_block_cache = false, use_jit = false, use_arena = false, huge_pages = false, ok = true;
+    double start, wall_seconds;
+    rom_image8080 *invaders_rom;
+    int i;
+
+    /*
+    -invaders N  run N Space Invaders machines (the ROM files must be in the current directory)
+    -frames N    frames each Space Invaders machine runs; default 600, 10 seconds of game time
+    -cpm N ROM   run N CP/M test machines with ROM loaded at 0x100
+    -threads N   number of worker threads; default is one per online CPU
+    -blockcache  run decoded blocks from a block cache and skip busy waits
+    -jit         translate hot blocks to native code (x86-64 only; implies -blockcache)
+    -arena       allocate the machines from one memory arena
+    -hugepages   put the arena on huge pages (implies -arena)
+    */
+    for (i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "-invaders", 9) == 0 && i + 1 < argc) {
+            num_invaders = atoi(argv[++i]);
+        }
+        else if (strncmp(argv[i], "-frames", 7) == 0 && i + 1 < argc) {
+            frames = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strncmp(argv[i], "-cpm", 4) == 0 && i + 2 < argc) {
+            num_cpm = atoi(argv[++i]);
+            cpm_rom = argv[++i];
+        }
+        else if (strncmp(argv[i], "-threads", 8) == 0 && i + 1 < argc) {
+            num_threads = atoi(argv[++i]);
+        }
+        else if (strncmp(argv[i], "-blockcache", 11) == 0) {
+            use_block_cache = true;
+        }
+        else if (strncmp(argv[i], "-jit", 4) == 0) {
+            use_block_cache = true;
+            use_jit = true;
+        }
+        else if (strncmp(argv[i], "-arena", 6) == 0) {
+            use_arena = true;
+        }
+        else if (strncmp(argv[i], "-hugepages", 10) == 0) {
+            use_arena = true;
+            huge_pages = true;
+        }
+        else {
+            printf("Usage: %s [-invaders N] [-frames N] [-cpm N ROM] [-threads N] [-blockcache] [-jit] [-arena] "
+                   "[-hugepages]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (frames == 0) {
+        printf("-frames must be at least 1.\n");
+        return EXIT_FAILURE;
+    }
+    if (num_invaders < 0 || num_cpm < 0 || num_invaders + num_cpm == 0) {
+        printf("Nothing to run; give -invaders and/or -cpm.\n");
+        return EXIT_FAILURE;
+    }
+    if (num_threads <= 0) {
+        num_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+    if (num_threads > MAX_THREADS) {
+        num_threads = MAX_THREADS;
+    }
+
+    r.num_instances = num_invaders + num_cpm;
+    r.num_workers = num_threads;
+    r.instances = (runner_instance **) calloc(r.num_instances, sizeof(runner_instance *));
+    r.workers = (runner_worker *) calloc(r.num_workers, sizeof(runner_worker));
+    r.instance_storage = NULL;
+    r.arena = NULL;
+    if (use_arena) {
+        r.arena = init_memory_arena(r.num_instances * ARENA_BYTES_PER_MACHINE, huge_pages);
+    }
+    else {
+        r.instance_storage = (runner_instance *) calloc(r.num_instances, sizeof(runner_instance));
+    }
+    if (r.instances == NULL || r.workers == NULL || (r.arena == NULL && r.instance_storage == NULL)) {
+        printf("Unable to allocate %d machines.\n", r.num_instances);
+        return EXIT_FAILURE;
+    }
+    if (r.arena != NULL) {
+        printf("Arena: %zu MB on %s\n", r.arena->size / (1024 * 1024),
+               (r.arena->pages == ARENA_PAGES_HUGE) ? "huge pages" :
+               (r.arena->pages == ARENA_PAGES_TRANSPARENT_HUGE) ? "transparent huge pages" : "normal pages");
+    }
+    // every Space Invaders machine maps the same copy of the ROM
+    start = now_seconds();
+    invaders_rom = (num_invaders > 0) ? load_space_invaders_rom() : NULL;
+    if (num_invaders > 0 && invaders_rom == NULL) {
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < r.num_instances && ok; i++) {
+        // with an arena, each machine's state goes right before its map and block cache
+        r.instances[i] = (r.arena != NULL) ? (runner_instance *) memory_arena_alloc(r.arena, sizeof(runner_instance)) :
+                                             &(r.instance_storage[i]);
+        ok = init_instance(r.instances[i], (i < num_invaders) ? INSTANCE_INVADERS : INSTANCE_CPM, cpm_rom,
+                           invaders_rom, r.arena, frames, use_block_cache, use_jit);
+    }
+    if (invaders_rom != NULL) {
+        release_rom_image(&invaders_rom);
+    }
+    printf("Set up %d machines in %f sec\n", r.num_instances, now_seconds() - start);
+    for (i = 0; i < r.num_workers && ok; i++) {
+        r.workers[i].owner = &r;
+        r.workers[i].number = i;
+        ok = init_queue(&(r.workers[i].queue), r.num_instances);
+    }
+    if (!ok) {
+        return EXIT_FAILURE;
+    }
+
+    // deal the machines out round robin; stealing evens out whatever imbalance is left
+    for (i = 0; i < r.num_instances; i++) {
+        push_tail(&(r.workers[i % r.num_workers].queue), i);
+    }
+    atomic_init(&(r.instances_left), r.num_instances);
+
+    start = now_seconds();
+    for (i = 0; i < r.num_workers; i++) {
+        if (pthread_create(&(r.workers[i].thread), NULL, &worker_main, &(r.workers[i])) != 0) {
+            printf("Unable to start worker thread %d.\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+    for (i = 0; i < r.num_workers; i++) {
+        pthread_join(r.workers[i].thread, NULL);
+    }
+    wall_seconds = now_seconds() - start;
+
+    print_report(&r, wall_seconds);
+
+    for (i = 0; i < r.num_instances; i++) {
+        if (r.instances[i]->failed) {
+            ok = false;
+        }
+        destroy_instance(r.instances[i]);
+    }
+    for (i = 0; i < r.num_workers; i++) {
+        destroy_queue(&(r.workers[i].queue));
+    }
+    if (r.arena != NULL) {
+        destroy_memory_arena(&(r.arena));
+    }
+    free(r.instance_storage);
+    free(r.instances);
+    free(r.workers);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "scheduler.h"
+
+void init_scheduler8080(scheduler8080 *scheduler) {
+    memset(scheduler, 0, sizeof(scheduler8080));
+}
+
+static bool event_before(const scheduled_event8080 *a, const scheduled_event8080 *b) {
+    return (a->deadline < b->deadline) || (a->deadline == b->deadline && a->sequence < b->sequence);
+}
+
+static void swap_events(scheduled_event8080 *a, scheduled_event8080 *b) {
+    scheduled_event8080 temp = *a;
+    *a = *b;
+    *b = temp;
+}
+
+// Adds an event that falls due at the absolute state count deadline.  Returns false if the queue is full.
+bool schedule_event8080(scheduler8080 *scheduler, const scheduler8080_timing *timing, uint64_t deadline) {
+    int i, parent;
+
+    if (scheduler->num_events == SCHEDULER_MAX_EVENTS) {
+        printf("Unable to schedule %s: more than %d events.\n", timing->name, SCHEDULER_MAX_EVENTS);
+        return false;
+    }
+    i = scheduler->num_events++;
+    scheduler->queue[i].deadline = deadline;
+    scheduler->queue[i].sequence = scheduler->next_sequence++;
+    scheduler->queue[i].timing = timing;
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (!event_before(&(scheduler->queue[i]), &(scheduler->queue[parent]))) {
+            break;
+        }
+        swap_events(&(scheduler->queue[i]), &(scheduler->queue[parent]));
+        i = parent;
+    }
+    return true;
+}
+
+// Schedules each event of a board's timing table its first states from now.
+bool schedule_timing8080(scheduler8080 *scheduler, const scheduler8080_timing *timings, int num_timings) {
+    int i;
+
+    for (i = 0; i < num_timings; i++) {
+        if (!schedule_event8080(scheduler, &(timings[i]), scheduler->states + timings[i].first)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static scheduled_event8080 pop_event(scheduler8080 *scheduler) {
+    scheduled_event8080 top = scheduler->queue[0];
+    int i = 0, child;
+
+    scheduler->queue[0] = scheduler->queue[--scheduler->num_events];
+    while (true) {
+        child = 2 * i + 1;
+        if (child >= scheduler->num_events) {
+            break;
+        }
+        if (child + 1 < scheduler->num_events && event_before(&(scheduler->queue[child + 1]),
+                                                              &(scheduler->queue[child]))) {
+            child++;
+        }
+        if (!event_before(&(scheduler->queue[child]), &(scheduler->queue[i]))) {
+            break;
+        }
+        swap_events(&(scheduler->queue[i]), &(scheduler->queue[child]));
+        i = child;
+    }
+    return top;
+}
+
+/* Runs the CPU and the events due as it goes until a handler yields.  Returns false if the CPU stopped with an error
+   or there is nothing scheduled that could ever yield. */
+bool run_scheduler8080(scheduler8080 *scheduler, motherboard8080 *motherboard, cpu8080 *cpu) {
+    cpu8080_stop_reason stop_reason;
+    scheduled_event8080 event;
+
+    scheduler->yield = false;
+    while (true) {
+        while (scheduler->num_events > 0 && scheduler->queue[0].deadline <= scheduler->states) {
+            event = pop_event(scheduler);
+            if (event.timing->period > 0) {
+                // from the deadline, not from now, so the overshoot does not push every later deadline back
+                schedule_event8080(scheduler, event.timing, event.deadline + event.timing->period);
+            }
+            event.timing->handler(scheduler, motherboard, cpu);
+            scheduler->events_run++;
+        }
+        if (scheduler->yield) {
+            return true;
+        }
+        if (scheduler->num_events == 0) {
+            printf("No events scheduled.\n");
+            return false;
+        }
+        // a halted CPU just lets the states pass until the deadline
+        scheduler->states += run_cpu8080_until_interrupt(motherboard, cpu,
+                                                         scheduler->queue[0].deadline - scheduler->states,
+                                                         &stop_reason);
+        if (stop_reason == STOP_ERROR) {
+            return false;
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef SCHEDULER_8080_H
+#define SCHEDULER_8080_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "motherboard.h"
+#include "cpu8080.h"
+
+/*
+Drives a motherboard by its timed events, such as video interrupts, instead of a main loop that hard-codes them.  A
+board declares its timing as a table of scheduler8080_timing: when each event first falls due, how many states later it
+falls due again, and the handler that does it.
+
+The scheduler keeps the pending events in a priority queue on the absolute state count at which they fall due.
+run_scheduler8080() runs the CPU up to the earliest deadline, calls every handler that is due, puts periodic events back
+one period later, and goes on until a handler yields.  The CPU finishes the instruction that crosses a deadline before
+the handler runs, the way a real 8080 finishes the instruction before taking an interrupt.  Because deadlines are
+absolute, those few states of overshoot come out of the time to the next deadline rather than adding up frame after
+frame.  Events that fall due on the same state run in the order they were scheduled.
+*/
+#define SCHEDULER_MAX_EVENTS 16
+
+struct scheduler8080;
+
+typedef struct scheduler8080_timing {
+    char *name;
+    uint64_t first;   // states from when it is scheduled to the first deadline
+    uint64_t period;  // states from one deadline to the next, or 0 for an event that happens once
+    void (*handler)(struct scheduler8080 *scheduler, motherboard8080 *motherboard, cpu8080 *cpu);
+} scheduler8080_timing;
+
+typedef struct scheduled_event8080 {
+    uint64_t deadline;  // absolute state count
+    uint64_t sequence;  // breaks ties between equal deadlines
+    const scheduler8080_timing *timing;
+} scheduled_event8080;
+
+typedef struct scheduler8080 {
+    uint64_t states;  // absolute state count: every state the CPU has run since init_scheduler8080()
+    uint64_t events_run;
+
+    // A handler sets it to make run_scheduler8080() return once the events due now have run.
+    bool yield;
+
+    uint64_t next_sequence;
+    int num_events;
+    scheduled_event8080 queue[SCHEDULER_MAX_EVENTS];  // binary min-heap on deadline, then sequence
+} scheduler8080;
+
+void init_scheduler8080(scheduler8080 *scheduler);
+bool schedule_event8080(scheduler8080 *scheduler, const scheduler8080_timing *timing, uint64_t deadline);
+bool schedule_timing8080(scheduler8080 *scheduler, const scheduler8080_timing *timings, int num_timings);
+bool run_scheduler8080(scheduler8080 *scheduler, motherboard8080 *motherboard, cpu8080 *cpu);
+
+#endif
@@ -3,41 +3,294 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
 #include <sys/time.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
 #include <SDL2/SDL.h>
 #include "memory.h"
 #include "disassembler.h"
 #include "cpu8080.h"
 #include "motherboard.h"
 #include "debugger.h"
+#include "scheduler.h"
+#include "blockcache.h"
+#include "video.h"
 
+// Column ranges checked, and whole screens converted, by benchmark_video_kernels() for each kernel
+#define VIDEO_CHECK_COUNT 1000
+#define VIDEO_BENCHMARK_FRAMES 10000
+// Column ranges checked, and whole screens scaled, by benchmark_video_scaling() for each kernel, factor and scanlines
+#define SCALE_CHECK_COUNT 100
+#define SCALE_BENCHMARK_FRAMES 500
+#define NANOSECONDS_PER_SECOND 1000000000LL
+
+// The CPU and the machine that the emulation thread runs, and how the render thread talks to it
+typedef struct emulation_thread {
+    spaceinvaders_motherboard8080 *motherboard;
+    cpu8080 *cpu;
+    uint64_t total_states;
+    atomic_bool stop;             // set by the render thread when the window is closed
+    atomic_bool debug_requested;  // set by the render thread when Escape is pressed
+    atomic_bool finished;         // set by the emulation thread when it stops
+} emulation_thread;
+
+static int64_t monotonic_nanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * NANOSECONDS_PER_SECOND + now.tv_nsec;
+}
+
+static void sleep_until(int64_t deadline) {
+    struct timespec wake;
+    wake.tv_sec = deadline / NANOSECONDS_PER_SECOND;
+    wake.tv_nsec = deadline % NANOSECONDS_PER_SECOND;
+    // restarted if a signal interrupts it, which the absolute deadline makes safe
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR) {
+    }
+}
+
+/*
+Runs frames until the CPU stops or the render thread says to stop.  Each half of the screen is copied to the frame being
+made at the interrupt that ends it, and the frame is handed to the render thread at vblank, so emulation never waits for
+the display.  It does wait for the clock: after each frame it sleeps until that frame's deadline, so the game runs at
+the speed of the real machine.
+*/
+static void *run_emulation(void *arg) {
+    emulation_thread *emulation = (emulation_thread *) arg;
+    spaceinvaders_motherboard8080 *motherboard = emulation->motherboard;
+    cpu8080 *cpu = emulation->cpu;
+    scheduler8080 scheduler;
+    uint64_t frame_start, frames_paced = 0;
+    int64_t pacing_start, deadline, now;
+    bool run;
+
+    init_scheduler8080(&scheduler);
+    run = schedule_space_invaders_events(&scheduler);
+    pacing_start = monotonic_nanoseconds();
+
+    // A CPU halted with interrupts disabled can never run again.
+    while (run && !(cpu->halted && !cpu->interrupts_enabled) && !atomic_load(&(emulation->stop))) {
+        if (atomic_exchange(&(emulation->debug_requested), false)) {
+            debug_8080((motherboard8080 *) motherboard, cpu, &(emulation->total_states));
+        }
+
+        // runs to vblank; the Space Invaders events scan, interrupt and publish the frame
+        frame_start = scheduler.states;
+        run = run_scheduler8080(&scheduler, (motherboard8080 *) motherboard, cpu);
+        emulation->total_states += scheduler.states - frame_start;
+        if (!run) {
+            debug_8080((motherboard8080 *) motherboard, cpu, &(emulation->total_states));
+        }
+
+        /* Deadlines count from pacing_start rather than from the last wakeup, so a late wakeup doesn't push back the
+           frames after it.  A thread more than a frame behind, after the debugger or a stall, starts counting again
+           from now instead of running flat out to catch up. */
+        frames_paced++;
+        deadline = pacing_start + (int64_t) (frames_paced * NANOSECONDS_PER_SECOND / SPACE_INVADERS_FRAMES_PER_SECOND);
+        now = monotonic_nanoseconds();
+        if (now - deadline > NANOSECONDS_PER_SECOND / SPACE_INVADERS_FRAMES_PER_SECOND) {
+            pacing_start = now;
+            frames_paced = 0;
+        }
+        else if (now < deadline) {
+            sleep_until(deadline);
+        }
+    }
+    atomic_store(&(emulation->finished), true);
+    return NULL;
+}
+
+/*
+Checks scale_video_pixels() with every kernel this CPU supports against the scalar one, for each factor with and without
+scanlines, on random pixels and random ranges of columns, then prints the time each takes to scale a whole screen.
+Returns false if any kernel's pixels differ.
+*/
+static bool benchmark_video_scaling() {
+    uint32_t *pixels, *expected, *scaled;
+    size_t scaled_size = (size_t) SPACE_INVADERS_SCREEN_WIDTH * VIDEO_MAX_SCALE *
+                         SPACE_INVADERS_SCREEN_HEIGHT * VIDEO_MAX_SCALE * sizeof(uint32_t);
+    struct timeval start_time, end_time;
+    double sec;
+    int kernel, factor, scanlines, i, pixel, frame, first, count;
+    bool ok = true;
+
+    pixels = (uint32_t *) init_memory(SPACE_INVADERS_SCREEN_WIDTH * SPACE_INVADERS_SCREEN_HEIGHT * sizeof(uint32_t));
+    expected = (uint32_t *) init_memory(scaled_size);
+    scaled = (uint32_t *) init_memory(scaled_size);
+    srand(8080);
+    for (kernel = 0; kernel < VIDEO_NUM_KERNELS; kernel++) {
+        if (!video_kernel_supported(kernel)) {
+            continue;
+        }
+        for (factor = 1; factor <= VIDEO_MAX_SCALE; factor++) {
+            for (scanlines = 0; scanlines < 2; scanlines++) {
+                for (i = 0; i < SCALE_CHECK_COUNT; i++) {
+                    for (pixel = 0; pixel < SPACE_INVADERS_SCREEN_WIDTH * SPACE_INVADERS_SCREEN_HEIGHT; pixel++) {
+                        pixels[pixel] = ((uint32_t) rand() << 16) ^ rand();
+                    }
+                    first = (i == 0) ? 0 : rand() % SPACE_INVADERS_SCREEN_WIDTH;
+                    count = (i == 0) ? SPACE_INVADERS_SCREEN_WIDTH
+                                     : 1 + rand() % (SPACE_INVADERS_SCREEN_WIDTH - first);
+                    memset(expected, 0, scaled_size);
+                    memset(scaled, 0, scaled_size);
+                    scale_video_pixels(VIDEO_KERNEL_SCALAR, pixels, SPACE_INVADERS_SCREEN_WIDTH,
+                                       SPACE_INVADERS_SCREEN_HEIGHT, first, count, expected,
+                                       SPACE_INVADERS_SCREEN_WIDTH * factor, factor, scanlines);
+                    scale_video_pixels(kernel, pixels, SPACE_INVADERS_SCREEN_WIDTH, SPACE_INVADERS_SCREEN_HEIGHT,
+                                       first, count, scaled, SPACE_INVADERS_SCREEN_WIDTH * factor, factor, scanlines);
+                    if (memcmp(expected, scaled, scaled_size) != 0) {
+                        printf("Scaler %s %dx%s: columns %d to %d differ from scalar\n", video_kernel_name(kernel),
+                               factor, scanlines ? " scanlines" : "", first, first + count - 1);
+                        ok = false;
+                        break;
+                    }
+                }
+
+                gettimeofday(&start_time, NULL);
+                for (frame = 0; frame < SCALE_BENCHMARK_FRAMES; frame++) {
+                    scale_video_pixels(kernel, pixels, SPACE_INVADERS_SCREEN_WIDTH, SPACE_INVADERS_SCREEN_HEIGHT, 0,
+                                       SPACE_INVADERS_SCREEN_WIDTH, scaled, SPACE_INVADERS_SCREEN_WIDTH * factor,
+                                       factor, scanlines);
+                }
+                gettimeofday(&end_time, NULL);
+                sec = ((double)(end_time.tv_usec - start_time.tv_usec) / 1000000) +
+                      ((double)(end_time.tv_sec - start_time.tv_sec));
+                printf("Scaler %s %dx%s: %f usec per frame\n", video_kernel_name(kernel), factor,
+                       scanlines ? " scanlines" : "", sec * 1000000 / SCALE_BENCHMARK_FRAMES);
+            }
+        }
+    }
+    free(pixels);
+    free(expected);
+    free(scaled);
+    return ok;
+}
+
+/*
+Checks every video kernel this CPU supports against the scalar one, on random VRAM and random ranges of columns, then
+prints the time each kernel takes to convert a whole screen.  Returns false if any kernel's pixels differ.
+*/
+static bool benchmark_video_kernels() {
+    uint8_t vram[SPACE_INVADERS_VRAM_SIZE];
+    uint32_t *expected, *pixels;
+    struct timeval start_time, end_time;
+    double sec;
+    int kernel, i, byte, frame, first, count;
+    bool ok = true;
+
+    expected = (uint32_t *) init_memory(SPACE_INVADERS_SCREEN_WIDTH * SPACE_INVADERS_SCREEN_HEIGHT * sizeof(uint32_t));
+    pixels = (uint32_t *) init_memory(SPACE_INVADERS_SCREEN_WIDTH * SPACE_INVADERS_SCREEN_HEIGHT * sizeof(uint32_t));
+    srand(8080);
+    for (kernel = 0; kernel < VIDEO_NUM_KERNELS; kernel++) {
+        if (!video_kernel_supported(kernel)) {
+            printf("Video kernel %s: not supported\n", video_kernel_name(kernel));
+            continue;
+        }
+        for (i = 0; i < VIDEO_CHECK_COUNT; i++) {
+            for (byte = 0; byte < SPACE_INVADERS_VRAM_SIZE; byte++) {
+                vram[byte] = rand();
+            }
+            first = (i == 0) ? 0 : rand() % SPACE_INVADERS_SCREEN_WIDTH;
+            count = (i == 0) ? SPACE_INVADERS_SCREEN_WIDTH : 1 + rand() % (SPACE_INVADERS_SCREEN_WIDTH - first);
+            memset(expected, 0, SPACE_INVADERS_SCREEN_WIDTH * SPACE_INVADERS_SCREEN_HEIGHT * sizeof(uint32_t));
+            memset(pixels, 0, SPACE_INVADERS_SCREEN_WIDTH * SPACE_INVADERS_SCREEN_HEIGHT * sizeof(uint32_t));
+            expand_video_columns(VIDEO_KERNEL_SCALAR, vram, expected, SPACE_INVADERS_SCREEN_WIDTH, first, count,
+                                 SPACE_INVADERS_PIXEL_ON, SPACE_INVADERS_PIXEL_OFF);
+            expand_video_columns(kernel, vram, pixels, SPACE_INVADERS_SCREEN_WIDTH, first, count,
+                                 SPACE_INVADERS_PIXEL_ON, SPACE_INVADERS_PIXEL_OFF);
+            if (memcmp(expected, pixels,
+                       SPACE_INVADERS_SCREEN_WIDTH * SPACE_INVADERS_SCREEN_HEIGHT * sizeof(uint32_t)) != 0) {
+                printf("Video kernel %s: columns %d to %d differ from scalar\n", video_kernel_name(kernel), first,
+                       first + count - 1);
+                ok = false;
+                break;
+            }
+        }
+
+        gettimeofday(&start_time, NULL);
+        for (frame = 0; frame < VIDEO_BENCHMARK_FRAMES; frame++) {
+            expand_video_columns(kernel, vram, pixels, SPACE_INVADERS_SCREEN_WIDTH, 0, SPACE_INVADERS_SCREEN_WIDTH,
+                                 SPACE_INVADERS_PIXEL_ON, SPACE_INVADERS_PIXEL_OFF);
+        }
+        gettimeofday(&end_time, NULL);
+        sec = ((double)(end_time.tv_usec - start_time.tv_usec) / 1000000) +
+              ((double)(end_time.tv_sec - start_time.tv_sec));
+        printf("Video kernel %s: %f usec per frame%s\n", video_kernel_name(kernel),
+               sec * 1000000 / VIDEO_BENCHMARK_FRAMES, (kernel == best_video_kernel()) ? " (used)" : "");
+    }
+    free(expected);
+    free(pixels);
+    return ok;
+}
 
 int main(int argc, char *argv[]) {
 
-    uint64_t total_states, num_states, cur_states, total_instructions;
+    uint64_t total_states;
     double sec;
     bool run, debug_mode = false;
     clock_t start_time, end_time, diff;
     struct timeval start_time1, end_time1;
     double sec1;
-    uint16_t ignore;
     SDL_Event event;
+    emulation_thread emulation;
+    pthread_t emulation_thread_id;
+    int scale = 1, i;
+    bool scanlines = false, use_block_cache = false;
 
-    if (argc > 1) {
-        if (strncmp(argv[1], "-debug", 6) == 0) {
+    /*
+    -debug       start in the debugger
+    -scale N     make the window N times the size of the screen, 1 to VIDEO_MAX_SCALE; default 1
+    -scanlines   draw every Nth row at half brightness when scaled
+    -blockcache  run decoded blocks from a block cache, which lets the emulation skip the game's busy waits
+    -videobench  check the video kernels against each other and time them, without starting the game
+    */
+    for (i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "-debug", 6) == 0) {
             debug_mode = true;
         }
+        else if (strncmp(argv[i], "-scale", 6) == 0 && i + 1 < argc) {
+            scale = atoi(argv[++i]);
+        }
+        else if (strncmp(argv[i], "-scanlines", 10) == 0) {
+            scanlines = true;
+        }
+        else if (strncmp(argv[i], "-blockcache", 11) == 0) {
+            use_block_cache = true;
+        }
+        else if (strncmp(argv[i], "-videobench", 11) == 0) {
+            return (benchmark_video_kernels() & benchmark_video_scaling()) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else {
+            printf("Usage: %s [-debug] [-scale N] [-scanlines] [-blockcache] [-videobench]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (scale < 1 || scale > VIDEO_MAX_SCALE) {
+        printf("-scale must be from 1 to %d.\n", VIDEO_MAX_SCALE);
+        return EXIT_FAILURE;
     }
 
 
     total_states = 0;
-    total_instructions = 0;
 
     spaceinvaders_motherboard8080 motherboard;
     cpu8080 cpu;
+    rom_image8080 *rom;
     init_cpu8080(&cpu);
-    init_space_invaders_motherboard(&motherboard);
+    rom = load_space_invaders_rom();
+    if (rom == NULL) {
+        return EXIT_FAILURE;
+    }
+    init_space_invaders_motherboard(&motherboard, rom, scale, scanlines);
+    release_rom_image(&rom);
+    if (use_block_cache) {
+        cpu.block_cache = init_block_cache8080();
+        if (cpu.block_cache == NULL) {
+            printf("Unable to allocate block cache; running without it.\n");
+        }
+    }
     
 
 
@@ -46,14 +299,25 @@ int main(int argc, char *argv[]) {
     run = true;
 
     if (debug_mode) {
-        run = debug_8080((motherboard8080 *) &motherboard, &cpu, &total_states, &total_instructions);
+        run = debug_8080((motherboard8080 *) &motherboard, &cpu, &total_states);
+    }
+    /* The emulation runs on its own thread, and this one is the render thread: SDL wants events handled and the window
+       drawn on the thread that made it.  A slow present only means frames are dropped, not that emulation waits. */
+    emulation.motherboard = &motherboard;
+    emulation.cpu = &cpu;
+    emulation.total_states = total_states;
+    atomic_init(&(emulation.stop), !run);
+    atomic_init(&(emulation.debug_requested), false);
+    atomic_init(&(emulation.finished), false);
+    if (pthread_create(&emulation_thread_id, NULL, &run_emulation, &emulation) != 0) {
+        printf("Unable to start emulation thread.\n");
+        return EXIT_FAILURE;
     }
-    while (run && (!cpu.halted)) {
-        
+    while (!atomic_load(&(emulation.finished))) {
         while (SDL_PollEvent(&event)) {
             switch(event.type) {
                 case SDL_QUIT:
-                    run = false;
+                    atomic_store(&(emulation.stop), true);
                     break;
                 case SDL_KEYDOWN:
                     switch(event.key.keysym.sym) {
@@ -79,7 +343,7 @@ int main(int argc, char *argv[]) {
                             motherboard.player_two_fire_pressed = true;
                             break;
                         case SDLK_ESCAPE:
-                            debug_8080((motherboard8080 *) &motherboard, &cpu, &total_states, &total_instructions);
+                            atomic_store(&(emulation.debug_requested), true);
                             break;
                     }
                     break;
@@ -111,41 +375,14 @@ int main(int argc, char *argv[]) {
             }
         }
 
-        cur_states = 0;
-        while (run && cur_states <= 16667) {
-            run = cycle_cpu8080((motherboard8080 *) &motherboard, &cpu, &num_states);
-            if (run) {
-                cur_states += num_states;
-                total_states += num_states;
-                total_instructions ++;
-            }
-            else {
-                debug_8080((motherboard8080 *) &motherboard, &cpu, &total_states, &total_instructions);
-            }
+        if (!spaceinvaders_screen_present(&motherboard)) {
+            SDL_Delay(1);
         }
-        if (run) {
-            // first interrupt
-            do_interrupt((motherboard8080 *) &motherboard, &cpu, 1, &ignore);
-        }
-        while (run && cur_states <= 33333) {
-            run = cycle_cpu8080((motherboard8080 *) &motherboard, &cpu, &num_states);
-            if (run) {
-                cur_states += num_states;
-                total_states += num_states;
-                total_instructions ++;
-            }
-            else {
-                debug_8080((motherboard8080 *) &motherboard, &cpu, &total_states, &total_instructions);
-            }
-        }
-        if (run) {
-            // second interrupt
-            do_interrupt((motherboard8080 *) &motherboard, &cpu, 2, &ignore);
-        }
-        spaceinvaders_screen_draw(&motherboard);
-
-        // insert loop here to delay
     }
+    pthread_join(emulation_thread_id, NULL);
+    total_states = emulation.total_states;
+    // the last frame, if the render thread didn't get to it
+    spaceinvaders_screen_present(&motherboard);
     end_time = clock();
     gettimeofday(&end_time1, NULL);
     diff = end_time - start_time;
@@ -154,14 +391,29 @@ int main(int argc, char *argv[]) {
 
     printf("Duration in CPU time: %f sec\n", sec);
     printf("Duration in clock time: %f sec\n", sec1);
-    printf("Num instructions: %ld\n", total_instructions);
+    printf("Num instructions: %ld\n", cpu.instructions_executed);
     if (sec > 0) {
         printf("Performance: %f states per CPU second\n", ((double)total_states) / sec);
     }
     if (sec1 > 0) {
         printf("Performance: %f states per clock second\n", ((double)total_states) / sec1);
     }
+    if (motherboard.render_frames > 0) {
+        printf("Render: %f ms per frame\n",
+               ((double)motherboard.render_ticks) * 1000 / SDL_GetPerformanceFrequency() / motherboard.render_frames);
+        printf("Render: %.1f VRAM bytes converted in %.1f texture uploads per frame\n",
+               ((double)motherboard.render_bytes) / motherboard.render_frames,
+               ((double)motherboard.render_uploads) / motherboard.render_frames);
+    }
+    if (motherboard.vram_frames > 0) {
+        printf("VRAM: %.1f of %d columns written per frame\n",
+               ((double)motherboard.vram_dirty_columns) / motherboard.vram_frames, SPACE_INVADERS_SCREEN_WIDTH);
+    }
 
+    if (cpu.block_cache != NULL) {
+        print_block_cache_stats(cpu.block_cache);
+        destroy_block_cache8080(&(cpu.block_cache));
+    }
     destroy_spaceinvaders_motherboard(&motherboard);
     return EXIT_SUCCESS;
 }
\ No newline at end of file
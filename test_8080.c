@@ -10,60 +10,131 @@
 #include "cpu8080.h"
 #include "motherboard.h"
 #include "debugger.h"
+#include "alu8080.h"
+#include "blockcache.h"
+#include "jit8080.h"
+
+// switch, threaded, block cache and JIT; see main()
+#define NUM_ENGINES 4
+
+// With -banks, memory below BANKED_MEMORY_END is banked and the top 16K is common, as in CP/M 3
+#define BANKED_MEMORY_END 0xC000
+// Bank switches timed by benchmark_bank_switches()
+#define BANK_SWITCH_BENCHMARK_COUNT 100000
+
+// With -iotest, this page is the memory-mapped device of run_io_test()
+#define IO_TEST_PAGE 0xE000
+// Reads of this address return 0 until it has been read IO_TEST_POLLS times, then 1
+#define IO_TEST_STATUS 0xE080
+#define IO_TEST_POLLS 20
+#define IO_TEST_MAX_ACCESSES 256
+// The program takes a few thousand states; an engine that gets the device wrong can loop forever
+#define IO_TEST_MAX_STATES 1000000
+
+// A read or write the -iotest program made of the device
+typedef struct {
+    uint16_t address;
+    uint8_t value;
+    bool write;
+} io_test_access;
+
+// Test computer with a device on IO_TEST_PAGE that logs every access
+typedef struct {
+    motherboard8080 base;  // first, so the handlers can get here from the motherboard8080 they are given
+    io_test_access accesses[IO_TEST_MAX_ACCESSES];
+    int num_accesses;
+    int status_reads;
+} io_test_motherboard8080;
 
 
 /*
 Virtual computer to run 8080 Emulator tests.  Tests may be found at https://altairclone.com/downloads/cpu_tests/
 */  
 
-int main(int argc, char *argv[]) {
-
-    uint64_t total_states, num_states, total_instructions;
+/*
+Switches between the first two banks BANK_SWITCH_BENCHMARK_COUNT times, the way an OUT to TEST_BANK_SELECT_PORT does, and
+prints the time per switch.  With a block cache, each switch also throws away the blocks decoded from the banked memory.
+*/
+void benchmark_bank_switches(motherboard8080 *motherboard, cpu8080 *cpu) {
+    struct timeval start_time, end_time;
     double sec;
-    bool run, debug_mode = false;
-    clock_t start_time, end_time, diff;
-    struct timeval start_time1, end_time1;
-    double sec1;
+    int i;
 
-    if (argc > 1) {
-        if (strncmp(argv[1], "-debug", 6) == 0) {
-            debug_mode = true;
+    gettimeofday(&start_time, NULL);
+    for (i = 0; i < BANK_SWITCH_BENCHMARK_COUNT; i++) {
+        select_memory_bank(motherboard->memory_map, (i + 1) & 1);
+        if (cpu->block_cache != NULL) {
+            block_cache_note_bank_switches(cpu->block_cache, motherboard->memory_map);
         }
     }
+    gettimeofday(&end_time, NULL);
+    sec = ((double)(end_time.tv_usec - start_time.tv_usec) / 1000000) + ((double)(end_time.tv_sec - start_time.tv_sec));
+    printf("Bank switch: %f usec (%s)\n", sec * 1000000 / BANK_SWITCH_BENCHMARK_COUNT,
+           (motherboard->memory_map->bank_storage == NULL) ? "remapped" : "copied");
+}
 
+/*
+Runs rom_name on a freshly initialized test computer using the given dispatch engine, and the basic block cache if 
+use_block_cache is set.  use_jit adds the JIT on top of the block cache.  With num_banks above 1, the memory below
+BANKED_MEMORY_END is banked, and bank switches are benchmarked after the run.  Prints the timing report, and copies the
+CPU's final state to final_cpu.  Returns the performance in states per clock second, or -1 if the ROM can't be loaded.
+*/
+double run_test_rom(char *rom_name, cpu8080_dispatch dispatch, bool use_block_cache, bool use_jit, bool debug_mode, 
+                    int num_banks, cpu8080 *final_cpu) {
+
+    uint64_t total_states;
+    cpu8080_stop_reason stop_reason;
+    double sec;
+    bool run;
+    clock_t start_time, end_time, diff;
+    struct timeval start_time1, end_time1;
+    double sec1, retval = 0;
 
     total_states = 0;
-    total_instructions = 0;
 
     motherboard8080 motherboard;
     cpu8080 cpu;
     init_test_cpu8080(&cpu);
-    init_test_motherboard(&motherboard);
+    cpu.dispatch = dispatch;
+    init_test_motherboard(&motherboard, NULL);
     
     load_cpm_shim(motherboard.memory);
 
     // all test ROMs are loaded starting 0x100.  
-    // load_rom("TST8080.COM", 0x100, motherboard.memory);
-    // load_rom("8080PRE.COM", 0x100, motherboard.memory);
-    // load_rom("CPUTEST.COM", 0x100, motherboard.memory);
-    load_rom("8080EXM.COM", 0x100, motherboard.memory);
+    if (!load_rom(rom_name, 0x100, motherboard.memory, MEMORY_NUM_PAGES * MEMORY_PAGE_SIZE, NULL)) {
+        destroy_motherboard(&motherboard);
+        return -1;
+    }
+
+    if (num_banks > 1 && !init_memory_banks(motherboard.memory_map, 0x0000, BANKED_MEMORY_END, num_banks)) {
+        num_banks = 1;
+    }
+
+    if (use_block_cache || use_jit) {
+        cpu.block_cache = init_block_cache8080();
+        if (cpu.block_cache == NULL) {
+            printf("Unable to allocate block cache; running without it.\n");
+        }
+    }
+    if (use_jit && cpu.block_cache != NULL) {
+        cpu.jit = init_jit8080();
+        if (cpu.jit == NULL) {
+            printf("JIT is not available; running in the interpreter.\n");
+        }
+    }
     
     start_time = clock();
     gettimeofday(&start_time1, NULL);
     run = true;
 
     if (debug_mode) {
-        run = debug_8080(&motherboard, &cpu, &total_states, &total_instructions);
+        run = debug_8080(&motherboard, &cpu, &total_states);
     }
 
     while (run && (!cpu.halted)) {
-        run = cycle_cpu8080(&motherboard, &cpu, &num_states);
-        if (run) {
-            total_states = total_states + num_states;
-            total_instructions++;
-        }
-        else {
-            debug_8080(&motherboard, &cpu, &total_states, &total_instructions);
+        total_states = total_states + run_cpu8080(&motherboard, &cpu, UINT64_MAX, &stop_reason);
+        if (stop_reason == STOP_ERROR) {
+            debug_8080(&motherboard, &cpu, &total_states);
             run = false;
         }
     }
@@ -75,14 +146,297 @@ int main(int argc, char *argv[]) {
 
     printf("Duration in CPU time: %f sec\n", sec);
     printf("Duration in clock time: %f sec\n", sec1);
-    printf("Num instructions: %ld\n", total_instructions);
+    printf("Num instructions: %ld\n", cpu.instructions_executed);
     if (sec > 0) {
         printf("Performance: %f states per CPU second\n", ((double)total_states) / sec);
     }
     if (sec1 > 0) {
-        printf("Performance: %f states per clock second\n", ((double)total_states) / sec1);
+        retval = ((double)total_states) / sec1;
+        printf("Performance: %f states per clock second\n", retval);
+    }
+    if (num_banks > 1) {
+        benchmark_bank_switches(&motherboard, &cpu);
+    }
+    if (cpu.jit != NULL) {
+        printf("JIT: %lu blocks translated, %lu native block runs, %lu flushes\n", cpu.jit->blocks_translated, 
+               cpu.jit->native_blocks_run, cpu.jit->flushes);
+        destroy_jit8080(&(cpu.jit));
+    }
+    if (cpu.block_cache != NULL) {
+        print_block_cache_stats(cpu.block_cache);
+        destroy_block_cache8080(&(cpu.block_cache));
     }
 
+    *final_cpu = cpu;
     destroy_motherboard(&motherboard);
+    return retval;
+}
+
+bool same_cpu_state(cpu8080 *cpu1, cpu8080 *cpu2) {
+    // compares everything the program can observe; the dispatch engine is deliberately left out.
+    materialize_flags(cpu1);
+    materialize_flags(cpu2);
+    return (cpu1->pc == cpu2->pc && cpu1->sp == cpu2->sp && cpu1->stack_pointer_start == cpu2->stack_pointer_start &&
+            cpu1->a == cpu2->a && cpu1->b == cpu2->b && cpu1->c == cpu2->c && cpu1->d == cpu2->d &&
+            cpu1->e == cpu2->e && cpu1->h == cpu2->h && cpu1->l == cpu2->l &&
+            cpu1->enable_interrupts_after_next_instruction == cpu2->enable_interrupts_after_next_instruction &&
+            cpu1->interrupts_enabled == cpu2->interrupts_enabled && cpu1->halted == cpu2->halted &&
+            cpu1->zero_flag == cpu2->zero_flag && cpu1->carry_flag == cpu2->carry_flag && cpu1->sign_flag == cpu2->sign_flag &&
+            cpu1->parity_flag == cpu2->parity_flag && cpu1->auxiliary_carry_flag == cpu2->auxiliary_carry_flag);
+}
+
+static void add_io_test_access(io_test_access *accesses, int *num_accesses, uint16_t address, uint8_t value,
+                               bool write) {
+    if (*num_accesses < IO_TEST_MAX_ACCESSES) {
+        accesses[*num_accesses].address = address;
+        accesses[*num_accesses].value = value;
+        accesses[*num_accesses].write = write;
+    }
+    (*num_accesses)++;
+}
+
+// The device: IO_TEST_STATUS counts its reads, and every other address reads as its low byte XOR 0x5A.
+uint8_t read_io_test_device(motherboard8080 *motherboard, uint16_t address) {
+    io_test_motherboard8080 *board = (io_test_motherboard8080 *)motherboard;
+    uint8_t value;
+
+    if (address == IO_TEST_STATUS) {
+        board->status_reads++;
+        value = (board->status_reads >= IO_TEST_POLLS) ? 1 : 0;
+    }
+    else {
+        value = (address & 0xFF) ^ 0x5A;
+    }
+    add_io_test_access(board->accesses, &(board->num_accesses), address, value, false);
+    return value;
+}
+
+void write_io_test_device(motherboard8080 *motherboard, uint16_t address, uint8_t value) {
+    io_test_motherboard8080 *board = (io_test_motherboard8080 *)motherboard;
+
+    add_io_test_access(board->accesses, &(board->num_accesses), address, value, true);
+}
+
+/*
+Runs a built-in program that reads and writes IO_TEST_PAGE with the given engine, and checks that the device saw exactly
+the accesses the program makes, in order.  The first loop runs often enough for the JIT to translate it, so its
+translated code has to hand the accesses to the interpreter.  The last loop polls IO_TEST_STATUS without changing a
+register, and must not be skipped as a busy wait, or the device would see fewer than IO_TEST_POLLS reads.
+*/
+bool run_io_test(char *engine_name, cpu8080_dispatch dispatch, bool use_block_cache, bool use_jit) {
+    uint8_t program[] = {
+        0x31, 0x00, 0x20,  // 0x0100:          LXI SP, 0x2000
+        0x21, 0x00, 0xE0,  // 0x0103:          LXI H, 0xE000
+        0x06, 0x40,        // 0x0106:          MVI B, 0x40
+        0x7E,              // 0x0108: loop:    MOV A, M
+        0xC6, 0x01,        // 0x0109:          ADI 1
+        0x77,              // 0x010B:          MOV M, A
+        0x23,              // 0x010C:          INX H
+        0x05,              // 0x010D:          DCR B
+        0xC2, 0x08, 0x01,  // 0x010E:          JNZ loop
+        0x3A, 0xF0, 0xE0,  // 0x0111:          LDA 0xE0F0
+        0x32, 0xF1, 0xE0,  // 0x0114:          STA 0xE0F1
+        0x21, 0x34, 0x12,  // 0x0117:          LXI H, 0x1234
+        0x22, 0xF2, 0xE0,  // 0x011A:          SHLD 0xE0F2
+        0x31, 0x00, 0xE1,  // 0x011D:          LXI SP, 0xE100
+        0xE5,              // 0x0120:          PUSH H
+        0xE1,              // 0x0121:          POP H
+        0x31, 0x00, 0x20,  // 0x0122:          LXI SP, 0x2000
+        0x3A, 0x80, 0xE0,  // 0x0125: poll:    LDA IO_TEST_STATUS
+        0xB7,              // 0x0128:          ORA A
+        0xCA, 0x25, 0x01,  // 0x0129:          JZ poll
+        0x76               // 0x012C:          HLT
+    };
+    io_test_access expected[IO_TEST_MAX_ACCESSES];
+    io_test_motherboard8080 board;
+    cpu8080 cpu;
+    cpu8080_stop_reason stop_reason;
+    uint64_t total_states = 0, busy_wait_skips = 0, blocks_translated = 0;
+    int num_expected = 0, i;
+    bool ok = true;
+
+    for (i = 0; i < 0x40; i++) {
+        add_io_test_access(expected, &num_expected, IO_TEST_PAGE + i, i ^ 0x5A, false);
+        add_io_test_access(expected, &num_expected, IO_TEST_PAGE + i, (i ^ 0x5A) + 1, true);
+    }
+    add_io_test_access(expected, &num_expected, 0xE0F0, 0xF0 ^ 0x5A, false);
+    add_io_test_access(expected, &num_expected, 0xE0F1, 0xF0 ^ 0x5A, true);
+    add_io_test_access(expected, &num_expected, 0xE0F2, 0x34, true);
+    add_io_test_access(expected, &num_expected, 0xE0F3, 0x12, true);
+    add_io_test_access(expected, &num_expected, 0xE0FF, 0x12, true);
+    add_io_test_access(expected, &num_expected, 0xE0FE, 0x34, true);
+    add_io_test_access(expected, &num_expected, 0xE0FE, 0xFE ^ 0x5A, false);
+    add_io_test_access(expected, &num_expected, 0xE0FF, 0xFF ^ 0x5A, false);
+    for (i = 1; i <= IO_TEST_POLLS; i++) {
+        add_io_test_access(expected, &num_expected, IO_TEST_STATUS, (i == IO_TEST_POLLS) ? 1 : 0, false);
+    }
+
+    init_test_cpu8080(&cpu);
+    cpu.dispatch = dispatch;
+    init_test_motherboard(&(board.base), NULL);
+    board.num_accesses = 0;
+    board.status_reads = 0;
+    map_memory_io(&(board.base), IO_TEST_PAGE, MEMORY_PAGE_SIZE, &read_io_test_device, &write_io_test_device);
+    load_cpm_shim(board.base.memory);
+    memcpy(&(board.base.memory[0x100]), program, sizeof(program));
+    if (use_block_cache || use_jit) {
+        cpu.block_cache = init_block_cache8080();
+    }
+    if (use_jit && cpu.block_cache != NULL) {
+        cpu.jit = init_jit8080();
+    }
+
+    while (ok && !cpu.halted && total_states < IO_TEST_MAX_STATES) {
+        total_states += run_cpu8080(&(board.base), &cpu, IO_TEST_MAX_STATES - total_states, &stop_reason);
+        ok = (stop_reason != STOP_ERROR);
+    }
+
+    if (cpu.jit != NULL) {
+        blocks_translated = cpu.jit->blocks_translated;
+        destroy_jit8080(&(cpu.jit));
+    }
+    if (cpu.block_cache != NULL) {
+        busy_wait_skips = cpu.block_cache->busy_wait_skips;
+        destroy_block_cache8080(&(cpu.block_cache));
+    }
+    destroy_motherboard(&(board.base));
+
+    printf("%-10s %4d accesses, %lu busy-wait skips, %lu blocks translated\n", engine_name, board.num_accesses,
+           busy_wait_skips, blocks_translated);
+    if (!ok || !cpu.halted) {
+        printf("ERROR: %s %s.\n", engine_name, ok ? "did not finish" : "stopped with an error");
+        return false;
+    }
+    if (board.base.memory_io_accesses != (uint64_t)num_expected) {
+        printf("ERROR: %s counted %lu memory-mapped accesses, not %d.\n", engine_name,
+               board.base.memory_io_accesses, num_expected);
+        ok = false;
+    }
+    if (busy_wait_skips > 0) {
+        printf("ERROR: %s skipped a busy wait that reads the device.\n", engine_name);
+        ok = false;
+    }
+    if (use_jit && blocks_translated == 0) {
+        printf("ERROR: %s translated nothing.\n", engine_name);
+        ok = false;
+    }
+    for (i = 0; i < num_expected || i < board.num_accesses; i++) {
+        if (i >= num_expected || i >= board.num_accesses || i >= IO_TEST_MAX_ACCESSES ||
+            board.accesses[i].address != expected[i].address || board.accesses[i].value != expected[i].value ||
+            board.accesses[i].write != expected[i].write) {
+            printf("ERROR: %s access %d is not the expected %s of %02X at %04X.\n", engine_name, i,
+                   (i < num_expected && expected[i].write) ? "write" : "read",
+                   (i < num_expected) ? expected[i].value : 0, (i < num_expected) ? expected[i].address : 0);
+            ok = false;
+            break;
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+
+    bool debug_mode = false, compare_mode = false, io_test_mode = false, use_block_cache = false, use_jit = false;
+    cpu8080_dispatch dispatch = CPU8080_DEFAULT_DISPATCH;
+    cpu8080 final_cpus[NUM_ENGINES];
+    double performance[NUM_ENGINES];
+    char *rom_name;
+    int i, num_banks = 1;
+
+    // the engines -compare runs, in the order they are reported
+    char *engine_names[NUM_ENGINES] = {"switch", "threaded", "blockcache", "jit"};
+    cpu8080_dispatch engine_dispatch[NUM_ENGINES] = {DISPATCH_SWITCH, DISPATCH_THREADED, CPU8080_DEFAULT_DISPATCH, 
+                                                     CPU8080_DEFAULT_DISPATCH};
+    bool engine_block_cache[NUM_ENGINES] = {false, false, true, true};
+    bool engine_jit[NUM_ENGINES] = {false, false, false, true};
+
+    /*
+    -debug       start in the debugger
+    -threaded    use the threaded (computed goto) dispatch engine instead of the switch
+    -blockcache  execute decoded basic blocks from the block cache
+    -jit         translate hot blocks to native code (x86-64 only)
+    -compare     run the ROM once with each engine and compare speed and final CPU state
+    -banks N     bank the memory below 0xC000 into N banks, switched with OUT 1, and benchmark bank switches
+    -selfcheck   check every entry of the precomputed ALU tables against the reference implementation and exit
+    -iotest      run a built-in program against a memory-mapped device with each engine, check its accesses and exit
+    */
+    for (i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "-debug", 6) == 0) {
+            debug_mode = true;
+        }
+        else if (strncmp(argv[i], "-threaded", 9) == 0) {
+            dispatch = DISPATCH_THREADED;
+        }
+        else if (strncmp(argv[i], "-blockcache", 11) == 0) {
+            use_block_cache = true;
+        }
+        else if (strncmp(argv[i], "-jit", 4) == 0) {
+            use_jit = true;
+        }
+        else if (strncmp(argv[i], "-compare", 8) == 0) {
+            compare_mode = true;
+        }
+        else if (strncmp(argv[i], "-banks", 6) == 0 && i + 1 < argc) {
+            num_banks = atoi(argv[++i]);
+        }
+        else if (strncmp(argv[i], "-selfcheck", 10) == 0) {
+            return (alu8080_self_check()) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (strncmp(argv[i], "-iotest", 7) == 0) {
+            io_test_mode = true;
+        }
+    }
+
+    if (io_test_mode) {
+        for (i = 0; i < NUM_ENGINES; i++) {
+            if (!run_io_test(engine_names[i], engine_dispatch[i], engine_block_cache[i], engine_jit[i])) {
+                return EXIT_FAILURE;
+            }
+        }
+        printf("Memory-mapped I/O is identical.\n");
+        return EXIT_SUCCESS;
+    }
+
+    // rom_name = "TST8080.COM";
+    // rom_name = "8080PRE.COM";
+    // rom_name = "CPUTEST.COM";
+    rom_name = "8080EXM.COM";
+
+    if (!compare_mode) {
+        if (run_test_rom(rom_name, dispatch, use_block_cache, use_jit, debug_mode, num_banks, &final_cpus[0]) < 0) {
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+#ifndef CPU8080_HAS_THREADED_DISPATCH
+    printf("Threaded dispatch is not available with this compiler; the threaded run will use the switch.\n");
+#endif
+    for (i = 0; i < NUM_ENGINES; i++) {
+        printf("%s=== %s ===\n", (i > 0) ? "\n" : "", engine_names[i]);
+        performance[i] = run_test_rom(rom_name, engine_dispatch[i], engine_block_cache[i], engine_jit[i], debug_mode, 
+                                      num_banks, &final_cpus[i]);
+        if (performance[i] < 0) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("\n%-10s %24s %9s\n", "Engine", "States per clock second", "Speedup");
+    for (i = 0; i < NUM_ENGINES; i++) {
+        printf("%-10s %24.0f", engine_names[i], performance[i]);
+        if (performance[0] > 0) {
+            printf(" %8.3fx", performance[i] / performance[0]);
+        }
+        printf("\n");
+    }
+    for (i = 1; i < NUM_ENGINES; i++) {
+        if (!same_cpu_state(&final_cpus[0], &final_cpus[i])) {
+            printf("ERROR: final CPU state differs between %s and %s.\n", engine_names[0], engine_names[i]);
+            debug_dump_8080(final_cpus[0]);
+            debug_dump_8080(final_cpus[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    printf("Final CPU state is identical.\n");
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,371 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "video.h"
+
+#ifdef VIDEO_HAS_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+static const char *kernel_names[VIDEO_NUM_KERNELS] = {"scalar", "sse2", "avx2"};
+
+const char *video_kernel_name(video_kernel kernel) {
+    return kernel_names[kernel];
+}
+
+bool video_kernel_supported(video_kernel kernel) {
+    switch (kernel) {
+        case VIDEO_KERNEL_SCALAR:
+            return true;
+#ifdef VIDEO_HAS_X86_KERNELS
+        case VIDEO_KERNEL_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case VIDEO_KERNEL_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+video_kernel best_video_kernel() {
+    video_kernel kernel = VIDEO_NUM_KERNELS - 1;
+
+    while (!video_kernel_supported(kernel)) {
+        kernel--;
+    }
+    return kernel;
+}
+
+// pixels points at pixel (0, 0) and has pitch pixels a row; column x of the screen starts at columns[x * 32].
+static void expand_scalar(const uint8_t *columns, uint32_t *pixels, int pitch, int first, int count, uint32_t on,
+                          uint32_t off) {
+    int x, y, row_byte, bit;
+
+    for (y = 0; y < VIDEO_COLUMN_HEIGHT; y++) {
+        row_byte = (VIDEO_COLUMN_HEIGHT - 1 - y) / 8;
+        bit = (VIDEO_COLUMN_HEIGHT - 1 - y) % 8;
+        for (x = first; x < first + count; x++) {
+            pixels[y * pitch + x] = ((columns[x * VIDEO_COLUMN_BYTES + row_byte] >> bit) & 0x01) ? on : off;
+        }
+    }
+}
+
+// A pixel at half brightness, for the last row of each block with scanlines.
+static inline uint32_t scanline_pixel(uint32_t pixel) {
+    return (pixel & 0xFF000000) | ((pixel >> 1) & 0x007F7F7F);
+}
+
+// The rows of block row y of scaled, as scale_video_pixels() lays them out.
+static inline uint32_t *scaled_row(uint32_t *scaled, int scaled_pitch, int y, int factor, int row) {
+    return scaled + (y * factor + row) * scaled_pitch;
+}
+
+static void scale_scalar(const uint32_t *pixels, int pitch, int height, int first, int count, uint32_t *scaled,
+                         int scaled_pitch, int factor, bool scanlines) {
+    uint32_t pixel;
+    int x, y, row, i;
+
+    for (y = 0; y < height; y++) {
+        for (x = first; x < first + count; x++) {
+            pixel = pixels[y * pitch + x];
+            for (row = 0; row < factor; row++) {
+                for (i = 0; i < factor; i++) {
+                    scaled_row(scaled, scaled_pitch, y, factor, row)[x * factor + i] =
+                        (scanlines && factor > 1 && row == factor - 1) ? scanline_pixel(pixel) : pixel;
+                }
+            }
+        }
+    }
+}
+
+#ifdef VIDEO_HAS_X86_KERNELS
+
+/* Transposes 16 rows of 16 bytes: afterwards, byte i of rows[j] is what byte j of rows[i] was.  Each round interleaves
+   rows i and i + 8, which rotates the 8 bit (row, byte) index right by one; four rounds swap its halves. */
+static inline void transpose_16x16(__m128i *rows) {
+    __m128i t[16];
+    int round, i;
+
+    for (round = 0; round < 4; round++) {
+        for (i = 0; i < 8; i++) {
+            t[2 * i] = _mm_unpacklo_epi8(rows[i], rows[i + 8]);
+            t[2 * i + 1] = _mm_unpackhi_epi8(rows[i], rows[i + 8]);
+        }
+        memcpy(rows, t, sizeof(t));
+    }
+}
+
+// Stores 16 pixels for the 16 bits of mask, bit 0 first.
+static inline void store_pixels_sse2(uint32_t *out, uint32_t mask, __m128i on, __m128i off) {
+    __m128i bits = _mm_set1_epi32(mask);
+    __m128i select = _mm_set_epi32(8, 4, 2, 1);
+    __m128i set;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        set = _mm_cmpeq_epi32(_mm_and_si128(bits, select), select);
+        _mm_storeu_si128((__m128i *) (out + 4 * i), _mm_or_si128(_mm_and_si128(set, on), _mm_andnot_si128(set, off)));
+        select = _mm_slli_epi32(select, 4);
+    }
+}
+
+// 16 columns at a time: after the transpose, the top bit of each byte of a row of bytes is one row of pixels.
+static void expand_sse2(const uint8_t *columns, uint32_t *pixels, int pitch, int first, int count, uint32_t on,
+                        uint32_t off) {
+    __m128i rows[16], bytes;
+    __m128i on_pixels = _mm_set1_epi32(on), off_pixels = _mm_set1_epi32(off);
+    uint32_t *out;
+    int x, half, i, bit;
+
+    for (x = first; x + 16 <= first + count; x += 16) {
+        for (half = 0; half < 2; half++) {
+            for (i = 0; i < 16; i++) {
+                rows[i] = _mm_loadu_si128((const __m128i *) (columns + (x + i) * VIDEO_COLUMN_BYTES + 16 * half));
+            }
+            transpose_16x16(rows);
+            for (i = 0; i < 16; i++) {
+                // byte 16 * half + i of the columns, whose bit 7 is the highest of its 8 rows
+                bytes = rows[i];
+                out = pixels + (VIDEO_COLUMN_HEIGHT - 8 * (16 * half + i + 1)) * pitch + x;
+                for (bit = 7; bit >= 0; bit--) {
+                    store_pixels_sse2(out, _mm_movemask_epi8(bytes), on_pixels, off_pixels);
+                    bytes = _mm_add_epi8(bytes, bytes);
+                    out += pitch;
+                }
+            }
+        }
+    }
+    if (x < first + count) {
+        expand_scalar(columns, pixels, pitch, x, first + count - x, on, off);
+    }
+}
+
+/* 4 pixels of a row at a time: each is repeated factor times across factor vectors with _mm_shuffle_epi32, and those
+   are stored to each row of the block. */
+static void scale_sse2(const uint32_t *pixels, int pitch, int height, int first, int count, uint32_t *scaled,
+                       int scaled_pitch, int factor, bool scanlines) {
+    __m128i wide[VIDEO_MAX_SCALE], pixel;
+    __m128i alpha = _mm_set1_epi32(0xFF000000), half = _mm_set1_epi32(0x007F7F7F);
+    uint32_t *out;
+    int wide_end = first + count / 4 * 4;  // the columns done 4 at a time end here
+    int x, y, row, i;
+
+    for (y = 0; y < height; y++) {
+        for (x = first; x < wide_end; x += 4) {
+            pixel = _mm_loadu_si128((const __m128i *) (pixels + y * pitch + x));
+            switch (factor) {
+                case 1:
+                    wide[0] = pixel;
+                    break;
+                case 2:
+                    wide[0] = _mm_unpacklo_epi32(pixel, pixel);
+                    wide[1] = _mm_unpackhi_epi32(pixel, pixel);
+                    break;
+                case 3:
+                    wide[0] = _mm_shuffle_epi32(pixel, _MM_SHUFFLE(1, 0, 0, 0));
+                    wide[1] = _mm_shuffle_epi32(pixel, _MM_SHUFFLE(2, 2, 1, 1));
+                    wide[2] = _mm_shuffle_epi32(pixel, _MM_SHUFFLE(3, 3, 3, 2));
+                    break;
+                default:
+                    wide[0] = _mm_shuffle_epi32(pixel, _MM_SHUFFLE(0, 0, 0, 0));
+                    wide[1] = _mm_shuffle_epi32(pixel, _MM_SHUFFLE(1, 1, 1, 1));
+                    wide[2] = _mm_shuffle_epi32(pixel, _MM_SHUFFLE(2, 2, 2, 2));
+                    wide[3] = _mm_shuffle_epi32(pixel, _MM_SHUFFLE(3, 3, 3, 3));
+                    break;
+            }
+            for (row = 0; row < factor; row++) {
+                out = scaled_row(scaled, scaled_pitch, y, factor, row) + x * factor;
+                for (i = 0; i < factor; i++) {
+                    if (scanlines && factor > 1 && row == factor - 1) {
+                        wide[i] = _mm_or_si128(_mm_and_si128(wide[i], alpha),
+                                               _mm_and_si128(_mm_srli_epi32(wide[i], 1), half));
+                    }
+                    _mm_storeu_si128((__m128i *) (out + 4 * i), wide[i]);
+                }
+            }
+        }
+    }
+    if (wide_end < first + count) {
+        scale_scalar(pixels, pitch, height, wide_end, first + count - wide_end, scaled, scaled_pitch, factor,
+                     scanlines);
+    }
+}
+
+// As transpose_16x16(), for both 128-bit lanes at once.
+__attribute__((target("avx2")))
+static inline void transpose_16x16_avx2(__m256i *rows) {
+    __m256i t[16];
+    int round, i;
+
+    for (round = 0; round < 4; round++) {
+        for (i = 0; i < 8; i++) {
+            t[2 * i] = _mm256_unpacklo_epi8(rows[i], rows[i + 8]);
+            t[2 * i + 1] = _mm256_unpackhi_epi8(rows[i], rows[i + 8]);
+        }
+        memcpy(rows, t, sizeof(t));
+    }
+}
+
+// Stores 32 pixels for the 32 bits of mask, bit 0 first.
+__attribute__((target("avx2")))
+static inline void store_pixels_avx2(uint32_t *out, uint32_t mask, __m256i on, __m256i off) {
+    __m256i bits = _mm256_set1_epi32(mask);
+    __m256i select = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i set;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        set = _mm256_cmpeq_epi32(_mm256_and_si256(bits, select), select);
+        _mm256_storeu_si256((__m256i *) (out + 8 * i), _mm256_blendv_epi8(off, on, set));
+        select = _mm256_slli_epi32(select, 8);
+    }
+}
+
+/* 32 columns at a time.  A column is one 256-bit load, so transposing 16 columns gives bytes 0-15 in the low lanes and
+   16-31 in the high ones; the lanes of the two groups of 16 are then paired up into rows of 32 columns. */
+__attribute__((target("avx2")))
+static void expand_avx2(const uint8_t *columns, uint32_t *pixels, int pitch, int first, int count, uint32_t on,
+                        uint32_t off) {
+    __m256i low[16], high[16], bytes;
+    __m256i on_pixels = _mm256_set1_epi32(on), off_pixels = _mm256_set1_epi32(off);
+    uint32_t *out;
+    int x, half, i, bit;
+
+    for (x = first; x + 32 <= first + count; x += 32) {
+        for (i = 0; i < 16; i++) {
+            low[i] = _mm256_loadu_si256((const __m256i *) (columns + (x + i) * VIDEO_COLUMN_BYTES));
+            high[i] = _mm256_loadu_si256((const __m256i *) (columns + (x + 16 + i) * VIDEO_COLUMN_BYTES));
+        }
+        transpose_16x16_avx2(low);
+        transpose_16x16_avx2(high);
+        for (half = 0; half < 2; half++) {
+            for (i = 0; i < 16; i++) {
+                bytes = half ? _mm256_permute2x128_si256(low[i], high[i], 0x31)
+                             : _mm256_permute2x128_si256(low[i], high[i], 0x20);
+                out = pixels + (VIDEO_COLUMN_HEIGHT - 8 * (16 * half + i + 1)) * pitch + x;
+                for (bit = 7; bit >= 0; bit--) {
+                    store_pixels_avx2(out, (uint32_t) _mm256_movemask_epi8(bytes), on_pixels, off_pixels);
+                    bytes = _mm256_add_epi8(bytes, bytes);
+                    out += pitch;
+                }
+            }
+        }
+    }
+    if (x < first + count) {
+        expand_sse2(columns, pixels, pitch, x, first + count - x, on, off);
+    }
+}
+
+/* 8 pixels of a row at a time: wide vector i holds pixels (8i + j) / factor of them, gathered with
+   _mm256_permutevar8x32_epi32. */
+__attribute__((target("avx2")))
+static void scale_avx2(const uint32_t *pixels, int pitch, int height, int first, int count, uint32_t *scaled,
+                       int scaled_pitch, int factor, bool scanlines) {
+    __m256i spread[VIDEO_MAX_SCALE], wide, pixel;
+    __m256i alpha = _mm256_set1_epi32(0xFF000000), half = _mm256_set1_epi32(0x007F7F7F);
+    int32_t index[8];
+    int wide_end = first + count / 8 * 8;  // the columns done 8 at a time end here
+    int x, y, row, i, j;
+
+    for (i = 0; i < factor; i++) {
+        for (j = 0; j < 8; j++) {
+            index[j] = (8 * i + j) / factor;
+        }
+        spread[i] = _mm256_loadu_si256((const __m256i *) index);
+    }
+    for (y = 0; y < height; y++) {
+        for (x = first; x < wide_end; x += 8) {
+            pixel = _mm256_loadu_si256((const __m256i *) (pixels + y * pitch + x));
+            for (i = 0; i < factor; i++) {
+                wide = _mm256_permutevar8x32_epi32(pixel, spread[i]);
+                for (row = 0; row < factor; row++) {
+                    if (scanlines && factor > 1 && row == factor - 1) {
+                        wide = _mm256_or_si256(_mm256_and_si256(wide, alpha),
+                                               _mm256_and_si256(_mm256_srli_epi32(wide, 1), half));
+                    }
+                    _mm256_storeu_si256((__m256i *) (scaled_row(scaled, scaled_pitch, y, factor, row) + x * factor +
+                                                     8 * i), wide);
+                }
+            }
+        }
+    }
+    if (wide_end < first + count) {
+        scale_sse2(pixels, pitch, height, wide_end, first + count - wide_end, scaled, scaled_pitch, factor,
+                   scanlines);
+    }
+}
+
+#endif
+
+/*
+Writes columns first to first + count - 1 of the rotated screen in columns to pixels, which points at pixel (0, 0) of
+an upright screen VIDEO_COLUMN_HEIGHT rows high with pitch pixels a row.  A set bit becomes on and a clear one off.
+The kernel must be one that video_kernel_supported().
+*/
+void expand_video_columns(video_kernel kernel, const uint8_t *columns, uint32_t *pixels, int pitch, int first,
+                          int count, uint32_t on, uint32_t off) {
+    switch (kernel) {
+#ifdef VIDEO_HAS_X86_KERNELS
+        case VIDEO_KERNEL_AVX2:
+            expand_avx2(columns, pixels, pitch, first, count, on, off);
+            break;
+        case VIDEO_KERNEL_SSE2:
+            expand_sse2(columns, pixels, pitch, first, count, on, off);
+            break;
+#endif
+        default:
+            expand_scalar(columns, pixels, pitch, first, count, on, off);
+            break;
+    }
+}
+
+/*
+Scales columns first to first + count - 1 of pixels, height rows with pitch pixels a row, up by factor (1 to
+VIDEO_MAX_SCALE) into scaled, which has scaled_pitch pixels a row: pixel (x, y) becomes the factor by factor block at
+(x * factor, y * factor).  With scanlines, the last row of each block is at half brightness.
+*/
+void scale_video_pixels(video_kernel kernel, const uint32_t *pixels, int pitch, int height, int first, int count,
+                        uint32_t *scaled, int scaled_pitch, int factor, bool scanlines) {
+    switch (kernel) {
+#ifdef VIDEO_HAS_X86_KERNELS
+        case VIDEO_KERNEL_AVX2:
+            scale_avx2(pixels, pitch, height, first, count, scaled, scaled_pitch, factor, scanlines);
+            break;
+        case VIDEO_KERNEL_SSE2:
+            scale_sse2(pixels, pitch, height, first, count, scaled, scaled_pitch, factor, scanlines);
+            break;
+#endif
+        default:
+            scale_scalar(pixels, pitch, height, first, count, scaled, scaled_pitch, factor, scanlines);
+            break;
+    }
+}
+
+// Buffer 0 is the producer's, 1 is in the middle and 2 is the consumer's, and there is no frame yet.
+void init_video_triple_buffer(video_triple_buffer *frames) {
+    frames->back = 0;
+    atomic_init(&(frames->middle), 1);
+    frames->front = 2;
+}
+
+/* Publishes the back buffer as the newest frame, and gives the producer the middle one to fill next.  Returns false if
+   the frame published before it was dropped: the consumer never took it. */
+bool publish_video_frame(video_triple_buffer *frames) {
+    unsigned int old_middle = atomic_exchange(&(frames->middle), frames->back | VIDEO_FRAME_FRESH);
+
+    frames->back = old_middle & ~VIDEO_FRAME_FRESH;
+    return !(old_middle & VIDEO_FRAME_FRESH);
+}
+
+// Makes the newest frame the front buffer, if one was published since the last call.  Returns false if not.
+bool take_video_frame(video_triple_buffer *frames) {
+    unsigned int old_middle;
+
+    if (!(atomic_load(&(frames->middle)) & VIDEO_FRAME_FRESH)) {
+        return false;
+    }
+    old_middle = atomic_exchange(&(frames->middle), frames->front);
+    frames->front = old_middle & ~VIDEO_FRAME_FRESH;
+    return true;
+}
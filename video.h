@@ -0,0 +1,63 @@
+#ifndef VIDEO_8080_H
+#define VIDEO_8080_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/*
+Screens that are stored rotated a quarter turn, the way the Space Invaders one is: each column of the screen is
+VIDEO_COLUMN_BYTES bytes from the bottom of the screen up, least significant bit first, so bit k of byte b of column x
+is pixel (x, VIDEO_COLUMN_HEIGHT - 1 - 8b - k).  expand_video_columns() turns columns of such a screen into upright
+32-bit pixels.
+
+The kernels that do it are picked at run time.  The SSE2 and AVX2 ones transpose the bits of 16 or 32 columns at a
+time with byte unpacks and movemask, and expand each row of bits into pixels with compares; columns left over go to the
+next smaller kernel.  Every kernel gives the same pixels as the scalar one.
+
+scale_video_pixels() blows pixels up by a whole number, nearest neighbor, so 1 bit art stays sharp at any window size.
+It can draw every factor'th row at half brightness, for the look of the gaps between a CRT's scanlines.  The same
+kernels do it: they widen 4 or 8 pixels at a time with shuffles and store each widened row factor times.
+
+A triple buffer hands frames from the thread that makes them to the thread that shows them without either one waiting
+for the other.  The producer fills its back buffer and publishes it; the consumer takes the newest published frame, if
+there is one it hasn't taken, as its front buffer.  Frames the consumer is too slow for are dropped.  The third buffer
+sits in the middle, and each side swaps with it in one atomic exchange.
+*/
+#define VIDEO_COLUMN_BYTES 32
+#define VIDEO_COLUMN_HEIGHT (VIDEO_COLUMN_BYTES * 8)
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define VIDEO_HAS_X86_KERNELS
+#endif
+
+typedef enum video_kernel {
+    VIDEO_KERNEL_SCALAR,
+    VIDEO_KERNEL_SSE2,
+    VIDEO_KERNEL_AVX2,
+    VIDEO_NUM_KERNELS
+} video_kernel;
+
+#define VIDEO_MAX_SCALE 4
+
+// Set in video_triple_buffer.middle while the middle buffer holds a frame the consumer hasn't taken
+#define VIDEO_FRAME_FRESH 0x4
+
+typedef struct video_triple_buffer {
+    int back;            // only the producer uses it
+    atomic_uint middle;  // buffer index, with VIDEO_FRAME_FRESH
+    int front;           // only the consumer uses it
+} video_triple_buffer;
+
+const char *video_kernel_name(video_kernel kernel);
+bool video_kernel_supported(video_kernel kernel);
+video_kernel best_video_kernel();
+void expand_video_columns(video_kernel kernel, const uint8_t *columns, uint32_t *pixels, int pitch, int first,
+                          int count, uint32_t on, uint32_t off);
+void scale_video_pixels(video_kernel kernel, const uint32_t *pixels, int pitch, int height, int first, int count,
+                        uint32_t *scaled, int scaled_pitch, int factor, bool scanlines);
+void init_video_triple_buffer(video_triple_buffer *frames);
+bool publish_video_frame(video_triple_buffer *frames);
+bool take_video_frame(video_triple_buffer *frames);
+
+#endif